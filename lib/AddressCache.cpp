@@ -0,0 +1,86 @@
+/**
+ * Cache file of the HDLC physical addresses found by the discovery scan
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <fstream>
+#include <json/json.h>
+#include "AddressCache.h"
+#include "Log.h"
+
+std::mutex AddressCache::mMutex;
+
+// A missing file is an empty cache
+static void Load(const std::string &file, Json::Value &root)
+{
+    std::ifstream ifs(file, std::ifstream::binary);
+    root = Json::Value(Json::objectValue);
+
+    if (ifs)
+    {
+        Json::CharReaderBuilder builder;
+        JSONCPP_STRING errs;
+
+        if (!parseFromStream(builder, ifs, &root, &errs) || !root.isObject())
+        {
+            LOG(LOG_ERROR, "** Error parsing " << file << " : " << errs);
+            root = Json::Value(Json::objectValue);
+        }
+    }
+}
+
+static bool Save(const std::string &file, const Json::Value &root)
+{
+    std::ofstream ofs(file, std::ofstream::binary | std::ofstream::trunc);
+
+    if (!ofs)
+    {
+        LOG(LOG_ERROR, "** Cannot write address cache: " << file);
+        return false;
+    }
+
+    Json::StreamWriterBuilder builder;
+    ofs << Json::writeString(builder, root) << std::endl;
+    return true;
+}
+
+bool AddressCache::Find(const std::string &file, const std::string &meterId, uint16_t &address)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Json::Value root;
+
+    Load(file, root);
+    Json::Value val = root.get(meterId, Json::Value());
+    if (val.isInt())
+    {
+        address = static_cast<uint16_t>(val.asInt());
+        return true;
+    }
+    return false;
+}
+
+bool AddressCache::Store(const std::string &file, const std::string &meterId, uint16_t address)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Json::Value root;
+
+    Load(file, root);
+    root[meterId] = static_cast<int>(address);
+    return Save(file, root);
+}
+
+bool AddressCache::Remove(const std::string &file, const std::string &meterId)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Json::Value root;
+
+    Load(file, root);
+    root.removeMember(meterId);
+    return Save(file, root);
+}
@@ -0,0 +1,37 @@
+/**
+ * Cache file of the HDLC physical addresses found by the discovery scan
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef ADDRESS_CACHE_H
+#define ADDRESS_CACHE_H
+
+#include <string>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * JSON object, one member per meter ID:
+ *
+ * { "saphir0899": 17, "saphir0900": 18 }
+ *
+ * The file is shared by the sessions of all the serial ports of the process.
+ */
+class AddressCache
+{
+public:
+    static bool Find(const std::string &file, const std::string &meterId, uint16_t &address);
+    static bool Store(const std::string &file, const std::string &meterId, uint16_t address);
+    static bool Remove(const std::string &file, const std::string &meterId);
+
+private:
+    static std::mutex mMutex;
+};
+
+#endif // ADDRESS_CACHE_H
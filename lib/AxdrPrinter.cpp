@@ -138,6 +138,20 @@ std::string DateFromCosem(uint32_t size, uint8_t *data)
 }
 
 
+AxdrPrinter::AxdrPrinter()
+{
+    ClearRows();
+}
+
+void AxdrPrinter::ClearRows()
+{
+    mSkipRoot = false;
+    mRows = 0U;
+    mRowsEnd = 0U;
+    mHasRowClock = false;
+    mHasLastRowClock = false;
+}
+
 void AxdrPrinter::PrintIndent()
 {
     for (uint32_t i = 0U; i < mLevels.size(); i++)
@@ -316,12 +330,64 @@ std::string AxdrPrinter::Get()
     return mStream.str();
 }
 
+void AxdrPrinter::Flush(std::ostream &out)
+{
+    out << mStream.str();
+    mStream.str("");
+}
+
 void AxdrPrinter::Start(const std::string &infos)
 {
     mStream.str("");
+    ClearRows();
     mStream  << "<Root " << infos <<  ">" << std::endl;
 }
 
+void AxdrPrinter::Continue()
+{
+    Clear();
+    mSkipRoot = true;
+}
+
+void AxdrPrinter::FlushRows(std::ostream &out)
+{
+    std::string text = mStream.str();
+
+    out << text.substr(0U, mRowsEnd);
+    mStream.str("");
+    mStream << text.substr(mRowsEnd);
+    mRowsEnd = 0U;
+}
+
+bool AxdrPrinter::LastRowClock(std::tm &tm) const
+{
+    clk_datetime_t clk;
+    csm_array array;
+    uint8_t clock[cClockSize];
+
+    if (!mHasLastRowClock)
+    {
+        return false;
+    }
+
+    std::memcpy(&clock[0], &mLastRowClock[0], cClockSize);
+    csm_array_init(&array, &clock[0], cClockSize, cClockSize, 0);
+    if (!clk_datetime_from_cosem(&clk, &array))
+    {
+        return false;
+    }
+
+    tm = std::tm();
+    tm.tm_year = clk.date.year - 1900;
+    tm.tm_mon = clk.date.month - 1;
+    tm.tm_mday = clk.date.day;
+    tm.tm_hour = clk.time.hour;
+    tm.tm_min = clk.time.minute;
+    tm.tm_sec = clk.time.second;
+    tm.tm_isdst = -1;
+    return true;
+}
+
 void AxdrPrinter::End()
 {
     mStream  << "</Root>" << std::endl;
@@ -330,12 +396,40 @@ void AxdrPrinter::End()
 void AxdrPrinter::Append(uint8_t type, uint32_t size, uint8_t *data)
 {
     std::string name = TagName(type);
+    size_t depth = mLevels.size();
 
-    PrintIndent();
+    if ((mLevels.size() == 1U) && ((type == AXDR_TAG_ARRAY) || (type == AXDR_TAG_STRUCTURE)))
+    {
+        // New row
+        mHasRowClock = false;
+    }
+    else if ((mLevels.size() == 2U) && (mLevels.back().counter == 0U) &&
+             (type == AXDR_TAG_OCTETSTRING) && (size == cClockSize))
+    {
+        std::memcpy(&mRowClock[0], data, cClockSize);
+        mHasRowClock = true;
+    }
 
-    if ((type == AXDR_TAG_ARRAY) ||
+    if (mSkipRoot && (mLevels.size() == 0U) &&
+        ((type == AXDR_TAG_ARRAY) || (type == AXDR_TAG_STRUCTURE)))
+    {
+        // Already printed with the previous rows
+        Element root;
+
+        root.counter = 0;
+        root.size = size;
+        root.type = type;
+        mLevels.push_back(root);
+        mSkipRoot = false;
+        if (size > 0U)
+        {
+            return;
+        }
+    }
+    else if ((type == AXDR_TAG_ARRAY) ||
         (type == AXDR_TAG_STRUCTURE))
     {
+        PrintIndent();
         mStream  << "<" << name << " size=\"" << size << "\">" << std::endl;
 
         if (mLevels.size() > 0)
@@ -356,6 +450,8 @@ void AxdrPrinter::Append(uint8_t type, uint32_t size, uint8_t *data)
     	std::string hint;
     	std::string value = DataToString(type, size, data, hint);
 
+        PrintIndent();
+
         mStream << "<" << name << " value=\"" << value;
 
         if (hint.size() > 0)
@@ -391,5 +487,17 @@ void AxdrPrinter::Append(uint8_t type, uint32_t size, uint8_t *data)
             break;
         }
     }
+
+    if ((depth > 0U) && (mLevels.size() <= 1U))
+    {
+        // Back in the root element, or past it: the row is complete
+        mRows++;
+        mRowsEnd = static_cast<size_t>(mStream.tellp());
+        mHasLastRowClock = mHasRowClock;
+        if (mHasRowClock)
+        {
+            std::memcpy(&mLastRowClock[0], &mRowClock[0], cClockSize);
+        }
+    }
 }
 
@@ -15,6 +15,7 @@
 #include <vector>
 #include <sstream>
 #include <cstdint>
+#include <ctime>
 
 struct Element
 {
@@ -29,25 +30,48 @@ class AxdrPrinter
 {
 
 public:
+    AxdrPrinter();
 
     void Clear()
     {
         mStream.str("");
         mLevels.clear();
+        ClearRows();
     }
 
     void Start(const std::string &infos = "");
+    // The data continues the rows of a dump already written: neither the header nor
+    // the root element are printed
+    void Continue();
     void End();
     void Append(uint8_t type, uint32_t size, uint8_t *data);
     std::string Get();
+    // Writes the text printed so far and forgets it, the open levels are kept
+    void Flush(std::ostream &out);
+
+    // Rows are the children of the root element (profile buffer entries)
+    void FlushRows(std::ostream &out);
+    uint32_t Rows() const { return mRows; }
+    // Clock of the last complete row: its first element, when it is a date-time
+    bool LastRowClock(std::tm &tm) const;
 
 private:
     void PrintIndent();
+    void ClearRows();
     static std::string DataToString(uint8_t type, uint32_t size, uint8_t *data, std::string &hint);
 
     std::vector<Element> mLevels;
     std::stringstream mStream;
 
+    static const uint32_t cClockSize = 12U;
+    bool mSkipRoot;
+    uint32_t mRows;
+    size_t mRowsEnd; // Text size up to the end of the last complete row
+    uint8_t mRowClock[cClockSize];
+    bool mHasRowClock;
+    uint8_t mLastRowClock[cClockSize];
+    bool mHasLastRowClock;
+
 };
 
 
@@ -0,0 +1,209 @@
+/**
+ * Resumable A-XDR decoder: data is given block by block, each complete element
+ * is passed to the adder as soon as it is received
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <cstddef>
+#include "AxdrStream.h"
+
+// Length of an array or a string: one byte, or 0x8N followed by N bytes.
+// Returns the encoded size, 0 if incomplete, -1 if invalid
+static int DecodeLength(const uint8_t *data, uint32_t size, uint32_t &length)
+{
+    if (size == 0U)
+    {
+        return 0;
+    }
+    if (data[0] < 0x80U)
+    {
+        length = data[0];
+        return 1;
+    }
+
+    uint32_t bytes = data[0] & 0x7FU;
+    if ((bytes == 0U) || (bytes > 4U))
+    {
+        return -1;
+    }
+    if (size <= bytes)
+    {
+        return 0;
+    }
+    length = 0U;
+    for (uint32_t i = 1U; i <= bytes; i++)
+    {
+        length = (length << 8U) | data[i];
+    }
+    return static_cast<int>(bytes) + 1;
+}
+
+AxdrStream::AxdrStream()
+    : mAdder(NULL)
+    , mFinished(false)
+    , mError(false)
+{
+
+}
+
+void AxdrStream::Start(Adder adder)
+{
+    mAdder = adder;
+    mPending.clear();
+    mRemaining.clear();
+    mFinished = false;
+    mError = false;
+}
+
+bool AxdrStream::Feed(const uint8_t *data, uint32_t size)
+{
+    if (mError)
+    {
+        return false;
+    }
+
+    mPending.insert(mPending.end(), data, data + size);
+
+    uint32_t pos = 0U;
+    while (!mFinished && (pos < mPending.size()))
+    {
+        uint32_t used = 0U;
+        int ret = Decode(&mPending[pos], static_cast<uint32_t>(mPending.size()) - pos, used);
+
+        if (ret < 0)
+        {
+            mError = true;
+            return false;
+        }
+        if (ret == 0)
+        {
+            break;
+        }
+        pos += used;
+    }
+
+    // Data after the root element is ignored
+    mPending.erase(mPending.begin(), mFinished ? mPending.end() : (mPending.begin() + pos));
+    return true;
+}
+
+// One element, children excluded. Returns 1 when decoded, 0 if incomplete, -1 on error
+int AxdrStream::Decode(uint8_t *data, uint32_t size, uint32_t &used)
+{
+    uint32_t fixed = 0U;
+
+    switch (data[0])
+    {
+    case 0U:   // null-data
+    case 255U: // dont-care
+        fixed = 0U;
+        break;
+    case 3U:   // boolean
+    case 13U:  // bcd
+    case 15U:  // integer
+    case 17U:  // unsigned
+    case 22U:  // enum
+        fixed = 1U;
+        break;
+    case 16U:  // long
+    case 18U:  // long-unsigned
+        fixed = 2U;
+        break;
+    case 5U:   // double-long
+    case 6U:   // double-long-unsigned
+    case 23U:  // float32
+    case 27U:  // time
+        fixed = 4U;
+        break;
+    case 26U:  // date
+        fixed = 5U;
+        break;
+    case 20U:  // long64
+    case 21U:  // long64-unsigned
+    case 24U:  // float64
+        fixed = 8U;
+        break;
+    case 25U:  // date-time
+        fixed = 12U;
+        break;
+    case 1U:   // array
+    case 2U:   // structure
+    {
+        uint32_t count;
+        int header = DecodeLength(&data[1], size - 1U, count);
+        if (header <= 0)
+        {
+            return header;
+        }
+        used = 1U + static_cast<uint32_t>(header);
+        mAdder(data[0], count, NULL);
+        if (count > 0U)
+        {
+            mRemaining.push_back(count);
+        }
+        else
+        {
+            Complete();
+        }
+        return 1;
+    }
+    case 4U:   // bit-string, length in bits
+    case 9U:   // octet-string
+    case 10U:  // visible-string
+    case 12U:  // utf8-string
+    {
+        uint32_t length;
+        int header = DecodeLength(&data[1], size - 1U, length);
+        if (header <= 0)
+        {
+            return header;
+        }
+        uint32_t bytes = (data[0] == 4U) ? ((length + 7U) / 8U) : length;
+        used = 1U + static_cast<uint32_t>(header) + bytes;
+        if (used > size)
+        {
+            return 0;
+        }
+        mAdder(data[0], length, &data[1U + header]);
+        Complete();
+        return 1;
+    }
+    default:
+        // compact-array and unknown types are not supported
+        return -1;
+    }
+
+    used = 1U + fixed;
+    if (used > size)
+    {
+        return 0;
+    }
+    mAdder(data[0], fixed, &data[1]);
+    Complete();
+    return 1;
+}
+
+// An element is complete: close the arrays and structures it ends
+void AxdrStream::Complete()
+{
+    for (;;)
+    {
+        if (mRemaining.size() == 0U)
+        {
+            mFinished = true;
+            break;
+        }
+        mRemaining.back()--;
+        if (mRemaining.back() > 0U)
+        {
+            break;
+        }
+        mRemaining.pop_back();
+    }
+}
@@ -0,0 +1,48 @@
+/**
+ * Resumable A-XDR decoder: data is given block by block, each complete element
+ * is passed to the adder as soon as it is received
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef AXDR_STREAM_H
+#define AXDR_STREAM_H
+
+#include <cstdint>
+#include <vector>
+
+class AxdrStream
+{
+public:
+    // Same signature as the Cosem library tag decoder callback
+    typedef void (*Adder)(uint8_t type, uint32_t size, uint8_t *data);
+
+    AxdrStream();
+
+    void Start(Adder adder);
+
+    // Decodes all the complete elements, an element cut between two blocks is kept
+    // for the next call. Returns false on malformed or unsupported data
+    bool Feed(const uint8_t *data, uint32_t size);
+
+    // The root element and all its children have been decoded
+    bool Finished() const { return mFinished; }
+    uint32_t Pending() const { return static_cast<uint32_t>(mPending.size()); }
+
+private:
+    Adder mAdder;
+    std::vector<uint8_t> mPending; // Start of an incomplete element
+    std::vector<uint32_t> mRemaining; // Elements left in each open array or structure
+    bool mFinished;
+    bool mError;
+
+    int Decode(uint8_t *data, uint32_t size, uint32_t &used);
+    void Complete();
+};
+
+#endif // AXDR_STREAM_H
@@ -0,0 +1,175 @@
+/**
+ * Lock-free single-producer/single-consumer byte ring
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef BYTE_RING_H
+#define BYTE_RING_H
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <vector>
+
+/**
+ * The producer (link reader) writes directly into WriteSpan() and publishes
+ * with Commit(); the consumer (protocol thread) parses ReadSpan() in place and
+ * releases with Consume(). Indexes are free-running, the capacity is a power of two.
+ * Each side must only be used by one thread.
+ */
+class ByteRing
+{
+public:
+    explicit ByteRing(uint32_t capacity)
+        : mBuffer(RoundUp(capacity))
+        , mMask(static_cast<uint32_t>(mBuffer.size()) - 1U)
+        , mHead(0U)
+        , mTail(0U)
+    {
+
+    }
+
+    uint32_t Capacity() const { return mMask + 1U; }
+
+    // Only while neither side is in use: the content is lost
+    void Resize(uint32_t capacity)
+    {
+        if (RoundUp(capacity) != Capacity())
+        {
+            std::vector<uint8_t>(RoundUp(capacity)).swap(mBuffer);
+            mMask = static_cast<uint32_t>(mBuffer.size()) - 1U;
+        }
+        mHead.store(0U, std::memory_order_relaxed);
+        mTail.store(0U, std::memory_order_relaxed);
+    }
+
+    // ------------------------------ Producer side ------------------------------
+
+    // Contiguous free room at the write position
+    uint32_t WriteSpan(uint8_t *&ptr)
+    {
+        uint32_t head = mHead.load(std::memory_order_relaxed);
+        uint32_t tail = mTail.load(std::memory_order_acquire);
+        uint32_t free = Capacity() - (head - tail);
+        uint32_t index = head & mMask;
+        uint32_t toEnd = Capacity() - index;
+
+        ptr = &mBuffer[index];
+        return (free < toEnd) ? free : toEnd;
+    }
+
+    void Commit(uint32_t size)
+    {
+        mHead.store(mHead.load(std::memory_order_relaxed) + size, std::memory_order_release);
+    }
+
+    uint32_t Write(const uint8_t *data, uint32_t size)
+    {
+        uint32_t written = 0U;
+
+        while (written < size)
+        {
+            uint8_t *ptr;
+            uint32_t span = WriteSpan(ptr);
+            if (span == 0U)
+            {
+                break;
+            }
+            if (span > (size - written))
+            {
+                span = size - written;
+            }
+            std::memcpy(ptr, &data[written], span);
+            Commit(span);
+            written += span;
+        }
+        return written;
+    }
+
+    // ------------------------------ Consumer side ------------------------------
+
+    uint32_t Readable() const
+    {
+        return mHead.load(std::memory_order_acquire) - mTail.load(std::memory_order_relaxed);
+    }
+
+    // Contiguous readable bytes at the read position (may be less than Readable() on wrap)
+    uint32_t ReadSpan(const uint8_t *&ptr) const
+    {
+        uint32_t tail = mTail.load(std::memory_order_relaxed);
+        uint32_t used = mHead.load(std::memory_order_acquire) - tail;
+        uint32_t index = tail & mMask;
+        uint32_t toEnd = Capacity() - index;
+
+        ptr = &mBuffer[index];
+        return (used < toEnd) ? used : toEnd;
+    }
+
+    // All the readable bytes as one block: a borrowed span of the ring, or a copy
+    // into 'linear' in the rare case where they wrap around the end of the storage
+    uint32_t Peek(const uint8_t *&ptr, uint8_t *linear, uint32_t linearSize) const
+    {
+        uint32_t tail = mTail.load(std::memory_order_relaxed);
+        uint32_t used = mHead.load(std::memory_order_acquire) - tail;
+        uint32_t index = tail & mMask;
+        uint32_t toEnd = Capacity() - index;
+
+        if (used <= toEnd)
+        {
+            ptr = &mBuffer[index];
+        }
+        else
+        {
+            if (used > linearSize)
+            {
+                used = linearSize;
+            }
+            std::memcpy(linear, &mBuffer[index], toEnd);
+            std::memcpy(&linear[toEnd], &mBuffer[0], used - toEnd);
+            ptr = linear;
+        }
+        return used;
+    }
+
+    void Consume(uint32_t size)
+    {
+        mTail.store(mTail.load(std::memory_order_relaxed) + size, std::memory_order_release);
+    }
+
+    // Forget everything received so far
+    void Clear()
+    {
+        mTail.store(mHead.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    std::vector<uint8_t> mBuffer;
+    uint32_t mMask;
+
+    // Separate cache lines: each index is written by one side only. Padding
+    // rather than alignas() so that the owners can still be allocated with new.
+    static const uint32_t cCacheLine = 64U;
+    uint8_t mPad0[cCacheLine];
+    std::atomic<uint32_t> mHead;
+    uint8_t mPad1[cCacheLine - sizeof(std::atomic<uint32_t>)];
+    std::atomic<uint32_t> mTail;
+    uint8_t mPad2[cCacheLine - sizeof(std::atomic<uint32_t>)];
+
+    static uint32_t RoundUp(uint32_t value)
+    {
+        uint32_t size = 1U;
+        while (size < value)
+        {
+            size <<= 1U;
+        }
+        return size;
+    }
+};
+
+#endif // BYTE_RING_H
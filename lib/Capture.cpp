@@ -0,0 +1,135 @@
+/**
+ * Binary capture of the link traffic
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <cstring>
+#include "Capture.h"
+#include "Log.h"
+
+const char Capture::cMagic[8] = { 'C', 'S', 'M', 'C', 'A', 'P', '0', '1' };
+
+static const uint32_t cRecordHeaderSize = 13U;
+
+Capture::Capture()
+    : mFile(NULL)
+{
+
+}
+
+Capture::~Capture()
+{
+    Close();
+}
+
+bool Capture::Open(const std::string &fileName)
+{
+    bool ok = false;
+
+    Close();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFile = std::fopen(fileName.c_str(), "wb");
+    if (mFile != NULL)
+    {
+        ok = (std::fwrite(cMagic, sizeof(cMagic), 1U, mFile) == 1U);
+        mStart = std::chrono::steady_clock::now();
+        LOG(LOG_INFO, "** Capturing link traffic into " << fileName);
+    }
+    else
+    {
+        LOG(LOG_ERROR, "** Cannot create capture file: " << fileName);
+    }
+    return ok;
+}
+
+void Capture::Close()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mFile != NULL)
+    {
+        std::fclose(mFile);
+        mFile = NULL;
+    }
+}
+
+void Capture::Write(Direction direction, const uint8_t *data, uint32_t size)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mFile != NULL)
+    {
+        uint64_t timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now() - mStart).count());
+        uint8_t header[cRecordHeaderSize];
+
+        header[0] = static_cast<uint8_t>(direction);
+        for (uint32_t i = 0U; i < 8U; i++)
+        {
+            header[1U + i] = static_cast<uint8_t>(timestamp >> (8U * i));
+        }
+        for (uint32_t i = 0U; i < 4U; i++)
+        {
+            header[9U + i] = static_cast<uint8_t>(size >> (8U * i));
+        }
+
+        std::fwrite(header, cRecordHeaderSize, 1U, mFile);
+        std::fwrite(data, 1U, size, mFile);
+    }
+}
+
+bool Capture::Load(const std::string &fileName, std::vector<Record> &records)
+{
+    bool ok = false;
+    std::FILE *file = std::fopen(fileName.c_str(), "rb");
+
+    if (file != NULL)
+    {
+        char magic[sizeof(cMagic)];
+        ok = (std::fread(magic, sizeof(magic), 1U, file) == 1U) &&
+             (std::memcmp(magic, cMagic, sizeof(cMagic)) == 0);
+
+        uint8_t header[cRecordHeaderSize];
+        while (ok && (std::fread(header, cRecordHeaderSize, 1U, file) == 1U))
+        {
+            Record record;
+            uint32_t size = 0U;
+
+            record.direction = (header[0] == SENT) ? SENT : RECEIVED;
+            record.timestamp = 0U;
+            for (uint32_t i = 0U; i < 8U; i++)
+            {
+                record.timestamp |= static_cast<uint64_t>(header[1U + i]) << (8U * i);
+            }
+            for (uint32_t i = 0U; i < 4U; i++)
+            {
+                size |= static_cast<uint32_t>(header[9U + i]) << (8U * i);
+            }
+
+            record.data.resize(size);
+            if ((size > 0U) && (std::fread(&record.data[0], size, 1U, file) != 1U))
+            {
+                LOG(LOG_ERROR, "** Truncated capture record in " << fileName);
+                ok = false;
+            }
+            else
+            {
+                records.push_back(record);
+            }
+        }
+        std::fclose(file);
+    }
+
+    if (!ok)
+    {
+        LOG(LOG_ERROR, "** Cannot load capture file: " << fileName);
+    }
+    return ok;
+}
@@ -0,0 +1,66 @@
+/**
+ * Binary capture of the link traffic
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+/**
+ * File layout: the 8-byte magic "CSMCAP01", then one record per chunk:
+ *
+ *   direction  (1 byte: 0 = sent, 1 = received)
+ *   timestamp  (8 bytes, little endian: microseconds since the capture start, monotonic)
+ *   size       (4 bytes, little endian)
+ *   data       (size bytes)
+ */
+class Capture
+{
+public:
+    enum Direction
+    {
+        SENT = 0,
+        RECEIVED = 1
+    };
+
+    struct Record
+    {
+        Direction direction;
+        uint64_t timestamp;
+        std::string data;
+    };
+
+    Capture();
+    ~Capture();
+
+    bool Open(const std::string &fileName);
+    void Close();
+    bool IsOpen() const { return mFile != NULL; }
+
+    // Thread safe: the sent and received chunks come from different threads
+    void Write(Direction direction, const uint8_t *data, uint32_t size);
+
+    static bool Load(const std::string &fileName, std::vector<Record> &records);
+
+private:
+    static const char cMagic[8];
+
+    std::FILE *mFile;
+    std::mutex mMutex;
+    std::chrono::steady_clock::time_point mStart;
+};
+
+#endif // CAPTURE_H
@@ -0,0 +1,105 @@
+/**
+ * Checkpoint file of the profile reads interrupted by a link failure
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <fstream>
+#include <json/json.h>
+#include "Checkpoint.h"
+#include "Log.h"
+
+std::mutex Checkpoint::mMutex;
+
+// A missing file has no checkpoint
+static void Load(const std::string &file, Json::Value &root)
+{
+    std::ifstream ifs(file, std::ifstream::binary);
+    root = Json::Value(Json::objectValue);
+
+    if (ifs)
+    {
+        Json::CharReaderBuilder builder;
+        JSONCPP_STRING errs;
+
+        if (!parseFromStream(builder, ifs, &root, &errs) || !root.isObject())
+        {
+            LOG(LOG_ERROR, "** Error parsing " << file << " : " << errs);
+            root = Json::Value(Json::objectValue);
+        }
+    }
+}
+
+static bool Save(const std::string &file, const Json::Value &root)
+{
+    std::ofstream ofs(file, std::ofstream::binary | std::ofstream::trunc);
+
+    if (!ofs)
+    {
+        LOG(LOG_ERROR, "** Cannot write checkpoint file: " << file);
+        return false;
+    }
+
+    Json::StreamWriterBuilder builder;
+    ofs << Json::writeString(builder, root) << std::endl;
+    return true;
+}
+
+bool Checkpoint::Find(const std::string &file, const std::string &meterId, const std::string &object, Checkpoint &checkpoint)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Json::Value root;
+
+    Load(file, root);
+    Json::Value meter = root.get(meterId, Json::Value());
+    if (!meter.isObject())
+    {
+        return false;
+    }
+
+    Json::Value entry = meter.get(object, Json::Value());
+    if (!entry.isObject() || !entry["clock"].isString())
+    {
+        return false;
+    }
+
+    checkpoint.clock = entry["clock"].asString();
+    checkpoint.rows = entry["rows"].isInt() ? static_cast<uint32_t>(entry["rows"].asInt()) : 0U;
+    checkpoint.block = entry["block"].isInt() ? static_cast<uint32_t>(entry["block"].asInt()) : 0U;
+    return true;
+}
+
+bool Checkpoint::Store(const std::string &file, const std::string &meterId, const std::string &object, const Checkpoint &checkpoint)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Json::Value root;
+
+    Load(file, root);
+    Json::Value &entry = root[meterId][object];
+    entry["clock"] = checkpoint.clock;
+    entry["rows"] = static_cast<int>(checkpoint.rows);
+    entry["block"] = static_cast<int>(checkpoint.block);
+    return Save(file, root);
+}
+
+bool Checkpoint::Remove(const std::string &file, const std::string &meterId, const std::string &object)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Json::Value root;
+
+    Load(file, root);
+    if (root.isMember(meterId) && root[meterId].isObject())
+    {
+        root[meterId].removeMember(object);
+        if (root[meterId].size() == 0U)
+        {
+            root.removeMember(meterId);
+        }
+    }
+    return Save(file, root);
+}
@@ -0,0 +1,49 @@
+/**
+ * Checkpoint file of the profile reads interrupted by a link failure
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * JSON object, one member per meter ID then per object name:
+ *
+ * { "saphir0899": { "load_profile": { "clock": "2017-03-02.10:15:00", "rows": 1250, "block": 42 } } }
+ *
+ * The clock is the one of the last complete row written in the dump file, the
+ * next read starts just after it.
+ */
+class Checkpoint
+{
+public:
+    Checkpoint()
+        : rows(0U)
+        , block(0U)
+    {
+
+    }
+
+    std::string clock; // Same format as the session start date
+    uint32_t rows;     // Rows already in the dump file
+    uint32_t block;    // Last complete block received
+
+    static bool Find(const std::string &file, const std::string &meterId, const std::string &object, Checkpoint &checkpoint);
+    static bool Store(const std::string &file, const std::string &meterId, const std::string &object, const Checkpoint &checkpoint);
+    static bool Remove(const std::string &file, const std::string &meterId, const std::string &object);
+
+private:
+    static std::mutex mMutex;
+};
+
+#endif // CHECKPOINT_H
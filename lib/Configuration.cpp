@@ -12,14 +12,24 @@
 #include <iostream>
 #include <fstream>
 #include <cstdint>
+#include <algorithm>
 #include <json/json.h>
 #include "Configuration.h"
+#include "Xdlms.h"
+#include "Log.h"
 
 Configuration::Configuration()
-	: timeout_connect(3U)
-    , timeout_dial(70U)
-    , timeout_request(5U)
+	: timeout_connect(3000U)
+    , timeout_dial(70000U)
+    , timeout_request(5000U)
+    , timeout_inter_frame(0U)
+    , timeout_min(100U)
 	, retries(0)
+    , get_list_max(16U)
+    , concurrency(8U)
+    , gateway_concurrency(1U)
+    , stream(false)
+    , udp_local_port(0U)
 {
 
 }
@@ -38,11 +48,43 @@ Configuration::Configuration()
         },
 
         "retries": 1,
+        "get_list_max": 16,
+        "concurrency": 8,
+        "gateway_concurrency": 1,
+        "stream": false,
+        "checkpoint": "checkpoints.json",
+        "cursor": "cursors.json",
+        "log_level": "info",
+
+        "udp": {
+            "local_port": 4059
+        },
+
+        "discovery": {
+            "first": 16,
+            "last": 125,
+            "timeout": 0.2,
+            "cache": "hdlc_addresses.json"
+        },
+
+        "polling": {
+            "period": 900,
+            "cycles": 0,
+            "inactivity": 120
+        },
+
+        "on_failure": {
+            "continue": true,
+            "object_retries": 2,
+            "session_retries": 8
+        },
 
         "timeouts": {
             "dial": 90,
             "connect": 5,
-            "request": 5
+            "request": 5,
+            "inter_frame": 1.5,
+            "min": 0.1
         }
     },
 
@@ -50,10 +92,15 @@ Configuration::Configuration()
         {
             "id": "saphir0899",
             "transport": "hdlc",
+            "port": "bus1",
             "hdlc": {
                 "phy_addr": 17,
                 "address_size": 4,
-                "test_addr": false
+                "test_addr": false,
+                "max_info_tx": 128,
+                "max_info_rx": 512,
+                "window_tx": 1,
+                "window_rx": 7
             },
             "cosem": {
                 "auth_level": "LOW_LEVEL_SECURITY",
@@ -62,6 +109,55 @@ Configuration::Configuration()
                 "client": 1,
                 "logical_device": 1
             }
+        },
+        {
+            "id": "gateway0042",
+            "transport": "tcp",
+            "tcp": {
+                "address": "192.168.1.42",
+                "port": 4059
+            },
+            "cosem": {
+                "auth_level": "LOW_LEVEL_SECURITY",
+                "auth_password": "ABCDEFGH",
+                "auth_hls_secret": "000102030405060708090A0B0C0D0E0F",
+                "client": 1,
+                "logical_device": 1,
+                "client_max_pdu": 65535,
+                "gbt_window": 8
+            }
+        },
+        {
+            "id": "concentrator07",
+            "transport": "udp",
+            "udp": {
+                "address": "10.0.0.7",
+                "port": 4059
+            },
+            "cosem": {
+                "auth_level": "LOW_LEVEL_SECURITY",
+                "auth_password": "ABCDEFGH",
+                "auth_hls_secret": "000102030405060708090A0B0C0D0E0F",
+                "client": 1,
+                "logical_device": 1
+            }
+        },
+        {
+            "id": "saphir0899_public",
+            "transport": "hdlc",
+            "port": "bus1",
+            "hdlc": {
+                "phy_addr": 17,
+                "address_size": 4
+            },
+            "cosem": {
+                "auth_level": "NO_SECURITY",
+                "client": 16,
+                "logical_device": 1,
+                "association": "pre-established",
+                "conformance": 4116,
+                "max_pdu": 512
+            }
         }
     ]
 }
@@ -69,12 +165,21 @@ Configuration::Configuration()
 */
 
 // Very tolerant, use default values of classes if corresponding parameter is not found
+static void ReadTimeout(const Json::Value &timeoutsObj, const char *name, uint32_t &timeout)
+{
+    Json::Value val = timeoutsObj.get(name, Json::Value());
+    if (val.isNumeric() && (val.asDouble() >= 0.0))
+    {
+        timeout = static_cast<uint32_t>(val.asDouble() * 1000.0 + 0.5);
+    }
+}
+
 bool Configuration::ParseSessionFile(const std::string &file)
 {
     std::ifstream ifs(file, std::ifstream::binary);
     if(!ifs)
     {
-        std::cerr << "** Error opening file: " << file << std::endl;
+        LOG(LOG_ERROR, "** Error opening file: " << file);
         return false;
     }
 
@@ -85,8 +190,7 @@ bool Configuration::ParseSessionFile(const std::string &file)
     Json::Value val;
 
     if (!parseFromStream(builder, ifs, &json, &errs)) {
-        std::cerr << "** Error parsing " << file
-                  << " : "  << errs << std::endl;
+        LOG(LOG_ERROR, "** Error parsing " << file << " : " << errs);
         return false;
     }
 
@@ -99,6 +203,48 @@ bool Configuration::ParseSessionFile(const std::string &file)
             retries = static_cast<uint32_t>(val.asInt());
         }
 
+        val = session.get("get_list_max", Json::Value());
+        if (val.isInt())
+        {
+            get_list_max = static_cast<uint32_t>(val.asInt());
+        }
+
+        val = session.get("concurrency", Json::Value());
+        if (val.isInt() && (val.asInt() > 0))
+        {
+            concurrency = static_cast<uint32_t>(val.asInt());
+        }
+
+        val = session.get("gateway_concurrency", Json::Value());
+        if (val.isInt() && (val.asInt() > 0))
+        {
+            gateway_concurrency = static_cast<uint32_t>(val.asInt());
+        }
+
+        val = session.get("stream", Json::Value());
+        if (val.isBool())
+        {
+            stream = val.asBool();
+        }
+
+        val = session.get("checkpoint", Json::Value());
+        if (val.isString())
+        {
+            checkpoint = val.asString();
+        }
+
+        val = session.get("cursor", Json::Value());
+        if (val.isString())
+        {
+            cursor = val.asString();
+        }
+
+        val = session.get("log_level", Json::Value());
+        if (val.isString())
+        {
+            log_level = val.asString();
+        }
+
         // *********************************   MODEM   *********************************
 
         Json::Value modemObj = session.get("modem", Json::Value());
@@ -123,28 +269,98 @@ bool Configuration::ParseSessionFile(const std::string &file)
             }
         }
 
-        // *********************************   TIMEOUTS   *********************************
-        Json::Value timeoutsObj = session.get("timeouts", Json::Value());
-        if (timeoutsObj.isObject())
+        // *********************************   UDP   *********************************
+        Json::Value udpObj = session.get("udp", Json::Value());
+        if (udpObj.isObject())
         {
-            val = timeoutsObj.get("dial", Json::Value());
+            val = udpObj.get("local_port", Json::Value());
             if (val.isInt())
             {
-                timeout_dial = static_cast<uint32_t>(val.asInt());
+                udp_local_port = static_cast<uint16_t>(val.asInt());
             }
+        }
 
-            val = timeoutsObj.get("connect", Json::Value());
+        // *********************************   HDLC ADDRESS DISCOVERY   *********************************
+        Json::Value discoveryObj = session.get("discovery", Json::Value());
+        if (discoveryObj.isObject())
+        {
+            val = discoveryObj.get("first", Json::Value());
             if (val.isInt())
             {
-                timeout_connect = static_cast<uint32_t>(val.asInt());
+                discovery.first = static_cast<uint16_t>(val.asInt());
             }
 
-            val = timeoutsObj.get("request", Json::Value());
+            val = discoveryObj.get("last", Json::Value());
             if (val.isInt())
             {
-                timeout_request = static_cast<uint32_t>(val.asInt());
+                discovery.last = static_cast<uint16_t>(val.asInt());
+            }
+
+            ReadTimeout(discoveryObj, "timeout", discovery.timeout);
+
+            val = discoveryObj.get("cache", Json::Value());
+            if (val.isString())
+            {
+                discovery.cache = val.asString();
+            }
+        }
+
+        // *********************************   POLLING   *********************************
+        // Only the HDLC sessions keep their association between two cycles; the TCP/IP and
+        // UDP/IP meters of the worker pool are disconnected after each job and re-associate
+        Json::Value pollingObj = session.get("polling", Json::Value());
+        if (pollingObj.isObject())
+        {
+            // Seconds, like the timeouts
+            ReadTimeout(pollingObj, "period", polling.period);
+            ReadTimeout(pollingObj, "inactivity", polling.inactivity);
+
+            val = pollingObj.get("cycles", Json::Value());
+            if (val.isInt() && (val.asInt() >= 0))
+            {
+                polling.cycles = static_cast<uint32_t>(val.asInt());
+            }
+        }
+
+        // *********************************   ON FAILURE   *********************************
+        Json::Value failureObj = session.get("on_failure", Json::Value());
+        if (failureObj.isObject())
+        {
+            val = failureObj.get("continue", Json::Value());
+            if (val.isBool())
+            {
+                failure.keepOn = val.asBool();
+            }
+
+            val = failureObj.get("object_retries", Json::Value());
+            if (val.isInt() && (val.asInt() >= 0))
+            {
+                failure.objectRetries = static_cast<uint32_t>(val.asInt());
+            }
+
+            val = failureObj.get("session_retries", Json::Value());
+            if (val.isInt() && (val.asInt() >= 0))
+            {
+                failure.sessionRetries = static_cast<uint32_t>(val.asInt());
             }
         }
+
+        // *********************************   TIMEOUTS   *********************************
+        Json::Value timeoutsObj = session.get("timeouts", Json::Value());
+        if (timeoutsObj.isObject())
+        {
+            // Seconds, with a fractional part if needed
+            ReadTimeout(timeoutsObj, "dial", timeout_dial);
+            ReadTimeout(timeoutsObj, "connect", timeout_connect);
+            ReadTimeout(timeoutsObj, "request", timeout_request);
+            ReadTimeout(timeoutsObj, "inter_frame", timeout_inter_frame);
+            ReadTimeout(timeoutsObj, "min", timeout_min);
+        }
+    }
+
+    if ((timeout_inter_frame == 0U) || (timeout_inter_frame > timeout_request))
+    {
+        timeout_inter_frame = timeout_request;
     }
 
     Json::Value meterObj = json.get("meters", Json::Value());
@@ -154,6 +370,7 @@ bool Configuration::ParseSessionFile(const std::string &file)
         {
             //iter.key() << iter->asInt() << '\n';
             Meter meter;
+            meter.rtt.SetBounds(timeout_min, timeout_inter_frame);
             if (iter->isObject())
             {
                 val = iter->get("id", Json::Value());
@@ -162,6 +379,12 @@ bool Configuration::ParseSessionFile(const std::string &file)
                     meter.meterId = val.asString();
                 }
 
+                val = iter->get("port", Json::Value());
+                if (val.isString())
+                {
+                    meter.port = val.asString();
+                }
+
                 val = iter->get("transport", Json::Value());
                 if (val.isString())
                 {
@@ -213,6 +436,38 @@ bool Configuration::ParseSessionFile(const std::string &file)
                     {
                         meter.cosem.logical_device = static_cast<unsigned int>(val.asInt());
                     }
+
+                    val = cosemObj.get("association", Json::Value());
+                    if (val.isString())
+                    {
+                        meter.cosem.pre_established = (val.asString() == "pre-established");
+                    }
+
+                    val = cosemObj.get("conformance", Json::Value());
+                    if (val.isInt())
+                    {
+                        meter.cosem.conformance = static_cast<uint32_t>(val.asInt());
+                    }
+
+                    val = cosemObj.get("max_pdu", Json::Value());
+                    if (val.isInt())
+                    {
+                        meter.cosem.max_pdu = static_cast<uint16_t>(val.asInt());
+                    }
+
+                    val = cosemObj.get("client_max_pdu", Json::Value());
+                    if (val.isInt())
+                    {
+                        int size = std::min(std::max(val.asInt(), 0), 0xFFFF);
+                        meter.cosem.client_max_pdu = static_cast<uint16_t>(size);
+                    }
+
+                    val = cosemObj.get("gbt_window", Json::Value());
+                    if (val.isInt())
+                    {
+                        int window = std::min(std::max(val.asInt(), 0), static_cast<int>(Xdlms::cBlockWindowMask));
+                        meter.cosem.gbt_window = static_cast<uint8_t>(window);
+                    }
                 }
 
                 // *********************************   HDLC   *********************************
@@ -236,6 +491,52 @@ bool Configuration::ParseSessionFile(const std::string &file)
                     {
                         meter.testHdlcAddr = val.asBool();
                     }
+
+                    // Link parameters proposed in the SNRM, the UA gives the ones to use
+                    val = hdlcObj.get("max_info_tx", Json::Value());
+                    if (val.isInt())
+                    {
+                        meter.hdlcParams.maxInfoTx = static_cast<uint16_t>(val.asInt());
+                        meter.hdlcNegotiate = true;
+                    }
+
+                    val = hdlcObj.get("max_info_rx", Json::Value());
+                    if (val.isInt())
+                    {
+                        meter.hdlcParams.maxInfoRx = static_cast<uint16_t>(val.asInt());
+                        meter.hdlcNegotiate = true;
+                    }
+
+                    val = hdlcObj.get("window_tx", Json::Value());
+                    if (val.isInt())
+                    {
+                        meter.hdlcParams.windowTx = static_cast<uint8_t>(std::min(std::max(val.asInt(), 1), static_cast<int>(HdlcFrame::cMaxWindow)));
+                        meter.hdlcNegotiate = true;
+                    }
+
+                    val = hdlcObj.get("window_rx", Json::Value());
+                    if (val.isInt())
+                    {
+                        meter.hdlcParams.windowRx = static_cast<uint8_t>(std::min(std::max(val.asInt(), 1), static_cast<int>(HdlcFrame::cMaxWindow)));
+                        meter.hdlcNegotiate = true;
+                    }
+                }
+
+                // *********************************   TCP/IP OR UDP/IP WRAPPER   *********************************
+                Json::Value wrapperObj = iter->get((meter.transport == UDP_IP) ? "udp" : "tcp", Json::Value());
+                if (wrapperObj.isObject())
+                {
+                    val = wrapperObj.get("address", Json::Value());
+                    if (val.isString())
+                    {
+                        meter.wrapper.address = val.asString();
+                    }
+
+                    val = wrapperObj.get("port", Json::Value());
+                    if (val.isInt())
+                    {
+                        meter.wrapper.port = static_cast<uint16_t>(val.asInt());
+                    }
                 }
 
                 // Add meter to the list
@@ -247,13 +548,86 @@ bool Configuration::ParseSessionFile(const std::string &file)
 }
 
 
+static bool ParsePort(const Json::Value &portObj, SerialPort &port)
+{
+    bool ok = false;
+    Json::Value val = portObj.get("port", Json::Value());
+    if (val.isString())
+    {
+        port.params.port = val.asString();
+        val = portObj.get("baudrate", 9600);
+        if (val.isInt())
+            port.params.baudrate = static_cast<unsigned int>(val.asInt());
+
+        val = portObj.get("mode_e", Json::Value());
+        if (val.isBool())
+        {
+            port.params.modeE = val.asBool();
+        }
+
+        val = portObj.get("capture", Json::Value());
+        if (val.isString())
+        {
+            port.capture = val.asString();
+        }
+
+        val = portObj.get("replay", Json::Value());
+        if (val.isString())
+        {
+            port.replay = val.asString();
+        }
+
+        val = portObj.get("replay_timing", Json::Value());
+        if (val.isString())
+        {
+            port.replayRealTime = (val.asString() != "fast");
+        }
+
+        // By default, a port is named after its device
+        port.name = port.params.port;
+        val = portObj.get("name", Json::Value());
+        if (val.isString())
+        {
+            port.name = val.asString();
+        }
+        ok = true;
+    }
+    return ok;
+}
+
+/*
+Single port:
+
+{
+    "serial": { "port": "/dev/ttyUSB0", "baudrate": 9600 }
+}
+
+Several ports, each one polled concurrently by its own worker. The meters select
+their port by name in the session file, the first port is the default one:
+
+{
+    "serial": [
+        { "name": "bus1", "port": "/dev/ttyS0", "baudrate": 9600 },
+        { "name": "bus2", "port": "/dev/ttyS1", "baudrate": 19200 }
+    ]
+}
+
+Optical probe: "mode_e": true starts each HDLC connection with the IEC 62056-21
+mode E sign-on at 300 bauds, "baudrate" is then the highest rate to negotiate.
+
+Offline runs: "capture": "bus1.cap" records all the traffic of the port (and of
+the TCP/UDP meters for the first port); "replay": "bus1.cap" plays such a file
+back instead of opening the port, "replay_timing": "original" (default) or "fast".
+
+*/
+
 // Very tolerant, use default values of classes if corresponding parameter is not found
 bool Configuration::ParseComFile(const std::string &file, Transport::Params &comm)
 {
     std::ifstream comm_ifs(file, std::ifstream::binary);
     if(!comm_ifs)  // operator! is used here
     {
-        std::cerr << "** Error opening file: " << file << std::endl;
+        LOG(LOG_ERROR, "** Error opening file: " << file);
         return false;
     }
 
@@ -263,25 +637,41 @@ bool Configuration::ParseComFile(const std::string &file, Transport::Params &com
     builder["collectComments"] = true;
 
     if (!parseFromStream(builder, comm_ifs, &jscomm, &errs)) {
-        std::cerr << "** Error parsing " << file
-                  << " : "  << errs << std::endl;
+        LOG(LOG_ERROR, "** Error parsing " << file << " : " << errs);
         return false;
     }
-    //std::cout << "Communication parameters = " <<  jscomm << std::endl; //This will print the entire json object.
+    //LOG(LOG_INFO, "Communication parameters = " <<  jscomm); //This will print the entire json object.
     Json::Value portObj = jscomm.get("serial", Json::Value());
     if (portObj.isObject())
     {
-        Json::Value val = portObj.get("port", Json::Value());
-        if (val.isString())
+        SerialPort port;
+        if (ParsePort(portObj, port))
         {
-            comm.port = val.asString();
-            val = portObj.get("baudrate", 9600);
-            if (val.isInt())
-                comm.baudrate = static_cast<unsigned int>(val.asInt());
+            ports.push_back(port);
+        }
+    }
+    else if (portObj.isArray())
+    {
+        // Several ports, the meters are bound to them by name
+        for (Json::Value::const_iterator iter = portObj.begin(); iter != portObj.end(); ++iter)
+        {
+            SerialPort port;
+            if (iter->isObject() && ParsePort(*iter, port))
+            {
+                ports.push_back(port);
+            }
         }
     }
-    std::cout << "Port "  << comm.port << std::endl;
-    std::cout << "Baudrate "  << comm.baudrate << std::endl;
+
+    if (ports.size() > 0U)
+    {
+        comm = ports[0].params;
+    }
+
+    for (uint32_t i = 0U; i < ports.size(); i++)
+    {
+        LOG(LOG_INFO, "Port " << ports[i].name << ": " << ports[i].params.port << " at " << ports[i].params.baudrate);
+    }
     return true;
 }
 
@@ -290,7 +680,7 @@ bool Configuration::ParseObjectsFile(const std::string &file)
     std::ifstream ifs(file, std::ifstream::binary);
     if(!ifs)
     {
-        std::cerr << "** Error opening file: " << file << std::endl;
+        LOG(LOG_ERROR, "** Error opening file: " << file);
         return false;
     }
 
@@ -300,8 +690,7 @@ bool Configuration::ParseObjectsFile(const std::string &file)
     builder["collectComments"] = true;
 
     if (!parseFromStream(builder, ifs, &json, &errs)) {
-        std::cerr << "** Error parsing " << file
-                  << " : "  << errs << std::endl;
+        LOG(LOG_ERROR, "** Error parsing " << file << " : " << errs);
         return false;
     }
     Json::Value arrval = json.get("objects", Json::Value());
@@ -333,6 +722,35 @@ bool Configuration::ParseObjectsFile(const std::string &file)
                     object.attribute_id = static_cast<std::int8_t>(val.asInt());
                 }
 
+                // Profile buffer: [from, to] entries and captured columns, 0 for the last one
+                val = iter->get("entries", Json::Value());
+                if (val.isArray() && (val.size() == 2U) && val[0].isInt() && val[1].isInt())
+                {
+                    object.from_entry = static_cast<std::uint32_t>(val[0].asInt());
+                    object.to_entry = static_cast<std::uint32_t>(val[1].asInt());
+                }
+                val = iter->get("columns", Json::Value());
+                if (val.isArray() && (val.size() == 2U) && val[0].isInt() && val[1].isInt())
+                {
+                    object.from_column = static_cast<std::uint16_t>(val[0].asInt());
+                    object.to_column = static_cast<std::uint16_t>(val[1].asInt());
+                    if (object.from_entry == 0U)
+                    {
+                        // Columns are only selected with the access by entry: all the entries
+                        object.from_entry = 1U;
+                    }
+                }
+                val = iter->get("start_date", Json::Value());
+                if (val.isString())
+                {
+                    object.from_date = val.asString();
+                }
+                val = iter->get("since_last_read", Json::Value());
+                if (val.isBool())
+                {
+                    object.since_last_read = val.asBool();
+                }
+
                 object.Print();
                 list.push_back(object);
             }
@@ -17,7 +17,10 @@
 
 #include "hdlc.h"
 #include "Transport.h"
+#include "HdlcFrame.h"
+#include "RttEstimator.h"
 #include "csm_association.h"
+#include "Log.h"
 
 enum ModemState
 {
@@ -53,11 +56,67 @@ struct Modem
     std::string init;
 };
 
+// HDLC physical address scan of the meters with "test_addr"
+struct Discovery
+{
+    Discovery()
+        : first(0x10U)
+        , last(0x7DU)
+        , timeout(200U)
+    {
+
+    }
+
+    uint16_t first;
+    uint16_t last;
+    uint32_t timeout;  // Milliseconds, per probed address
+    std::string cache; // Addresses found by previous scans, empty for no cache
+};
+
+// Long-running mode: the meters are read again every period, the HDLC associations are kept.
+// TCP/IP and UDP/IP meters are read on the worker pool, which closes the link after each job:
+// they always open a new association and never count as reused.
+struct Polling
+{
+    Polling()
+        : period(0U)
+        , cycles(0U)
+        , inactivity(0U)
+    {
+
+    }
+
+    uint32_t period;     // Milliseconds between the start of two cycles, 0 for a single read
+    uint32_t cycles;     // 0 to run until the process is stopped
+    uint32_t inactivity; // Milliseconds, server inactivity time-out; 0 if unknown, the reuse is always tried
+};
+
+// What a session does after a failed object: stop (default), or record it and read the next one
+struct FailurePolicy
+{
+    FailurePolicy()
+        : keepOn(false)
+        , objectRetries(2U)
+        , sessionRetries(8U)
+    {
+
+    }
+
+    bool keepOn;
+    uint32_t objectRetries;  // New tries of an object after a temporary failure or no response
+    uint32_t sessionRetries; // All the objects of a meter session; once spent, no response stops the session
+};
+
 struct Cosem
 {
     Cosem()
         : client(1U)
         , logical_device(1U)
+        , pre_established(false)
+        , conformance(0U)
+        , max_pdu(0U)
+        , gbt_window(0U)
+        , client_max_pdu(0U)
     {
 
     }
@@ -107,6 +166,20 @@ struct Cosem
     std::string auth_level;
     uint16_t client;
     uint16_t logical_device;
+
+    // Association the server opens by itself for this client (eg: public client 16): no AARQ,
+    // the xDLMS context is given by the configuration instead of the AARE
+    bool pre_established;
+    uint32_t conformance; // Negotiated conformance block, 0 for GET only
+    uint16_t max_pdu;     // Server max receive PDU size, 0 if unknown
+
+    // General-Block-Transfer: blocks the server may stream before an acknowledge (1 to 63),
+    // 0 to keep the GET-Request-Next block transfer
+    uint8_t gbt_window;
+
+    // Client max receive PDU size proposed in the AARQ, 0 for the Cosem library default: bigger
+    // APDUs mean fewer blocks and list responses over fast links
+    uint16_t client_max_pdu;
 };
 
 
@@ -116,13 +189,18 @@ struct Object
         : class_id(0U)
         , attribute_id(0)
         , dump(true)
+        , from_entry(0U)
+        , to_entry(0U)
+        , from_column(0U)
+        , to_column(0U)
+        , since_last_read(false)
     {
 
     }
 
     void Print()
     {
-        std::cout << "Object " << name << ": " << ln << " Class ID: " << class_id << " Attribute: " << (int)attribute_id << std::endl;
+        LOG(LOG_INFO, "Object " << name << ": " << ln << " Class ID: " << class_id << " Attribute: " << (int)attribute_id);
     }
 
     std::string name;
@@ -130,35 +208,100 @@ struct Object
     std::uint16_t class_id;
     std::int8_t attribute_id;
     bool dump;
+
+    // Profile buffer selective access by entry when from_entry is set; numbered from 1,
+    // 0 for the last entry or column
+    std::uint32_t from_entry;
+    std::uint32_t to_entry;
+    std::uint16_t from_column;
+    std::uint16_t to_column;
+    bool since_last_read;  // Only the rows captured since the previous read, see the cursor file
+    std::string from_date; // Overrides the session start date (same format)
+};
+
+// IEC 62056-47 wrapper parameters (TCP or UDP transport)
+struct Wrapper
+{
+    static const uint16_t cDefaultPort = 4059U; // IANA-registered DLMS/COSEM port
+
+    Wrapper()
+        : port(cDefaultPort)
+    {
+
+    }
+
+    std::string address;
+    uint16_t port;
 };
 
 struct Meter
 {
     Meter()
         : testHdlcAddr(false)
+        , hdlcAddrCached(false)
+        , hdlcNegotiate(false)
         , transport(HDLC)
     {
         hdlc_init(&hdlc);
     }
     Cosem cosem;
     hdlc_t hdlc;
+    Wrapper wrapper;
     std::string meterId;
-    bool testHdlcAddr;
+    std::string port; // HDLC: name of the serial port in the comm file, empty for the first one
+    bool testHdlcAddr; // Discover the physical address (cache file, then scan)
+    bool hdlcAddrCached; // Physical address read from the discovery cache
+    bool hdlcNegotiate; // Propose hdlcParams in the SNRM instead of the library defaults
+    HdlcFrame::Parameters hdlcParams; // Client point of view
+    HdlcFrame::Parameters hdlcLink;   // Negotiated by SNRM/UA, client point of view
+    RttEstimator rtt;
     TransportType transport;
 };
 
+// One serial port of the comm file, polled by its own worker
+struct SerialPort
+{
+    SerialPort()
+        : replayRealTime(true)
+    {
+
+    }
+
+    std::string name;
+    Transport::Params params;
+    std::string capture; // Records the traffic of the port into this file
+    std::string replay;  // Plays this capture file back instead of opening the port
+    bool replayRealTime; // Replay with the captured delays, otherwise as fast as possible
+};
+
 
 struct Configuration
 {
     std::vector<Meter> meters;
     std::vector<Object> list;
+    std::vector<SerialPort> ports; // The first one is the default port, it also carries the modem
     Modem modem;
+    Discovery discovery;
+    Polling polling;
+    FailurePolicy failure;
+    // Milliseconds. Connect and request bound the whole response, inter-frame and min bound
+    // the adaptive wait for the next frame
     uint32_t timeout_connect;
     uint32_t timeout_dial;
     uint32_t timeout_request;
+    uint32_t timeout_inter_frame;
+    uint32_t timeout_min;
     uint32_t retries;
+    uint32_t get_list_max; // Objects per GET-Request-With-List, 0 or 1 for single GETs only
+    uint32_t concurrency;  // Sessions in parallel for the TCP/IP and UDP/IP meters
+    uint32_t gateway_concurrency; // Of which at most this number through the same gateway address
+    bool stream; // Decode and dump the data blocks as they arrive, instead of storing the whole object
+    std::string checkpoint; // Checkpoint file of the interrupted streamed profile reads, empty to disable
+    std::string cursor; // Cursor file of the "since last read" profiles
     std::string start_date;
     std::string end_date;
+    std::string log_level; // error, info, frame or trace
+    uint16_t udp_local_port; // UDP meters share this local port, 0 for one socket per meter
 
     Configuration();
 
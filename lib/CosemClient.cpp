@@ -15,13 +15,23 @@
 #include <ctime>
 #include <cstring>
 #include <cstdlib>
+#include <cstdio>
+#include <algorithm>
 #include <fstream>
 
 
 #include "CosemClient.h"
+#include "ReplayTransport.h"
+#include "HdlcFrame.h"
+#include "HdlcScanner.h"
+#include "AddressCache.h"
+#include "Checkpoint.h"
+#include "ProfileCursor.h"
+#include "Xdlms.h"
 #include "serial.h"
 #include "os_util.h"
 #include "AxdrPrinter.h"
+#include "Log.h"
 
 #include "hdlc.h"
 #include "csm_array.h"
@@ -34,32 +44,56 @@
 CosemClient::CosemClient()
     : mModemState(DISCONNECTED)
     , mCosemState(CONNECT_HDLC)
+    , mClientMaxPdu(cDefaultMaxPdu)
+    , mStreamRows(0U)
+    , mDumped(false)
+    , mDumpRows(0U)
+    , mDumpHasClock(false)
+    , mReused(false)
+    , mDisconnected(false)
+    , mReusedAssociations(0U)
+    , mNewAssociations(0U)
+    , mRetryIndex(0U)
+    , mObjectRetries(0U)
+    , mSessionRetries(0U)
+    , mInvokeId(0U)
     , mReadIndex(0U)
     , mMeterIndex(0U)
+    , mTransport(NULL)
+    , mReactor(NULL)
+    , mListAllowed(false)
 {
 
 }
 
+CosemClient::~CosemClient()
+{
+    delete mTransport;
+}
+
+
+// Session currently processed by the calling thread, for the Cosem stack callbacks
+static thread_local CosemClient *gCurrentClient = NULL;
 
-bool CosemClient::Initialize(const std::string &commFile, const std::string &objectsFile, const std::string &meterFile)
+CosemClient *CosemClient::Current()
 {
-    bool ok = false;
+    return gCurrentClient;
+}
 
-    Transport::Params params;
+bool CosemClient::Initialize(const Configuration &conf, const SerialPort &port)
+{
+    bool ok = false;
 
     Result result;
     result.subject = "OPEN COM PORT";
 
-    if(!mConf.ParseComFile(commFile, params))
-        return false;
-    if(!mConf.ParseObjectsFile(objectsFile))
-        return false;
-    if(!mConf.ParseSessionFile(meterFile))
-        return false;
+    mConf = conf;
+    mAppBuffer.resize(cAppBufferSize);
+    SizeBuffers(cDefaultMaxPdu);
 
     if (mConf.modem.useModem)
     {
-        std::cout << "** Using Modem device" << std::endl;
+        LOG(LOG_INFO, "** Using Modem device");
         mModemState = DISCONNECTED;
     }
     else
@@ -68,48 +102,313 @@ bool CosemClient::Initialize(const std::string &commFile, const std::string &obj
         mModemState = CONNECTED;
     }
 
-    ok = mTransport.Open(params);
+    mSerialParams = port.params;
+
+    // A capture file stands for the link: offline runs and benchmarks
+    if (port.replay.size() > 0U)
+    {
+        mTransport = new ReplayTransport(port.replay, port.replayRealTime);
+    }
+    else
+    {
+        mTransport = new Transport();
+    }
+
+    if (port.capture.size() > 0U)
+    {
+        mTransport->StartCapture(port.capture);
+    }
+
+    // A session with TCP/IP meters only does not need any serial port
+    if (mConf.modem.useModem || (mSerialParams.port.size() > 0U))
+    {
+        ok = mTransport->Open(mSerialParams);
+    }
+    else
+    {
+        ok = true;
+    }
+
     if (ok)
     {
-        mTransport.Start();
+        if ((mReactor == NULL) || !mReactor->Register(*mTransport))
+        {
+            mReactor = NULL;
+            mTransport->Start();
+        }
     }
     else
     {
         std::stringstream ss;
-        ss << "** Cannot open serial port " << params.port << " at " << params.baudrate << " bauds";
+        ss << "** Cannot open serial port " << mSerialParams.port << " at " << mSerialParams.baudrate << " bauds";
         result.SetError(ss.str());
         mResults.push_back(result);
     }
     return ok;
 }
 
-void CosemClient::SetStartDate(const std::string &date)
+void CosemClient::SetReactor(TransportReactor *reactor)
+{
+    mReactor = reactor;
+}
+
+void CosemClient::WaitForStop()
 {
-    mConf.start_date = date;
+    if (mTransport == NULL)
+    {
+        // Never initialized
+    }
+    else if (mReactor != NULL)
+    {
+        mReactor->Unregister(*mTransport);
+    }
+    else
+    {
+        mTransport->WaitForStop();
+    }
 }
 
-void CosemClient::SetEndDate(const std::string &date)
+
+// Milliseconds to wait for the next bytes: the adaptive timeout when the exchange can be
+// retried, otherwise the inter-frame bound; never after the response deadline
+static uint32_t RemainingMs(const std::chrono::steady_clock::time_point &deadline)
 {
-    mConf.end_date = date;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    uint32_t remaining = 0U;
+
+    if (deadline > now)
+    {
+        remaining = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count());
+    }
+    return remaining;
 }
 
-void CosemClient::WaitForStop()
+// Until the first byte of the response, only the response deadline (request or connect
+// timeout) applies; then the inter-frame deadline as well. With retries, the RTT based
+// timeout repeats the request sooner
+uint32_t CosemClient::WaitTime(const Meter &meter, bool canRetry, const std::chrono::steady_clock::time_point &deadline,
+                               bool started, const std::chrono::steady_clock::time_point &frameDeadline)
 {
-    mTransport.WaitForStop();
+    uint32_t wait = RemainingMs(deadline);
+
+    if (started)
+    {
+        wait = std::min(wait, RemainingMs(frameDeadline));
+    }
+    if (canRetry)
+    {
+        wait = std::min(wait, meter.rtt.Timeout());
+    }
+    return wait;
 }
 
+static uint32_t ElapsedMs(const std::chrono::steady_clock::time_point &start)
+{
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+}
 
-bool CosemClient::HdlcProcess(Meter &meter, const std::string &send, std::string &rcv, int timeout, bool enableRetries)
+// Sends an HDLC frame, the send sequence number moves on after an I-frame. An I-frame
+// larger than the negotiated maximum information field is sent in segments. 'echo' is
+// the last data sent on the line, for the echo cancellation
+bool CosemClient::SendHdlc(Meter &meter, const std::string &data, std::string &echo)
 {
-    bool retCode = false;
+    HdlcFrame::Frame frame;
+
+    if ((HdlcFrame::Decode((const uint8_t *)data.data(), static_cast<uint32_t>(data.size()), frame) == 1) &&
+        HdlcFrame::IsIFrame(frame.control) &&
+        (frame.infoSize > meter.hdlcLink.maxInfoTx))
+    {
+        return SendSegments(meter, frame, echo);
+    }
+
+    if (mTransport->Send(data, PRINT_HEX) <= 0)
+    {
+        return false;
+    }
+    echo = data;
+
+    if (meter.hdlc.type == HDLC_PACKET_TYPE_I)
+    {
+        if (meter.hdlc.sss == 7U)
+        {
+            meter.hdlc.sss = 0U;
+        }
+        else
+        {
+            meter.hdlc.sss++;
+        }
+    }
+    return true;
+}
+
+static bool SameAddress(const HdlcFrame::Address &a, const HdlcFrame::Address &b)
+{
+    return (a.size == b.size) && (std::memcmp(&a.bytes[0], &b.bytes[0], a.size) == 0);
+}
+
+// Sends the information field of 'frame' in frames of at most maxInfoTx bytes, windowTx
+// frames at a time: the last frame of a window has the poll bit, the server acknowledges
+// the window with RR and the frames from its N(R) are sent again if some were lost. The
+// poll bit of the very last frame hands over to the server, its response is received by
+// HdlcProcess()
+bool CosemClient::SendSegments(Meter &meter, const HdlcFrame::Frame &frame, std::string &echo)
+{
+    uint32_t maxInfo = (meter.hdlcLink.maxInfoTx > 0U) ? meter.hdlcLink.maxInfoTx : static_cast<uint32_t>(HdlcFrame::cDefaultMaxInfo);
+    uint32_t window = (meter.hdlcLink.windowTx > 0U) ? meter.hdlcLink.windowTx : 1U;
+    uint32_t count = (frame.infoSize + maxInfo - 1U) / maxInfo;
+    uint8_t first = static_cast<uint8_t>((frame.control >> 1U) & 0x07U); // N(S) of the first segment
+    uint32_t acked = 0U;
+    uint32_t retries = 0U;
+    bool ok = true;
+
+    LOG(LOG_TRACE, "** Segmented I-frame: " << frame.infoSize << " bytes in " << count << " frames");
+
+    while (ok && (acked < count))
+    {
+        uint32_t end = std::min(acked + window, count);
+        std::string windowData;
+
+        for (uint32_t k = acked; ok && (k < end); k++)
+        {
+            uint32_t offset = k * maxInfo;
+            uint32_t size = std::min(maxInfo, frame.infoSize - offset);
+            bool last = ((k + 1U) == count);
+            uint8_t control = HdlcFrame::IControl(meter.hdlc.rrr, static_cast<uint8_t>(first + k), (k + 1U) == end);
+            uint32_t frameSize = HdlcFrame::Encode((uint8_t *)&mSndBuffer[0], static_cast<uint32_t>(mSndBuffer.size()),
+                                                   frame.destination, frame.source, control, !last, &frame.info[offset], size);
+            std::string segment(&mSndBuffer[0], frameSize);
+
+            ok = (frameSize > 0U) && (mTransport->Send(segment, PRINT_HEX) > 0);
+            windowData += segment;
+        }
+
+        if (!ok || (end == count))
+        {
+            echo = windowData;
+            acked = end;
+        }
+        else
+        {
+            uint8_t nr;
+            uint32_t done = 0U;
+
+            if (WaitHdlcRr(meter, frame.source, nr))
+            {
+                // Frames of the window acknowledged by N(R)
+                done = static_cast<uint32_t>((nr - first - acked) & 0x07U);
+                if (done > (end - acked))
+                {
+                    LOG(LOG_ERROR, "** Bad N(R) in the acknowledge of the window: " << static_cast<int>(nr));
+                    ok = false;
+                }
+            }
+
+            if (done > 0U)
+            {
+                acked += done;
+                retries = 0U;
+            }
+            else if (ok)
+            {
+                retries++;
+                if (retries > mConf.retries)
+                {
+                    LOG(LOG_ERROR, "** Segmented I-frame not acknowledged");
+                    ok = false;
+                }
+                else
+                {
+                    LOG(LOG_INFO, "** Window not acknowledged, sending it again");
+                }
+            }
+        }
+    }
+
+    if (ok)
+    {
+        meter.hdlc.sss = static_cast<uint8_t>((first + count) & 0x07U);
+    }
+    return ok;
+}
+
+// Acknowledge of a window of segments, the other frames (our echo) are skipped
+bool CosemClient::WaitHdlcRr(Meter &meter, const HdlcFrame::Address &client, uint8_t &nr)
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(meter.rtt.Timeout());
+    bool acked = false;
+    uint32_t pending = 0U;
+    HdlcScanner scanner;
+
+    while (!acked && mTransport->WaitForMore(pending, RemainingMs(deadline)))
+    {
+        const uint8_t *ptr;
+        uint32_t length;
+        uint32_t size = mTransport->Peek(ptr);
+
+        HdlcScanner::Status status = scanner.Scan(ptr, size, length);
+        while (!acked && (status != HdlcScanner::NEED_MORE))
+        {
+            HdlcFrame::Frame frame;
+            if ((status == HdlcScanner::FRAME) && (HdlcFrame::Decode(ptr, length, frame) == 1) &&
+                HdlcFrame::IsRr(frame.control) && SameAddress(frame.destination, client))
+            {
+                nr = static_cast<uint8_t>((frame.control >> 5U) & 0x07U);
+                acked = true;
+            }
+            mTransport->Consume(length);
+            size = mTransport->Peek(ptr);
+            status = (size > 0U) ? scanner.Scan(ptr, size, length) : HdlcScanner::NEED_MORE;
+        }
+
+        pending = mTransport->Readable();
+        if (scanner.Needed() > (pending + 1U))
+        {
+            pending = scanner.Needed() - 1U;
+        }
+    }
+
+    if (!acked)
+    {
+        meter.rtt.Backoff();
+    }
+    return acked;
+}
 
-    csm_array_init(&mRcvArray, (uint8_t*)&mRcvBuffer[0], cBufferSize, 0U, 0U);
+// Sends a request now, its response is collected later by DataExchange()
+bool CosemClient::SendRequest(Meter &meter, const std::string &request)
+{
+    if (meter.transport == HDLC)
+    {
+        std::string echo;
+        return SendHdlc(meter, request, echo);
+    }
+    return (mTransport->Send(request, PRINT_HEX) > 0);
+}
+
+// The information fields of the received frames are decoded in place from the
+// transport and written once, at the end of 'rcv'.
+// When 'sent' is true, the request has already been sent by SendRequest(): it is only
+// repeated on retries
+bool CosemClient::HdlcProcess(Meter &meter, const std::string &send, csm_array &rcv, uint32_t timeout, bool enableRetries, bool sent)
+{
+    bool retCode = false;
 
     bool loop = true;
 
-    std::string dataToSend = send;
-    std::string dataSent;
+    std::string dataToSend = sent ? std::string() : send;
+    std::string dataSent = sent ? send : std::string();
     uint32_t retries = 0U;
+    uint32_t pending = 0U; // bytes received that do not contain a complete frame yet
+    HdlcScanner scanner;
+    // Whole response deadline, restarted on each frame sent (retry, or RR asking for the next
+    // window), and inter-frame deadline, restarted on each reception. The RTT is not sampled
+    // on retries (Karn)
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    std::chrono::steady_clock::time_point frameDeadline;
+    bool started = false;
+    std::chrono::steady_clock::time_point sentAt;
+    bool sampling = false;
+    bool retransmission = false;
 
     if (!enableRetries)
     {
@@ -121,21 +420,14 @@ bool CosemClient::HdlcProcess(Meter &meter, const std::string &send, std::string
     {
         if (dataToSend.size() > 0)
         {
-            if (mTransport.Send(dataToSend, PRINT_HEX))
+            if (SendHdlc(meter, dataToSend, dataSent))
             {
-                if (meter.hdlc.type == HDLC_PACKET_TYPE_I)
-                {
-                    if (meter.hdlc.sss == 7U)
-                    {
-                        meter.hdlc.sss = 0U;
-                    }
-                    else
-                    {
-                        meter.hdlc.sss++;
-                    }
-                }
-                dataSent = dataToSend;
                 dataToSend.clear();
+                sentAt = std::chrono::steady_clock::now();
+                deadline = sentAt + std::chrono::milliseconds(timeout);
+                started = false;
+                sampling = !retransmission;
+                retransmission = false;
             }
             else
             {
@@ -144,120 +436,156 @@ bool CosemClient::HdlcProcess(Meter &meter, const std::string &send, std::string
             }
         }
 
-        std::string data;
         hdlc_t hdlc;
 
-        if (mTransport.WaitForData(data, timeout))
+        if (loop && mTransport->WaitForMore(pending, WaitTime(meter, retries < mConf.retries, deadline, started, frameDeadline)))
         {
-            // We have something, add buffer
-            if (!csm_array_write_buff(&mRcvArray, (const uint8_t*)data.c_str(), data.size()))
+            const uint8_t *ptr;
+            uint32_t size = mTransport->Peek(ptr);
+            started = true;
+            frameDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(mConf.timeout_inter_frame);
+
+            // Check echo
+            if ((dataSent.size() > 0U) &&
+                (size >= dataSent.size()) &&
+                (std::memcmp(ptr, dataSent.data(), dataSent.size()) == 0))
             {
-                loop = false;
-                retCode = false;
+                // remove echo from the received data
+                mTransport->Consume(dataSent.size());
+                dataSent.clear();
+                scanner.Reset();
+                size = mTransport->Peek(ptr);
+                LOG(LOG_TRACE, "Echo canceled!");
             }
 
-            if (loop)
+            while (loop && (size > 0U))
             {
-                uint8_t *ptr = csm_array_rd_data(&mRcvArray);
-                uint32_t size = csm_array_unread(&mRcvArray);
+                uint32_t length;
+                HdlcScanner::Status status = scanner.Scan(ptr, size, length);
+                if (status == HdlcScanner::NEED_MORE)
+                {
+                    // Partial packet, re-try when the missing bytes are there
+                    break;
+                }
 
+                hdlc.sender = HDLC_SERVER;
+                if ((status == HdlcScanner::SKIP) || (hdlc_decode(&hdlc, ptr, length) != HDLC_OK))
+                {
+                    LOG(LOG_TRACE, "Garbage, resync on the next flag");
+                    mTransport->Consume((status == HdlcScanner::SKIP) ? length : 1U);
+                    size = mTransport->Peek(ptr);
+                    continue;
+                }
 
-//                printf("Ptr: 0x%08X, Unread: %d\r\n", (unsigned long)ptr, size);
-//
-//                puts("Sent frame: ");
-//                print_hex(mSendCopy.c_str(), mSendCopy.size());
-//                puts("\r\n");
+                if (sampling)
+                {
+                    meter.rtt.Sample(ElapsedMs(sentAt));
+                    sampling = false;
+                }
 
-                // the frame seems correct, check echo
-                if (dataSent.compare(0, dataSent.size(), (char*)ptr, size) == 0)
+                if (hdlc.type == HDLC_PACKET_TYPE_RR)
                 {
-                    // remove echo from the string
-                    csm_array_reader_jump(&mRcvArray, size);
-                    ptr = csm_array_rd_data(&mRcvArray);
-                    size = csm_array_unread(&mRcvArray);
-                    std::cout << "Echo canceled!" << std::endl;
+                    // Send again the request
+                    LOG(LOG_INFO, "RR sync, send again");
+                    mTransport->Consume(hdlc.frame_size);
+                    dataToSend = send;
+                    retransmission = true;
+                    break;
                 }
 
-//                puts("Decoding: ");
-//                print_hex((const char *)ptr, size);
-//                puts("\r\n");
+                if ((hdlc.type == HDLC_PACKET_TYPE_DM) || (hdlc.type == HDLC_PACKET_TYPE_FRMR))
+                {
+                    // The server is in disconnected mode or rejects the frame: nothing else will come
+                    LOG(LOG_INFO, "** HDLC link not connected on the server side");
+                    mTransport->Consume(hdlc.frame_size);
+                    mDisconnected = true;
+                    retCode = false;
+                    loop = false;
+                    break;
+                }
 
-                do
+                if ((hdlc.type == HDLC_PACKET_TYPE_I) && (hdlc.sss != meter.hdlc.rrr))
                 {
-                    hdlc.sender = HDLC_SERVER;
-                    int ret = hdlc_decode(&hdlc, ptr, size);
-                    if (ret == HDLC_OK)
+                    // A frame of the window has been lost: drop the next ones, the RR
+                    // sent on the poll/final frame makes the server go back to N(R)
+                    LOG(LOG_INFO, "Out of sequence I-frame, N(S)=" << static_cast<int>(hdlc.sss) << ", expected " << static_cast<int>(meter.hdlc.rrr));
+                    mTransport->Consume(hdlc.frame_size);
+                    if (hdlc.poll_final == 1U)
                     {
+                        hdlc.sender = HDLC_CLIENT;
+                        uint32_t rrSize = hdlc_encode_rr(&meter.hdlc, (uint8_t*)&mSndBuffer[0], static_cast<uint32_t>(mSndBuffer.size()));
+                        dataToSend.assign(&mSndBuffer[0], rrSize);
+                    }
+                    size = mTransport->Peek(ptr);
+                    continue;
+                }
 
+                LOG(LOG_TRACE, "Data packet");
+                // God packet! Copy to cosem data
+                if (!csm_array_write_buff(&rcv, &ptr[hdlc.data_index], hdlc.data_size))
+                {
+                    LOG(LOG_ERROR, "** Reception buffer overflow");
+                    retCode = false;
+                    loop = false;
+                }
 
-                        if (hdlc.type == HDLC_PACKET_TYPE_RR)
-                        {
-                           // Send again the request
-                            puts("RR sync, send again\r\n");
-                           dataToSend = send;
-                           size = 0U;
-                        }
-                        else
-                        {
-                            std::cout << "Data packet" << std::endl;
-                            // God packet! Copy to cosem data
-                            rcv.append((const char*)&ptr[hdlc.data_index], hdlc.data_size);
-
-                            // Continue with next one
-                            csm_array_reader_jump(&mRcvArray, hdlc.frame_size);
-
-                            if (hdlc.type == HDLC_PACKET_TYPE_I)
-                            {
-                                // ack last hdlc frame
-                                if (hdlc.sss == 7U)
-                                {
-                                    meter.hdlc.rrr = 0U;
-                                }
-                                else
-                                {
-                                    meter.hdlc.rrr = hdlc.sss + 1;
-                                }
-                            }
+                // Continue with next one
+                mTransport->Consume(hdlc.frame_size);
 
-                            // Test if it is a last HDLC packet
-                            if ((hdlc.segmentation == 0U) &&
-                                (hdlc.poll_final == 1U))
-                            {
-                                puts("Final packet\r\n");
+                if (hdlc.type == HDLC_PACKET_TYPE_I)
+                {
+                    // ack last hdlc frame
+                    if (hdlc.sss == 7U)
+                    {
+                        meter.hdlc.rrr = 0U;
+                    }
+                    else
+                    {
+                        meter.hdlc.rrr = hdlc.sss + 1;
+                    }
+                }
 
-                                retCode = true; // good Cosem packet
-                                loop = false; // quit
-                            }
-                            else if (hdlc.segmentation == 1U)
-                            {
-                                puts("Segmentation packet: ");
-                                hdlc_print_result(&hdlc, HDLC_OK);
-                                // There are remaining frames to be received.
-                                if (hdlc.poll_final == 1U)
-                                {
-                                    // Send RR
-                                    hdlc.sender = HDLC_CLIENT;
-                                    size = hdlc_encode_rr(&meter.hdlc, (uint8_t*)&mSndBuffer[0], cBufferSize);
-                                    dataToSend.assign(&mSndBuffer[0], size);
-                                }
-                            }
+                // Test if it is a last HDLC packet
+                if ((hdlc.segmentation == 0U) &&
+                    (hdlc.poll_final == 1U))
+                {
+                    LOG(LOG_TRACE, "Final packet");
 
-                            // go to next frame, if any
-                            ptr = csm_array_rd_data(&mRcvArray);
-                            size = csm_array_unread(&mRcvArray);
-                        }
+                    retCode = loop; // good Cosem packet
+                    loop = false; // quit
+                }
+                else if (hdlc.segmentation == 1U)
+                {
+                    LOG(LOG_TRACE, "Segmentation packet");
+                    if (Log::Enabled(LOG_TRACE))
+                    {
+                        hdlc_print_result(&hdlc, HDLC_OK);
                     }
-                    else
+                    // There are remaining frames to be received. Inside a window, only
+                    // the last frame carries the poll/final bit and is acknowledged
+                    if (hdlc.poll_final == 1U)
                     {
-                        // Maybe a partial packet, re-try later
-                        size = 0U;
+                        // Send RR
+                        hdlc.sender = HDLC_CLIENT;
+                        uint32_t rrSize = hdlc_encode_rr(&meter.hdlc, (uint8_t*)&mSndBuffer[0], static_cast<uint32_t>(mSndBuffer.size()));
+                        dataToSend.assign(&mSndBuffer[0], rrSize);
                     }
                 }
-                while (size);
+
+                // go to next frame, if any
+                size = mTransport->Peek(ptr);
+            }
+
+            // Wake up only when the frame being received can be complete
+            pending = mTransport->Readable();
+            if (scanner.Needed() > (pending + 1U))
+            {
+                pending = scanner.Needed() - 1U;
             }
         }
-        else
+        else if (loop)
         {
+            meter.rtt.Backoff();
             retries++;
             if (retries > mConf.retries)
             {
@@ -267,13 +595,16 @@ bool CosemClient::HdlcProcess(Meter &meter, const std::string &send, std::string
             }
             else
             {
-                puts("Try to resync\r\n");
-                csm_array_init(&mRcvArray, (uint8_t*)&mRcvBuffer[0], cBufferSize, 0U, 0U);
+                LOG(LOG_INFO, "Try to resync");
+                mTransport->Flush();
+                scanner.Reset();
+                pending = 0U;
                 // try to re-sync with server, send RR frame
                 // Send RR
                 hdlc.sender = HDLC_CLIENT;
-                uint32_t size = hdlc_encode_rr(&meter.hdlc, (uint8_t*)&mSndBuffer[0], cBufferSize);
+                uint32_t size = hdlc_encode_rr(&meter.hdlc, (uint8_t*)&mSndBuffer[0], static_cast<uint32_t>(mSndBuffer.size()));
                 dataToSend.assign(&mSndBuffer[0], size);
+                retransmission = true;
             }
         }
     }
@@ -283,66 +614,298 @@ bool CosemClient::HdlcProcess(Meter &meter, const std::string &send, std::string
 }
 
 
-bool CosemClient::SendModem(const std::string &command, const std::string &expected, std::string &modemReply, uint32_t timeout)
+// IEC 62056-47 wrapper: version, source wPort, destination wPort, length (all 16-bit big endian)
+static const uint32_t cWrapperHeaderSize = 8U;
+static const uint16_t cWrapperVersion = 0x0001U;
+
+static uint16_t ReadBe16(const uint8_t *data)
+{
+    return static_cast<uint16_t>((data[0] << 8U) | data[1]);
+}
+
+bool CosemClient::WrapperProcess(Meter &meter, const std::string &send, csm_array &rcv, uint32_t timeout, bool sent)
 {
     bool retCode = false;
+    bool loop = true;
+    uint32_t pending = 0U;
+    // Datagrams may be lost: the request is repeated on its own timer (RTT based, backed off
+    // on each repetition) until the response arrives or the whole request times out
+    bool retransmit = (meter.transport == UDP_IP) && (send.size() > 0U);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    std::chrono::steady_clock::time_point sentAt = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point retransmitAt = sentAt + std::chrono::milliseconds(meter.rtt.Timeout());
+    std::chrono::steady_clock::time_point frameDeadline;
+    bool started = false; // Some bytes received: the inter-frame deadline applies
+    bool sampling = (send.size() > 0U) && !sent;
+
+    // A repeated request may have been answered twice: drop the late copies before a new request
+    if (retransmit && !sent)
+    {
+        mTransport->Flush();
+    }
 
-    if (mTransport.Send(command, PRINT_RAW))
+    // Nothing to send: only wait for a response already requested
+    if ((send.size() > 0U) && !sent && (mTransport->Send(send, PRINT_HEX) <= 0))
     {
-        bool loop = true;
-        do {
-            std::string data;
-            if (mTransport.WaitForData(data, timeout))
+        loop = false;
+    }
+
+    while (loop)
+    {
+        uint32_t wait = WaitTime(meter, false, deadline, started, frameDeadline);
+        if (retransmit)
+        {
+            wait = std::min(wait, RemainingMs(retransmitAt));
+        }
+
+        if (mTransport->WaitForMore(pending, wait))
+        {
+            const uint8_t *ptr;
+            uint32_t size = mTransport->Peek(ptr);
+            frameDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(mConf.timeout_inter_frame);
+
+            // Consume all the complete wrapper frames available
+            while (loop && (size >= cWrapperHeaderSize))
             {
-                Transport::Printer(data.c_str(), data.size(), PRINT_RAW);
-                modemReply += data;
+                uint16_t version = ReadBe16(&ptr[0]);
+                uint16_t source = ReadBe16(&ptr[2]);
+                uint16_t destination = ReadBe16(&ptr[4]);
+                uint32_t length = ReadBe16(&ptr[6]);
 
-                // Wait again, if there is remaing data
-                if (mTransport.WaitForData(data, 2U))
+                if (version != cWrapperVersion)
                 {
-                    modemReply += data;
+                    LOG(LOG_ERROR, "** Bad wrapper version: " << version);
+                    // The frame boundaries are lost: drop the data, a TCP stream cannot resynchronize
+                    mTransport->Flush();
+                    if (meter.transport == TCP_IP)
+                    {
+                        LOG(LOG_ERROR, "** Closing the TCP link");
+                        mTransport->Close();
+                    }
+                    loop = false;
                 }
-
-                if (modemReply.find(expected) != std::string::npos)
+                else if (size >= (cWrapperHeaderSize + length))
                 {
-                    retCode = true;
+                    if ((source == meter.cosem.logical_device) &&
+                        (destination == meter.cosem.client))
+                    {
+                        if (sampling)
+                        {
+                            meter.rtt.Sample(ElapsedMs(sentAt));
+                        }
+                        retCode = csm_array_write_buff(&rcv, &ptr[cWrapperHeaderSize], length);
+                        loop = false;
+                    }
+                    else
+                    {
+                        LOG(LOG_INFO, "** Wrapper frame for another association, skipped");
+                    }
+                    mTransport->Consume(cWrapperHeaderSize + length);
+                    size = mTransport->Peek(ptr);
+                }
+                else
+                {
+                    // Partial frame, wait for more data
+                    break;
                 }
-
-                loop = false;
             }
-            else
+            pending = mTransport->Readable();
+            // The inter-frame deadline only bounds the end of a frame being received
+            started = (pending > 0U);
+        }
+        else if (retransmit && (RemainingMs(deadline) > 0U))
+        {
+            // A late response to the first sending is still valid: the received data is kept
+            LOG(LOG_INFO, "** No response, repeating the request");
+            meter.rtt.Backoff();
+            sampling = false;
+            retransmitAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(meter.rtt.Timeout());
+            if (mTransport->Send(send, PRINT_HEX) <= 0)
             {
                 loop = false;
-                retCode = false;
             }
         }
-        while (loop);
+        else
+        {
+            loop = false;
+        }
     }
 
-    std::this_thread::sleep_for(std::chrono::seconds(2U));
-
     return retCode;
 }
 
-int CosemClient::ConnectHdlc(Meter &meter)
+bool CosemClient::DataExchange(Meter &meter, const std::string &send, csm_array &rcv, uint32_t timeout, bool enableRetries, bool sent)
 {
-    int ret = -1;
-
-    int size = hdlc_encode_snrm(&meter.hdlc, (uint8_t *)&mSndBuffer[0], cBufferSize);
-
-    std::string snrmData(&mSndBuffer[0], size);
-    std::string data;
+    bool ret = false;
 
-    if (HdlcProcess(meter, snrmData, data, mConf.timeout_connect, false))
+    mDisconnected = false;
+    if (meter.transport == HDLC)
     {
-        ret = data.size();
-        Transport::Printer(data.c_str(), data.size(), PRINT_HEX);
-
-        // Decode UA
-        ret = hdlc_decode_info_field(&meter.hdlc, (const uint8_t *)data.c_str(), data.size());
-        if (ret == HDLC_OK)
+        ret = HdlcProcess(meter, send, rcv, timeout, enableRetries, sent);
+    }
+    else
+    {
+        ret = WrapperProcess(meter, send, rcv, timeout, sent);
+    }
+
+    return ret;
+}
+
+bool CosemClient::OpenLink(Meter &meter)
+{
+    bool ok = true;
+    Transport::Params params = mSerialParams;
+    Result result;
+    result.subject = "OPEN LINK";
+
+    // The reception ring holds a whole window of HDLC frames, or a whole wrapper frame of the
+    // largest APDU proposed to the server
+    if (meter.transport == HDLC)
+    {
+        params.frameSize = static_cast<uint32_t>(HdlcFrame::cMaxWindow) * HdlcFrame::cMaxFrameSize;
+    }
+    else
+    {
+        uint16_t maxPdu = (meter.cosem.client_max_pdu > 0U) ? meter.cosem.client_max_pdu : cDefaultMaxPdu;
+        params.frameSize = cWrapperHeaderSize + maxPdu;
+    }
+
+    if (meter.transport == TCP_IP)
+    {
+        std::stringstream ss;
+        ss << meter.wrapper.port;
+
+        params.type = Transport::TCP_IP;
+        params.address = meter.wrapper.address;
+        params.port = ss.str();
+    }
+    else if (meter.transport == UDP_IP)
+    {
+        std::stringstream ss;
+        ss << meter.wrapper.port;
+
+        params.type = Transport::UDP_IP;
+        params.address = meter.wrapper.address;
+        params.port = ss.str();
+        params.sharedPort = mConf.udp_local_port;
+        if (params.sharedPort != 0U)
+        {
+            // The shared socket routes the responses by meter address and logical device
+            params.wPort = meter.cosem.logical_device;
+        }
+    }
+
+    // Keep the current link when the meter is reachable through it
+    if (ok && (!mTransport->IsOpen() || !(mTransport->GetParams() == params)))
+    {
+        ok = mTransport->Open(params);
+        if (!ok)
+        {
+            std::stringstream ss;
+            if (params.type != Transport::SERIAL)
+            {
+                ss << "** Cannot connect to " << params.address << ":" << params.port;
+            }
+            else
+            {
+                ss << "** Cannot open serial port " << params.port << " at " << params.baudrate << " bauds";
+            }
+            result.SetError(ss.str());
+            mResults.push_back(result);
+        }
+    }
+
+    return ok;
+}
+
+bool CosemClient::SendModem(const std::string &command, const std::string &expected, std::string &modemReply, uint32_t timeout)
+{
+    bool retCode = false;
+
+    if (mTransport->Send(command, PRINT_RAW))
+    {
+        bool loop = true;
+        do {
+            std::string data;
+            if (mTransport->WaitForData(data, timeout))
+            {
+                Transport::Printer(data.c_str(), data.size(), PRINT_RAW);
+                modemReply += data;
+
+                // Wait again, if there is remaing data
+                if (mTransport->WaitForData(data, 2000U))
+                {
+                    modemReply += data;
+                }
+
+                if (modemReply.find(expected) != std::string::npos)
+                {
+                    retCode = true;
+                }
+
+                loop = false;
+            }
+            else
+            {
+                loop = false;
+                retCode = false;
+            }
+        }
+        while (loop);
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(2U));
+
+    return retCode;
+}
+
+int CosemClient::ConnectHdlc(Meter &meter)
+{
+    int ret = -1;
+
+    int size = hdlc_encode_snrm(&meter.hdlc, (uint8_t *)&mSndBuffer[0], static_cast<uint32_t>(mSndBuffer.size()));
+
+    if (meter.hdlcNegotiate)
+    {
+        // Same frame, with our own link parameters as information field
+        uint8_t info[32];
+        uint32_t infoSize = HdlcFrame::EncodeParameters(&info[0], sizeof(info), meter.hdlcParams);
+        size = static_cast<int>(HdlcFrame::Encode((uint8_t *)&mSndBuffer[0], static_cast<uint32_t>(mSndBuffer.size()),
+                                HdlcFrame::ServerAddress(meter.hdlc.logical_device, meter.hdlc.phy_address, meter.hdlc.addr_len),
+                                HdlcFrame::ClientAddress(meter.hdlc.client_addr),
+                                HdlcFrame::cSnrm | HdlcFrame::cPollFinal, false, &info[0], infoSize));
+    }
+
+    std::string snrmData(&mSndBuffer[0], size);
+    csm_array ua;
+    csm_array_init(&ua, &mScratch[0], static_cast<uint32_t>(mScratch.size()), 0, 0);
+
+    if (HdlcProcess(meter, snrmData, ua, mConf.timeout_connect, false, false))
+    {
+        Log::Hex(LOG_TRACE, "UA: ", &mScratch[0], csm_array_written(&ua));
+
+        // Decode UA
+        ret = hdlc_decode_info_field(&meter.hdlc, &mScratch[0], csm_array_written(&ua));
+        if (ret == HDLC_OK)
         {
-            hdlc_print_result(&meter.hdlc, ret);
+            if (Log::Enabled(LOG_TRACE))
+            {
+                hdlc_print_result(&meter.hdlc, ret);
+            }
+
+            // The UA parameters are the server ones: its transmit side is our receive side. The
+            // proposed ones (hdlcParams) are kept for the next connection
+            HdlcFrame::Parameters server;
+            bool decoded = HdlcFrame::DecodeParameters(&mScratch[0], csm_array_written(&ua), server);
+            meter.hdlcLink.maxInfoTx = server.maxInfoRx;
+            meter.hdlcLink.maxInfoRx = server.maxInfoTx;
+            meter.hdlcLink.windowTx = static_cast<uint8_t>(std::min(std::max(static_cast<int>(server.windowRx), 1), static_cast<int>(HdlcFrame::cMaxWindow)));
+            meter.hdlcLink.windowRx = server.windowTx;
+            if (decoded || meter.hdlcNegotiate)
+            {
+                LOG(LOG_INFO, "** HDLC link: max info TX " << meter.hdlcLink.maxInfoTx << ", RX " << meter.hdlcLink.maxInfoRx
+                    << ", window TX " << static_cast<int>(meter.hdlcLink.windowTx) << ", RX " << static_cast<int>(meter.hdlcLink.windowRx));
+            }
             ret = 1U;
         }
     }
@@ -350,6 +913,135 @@ int CosemClient::ConnectHdlc(Meter &meter)
     return ret;
 }
 
+// Unnumbered command without information field, for the address discovery. True when
+// a station answered with UA or DM, its physical address is then in 'physical'
+bool CosemClient::SendHdlcCommand(const HdlcFrame::Address &server, const HdlcFrame::Address &client, uint8_t command, uint8_t &control, uint16_t &physical)
+{
+    uint8_t buf[32];
+    uint32_t size = HdlcFrame::Encode(&buf[0], sizeof(buf), server, client, command, false, NULL, 0U);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(mConf.discovery.timeout);
+    bool answered = false;
+    uint32_t pending = 0U;
+    HdlcScanner scanner;
+
+    mTransport->Flush();
+    if (mTransport->Send(std::string((const char *)&buf[0], size), PRINT_HEX) <= 0)
+    {
+        return false;
+    }
+
+    while (!answered && mTransport->WaitForMore(pending, RemainingMs(deadline)))
+    {
+        const uint8_t *ptr;
+        uint32_t length;
+        size = mTransport->Peek(ptr);
+
+        HdlcScanner::Status status = scanner.Scan(ptr, size, length);
+        while (!answered && (status != HdlcScanner::NEED_MORE))
+        {
+            HdlcFrame::Frame frame;
+            if ((status == HdlcScanner::FRAME) && (HdlcFrame::Decode(ptr, length, frame) == 1))
+            {
+                control = static_cast<uint8_t>(frame.control | HdlcFrame::cPollFinal);
+                // Anything else is our own echo or another conversation on the bus
+                if ((control == HdlcFrame::cUa) || (control == HdlcFrame::cDm))
+                {
+                    physical = HdlcFrame::PhysicalAddress(frame.source);
+                    answered = true;
+                }
+            }
+            mTransport->Consume(length);
+            size = mTransport->Peek(ptr);
+            status = (size > 0U) ? scanner.Scan(ptr, size, length) : HdlcScanner::NEED_MORE;
+        }
+
+        pending = mTransport->Readable();
+        if (scanner.Needed() > (pending + 1U))
+        {
+            pending = scanner.Needed() - 1U;
+        }
+    }
+
+    return answered;
+}
+
+// SNRM to one address (or to all the stations); a connected station is released with DISC
+bool CosemClient::ProbeHdlcAddress(Meter &meter, uint16_t physical, uint16_t &found)
+{
+    HdlcFrame::Address client = HdlcFrame::ClientAddress(meter.hdlc.client_addr);
+    uint8_t control;
+    uint16_t answer;
+
+    if (!SendHdlcCommand(HdlcFrame::ServerAddress(meter.hdlc.logical_device, physical, meter.hdlc.addr_len),
+                         client, HdlcFrame::cSnrm, control, answer))
+    {
+        return false;
+    }
+
+    // The answer of a broadcast gives the real address; one byte addresses have no physical part
+    if ((answer != 0U) && (answer != HdlcFrame::cAllStations) && (answer != 0x7FU))
+    {
+        found = answer;
+    }
+    else if (physical != HdlcFrame::cAllStations)
+    {
+        found = physical;
+    }
+    else
+    {
+        LOG(LOG_INFO, "** Broadcast answered without the station address");
+        return false;
+    }
+
+    if (control == HdlcFrame::cUa)
+    {
+        uint8_t discControl;
+        SendHdlcCommand(HdlcFrame::ServerAddress(meter.hdlc.logical_device, found, meter.hdlc.addr_len),
+                        client, HdlcFrame::cDisc, discControl, answer);
+    }
+    return true;
+}
+
+// Physical address from the cache file, otherwise broadcast then sweep of the address range
+bool CosemClient::DiscoverHdlcAddress(Meter &meter)
+{
+    const Discovery &discovery = mConf.discovery;
+    uint16_t address = 0U;
+    bool found = false;
+
+    if ((discovery.cache.size() > 0U) && AddressCache::Find(discovery.cache, meter.meterId, address))
+    {
+        LOG(LOG_INFO, "** HDLC address " << address << " read from " << discovery.cache);
+        meter.hdlcAddrCached = true;
+        found = true;
+    }
+    else
+    {
+        LOG(LOG_INFO, "** Scanning HDLC addresses " << discovery.first << " to " << discovery.last << "...");
+        found = ProbeHdlcAddress(meter, HdlcFrame::cAllStations, address);
+
+        for (uint32_t physical = discovery.first; !found && (physical <= discovery.last); physical++)
+        {
+            found = ProbeHdlcAddress(meter, static_cast<uint16_t>(physical), address);
+        }
+
+        if (found)
+        {
+            LOG(LOG_INFO, "** HDLC address found: " << address);
+            if (discovery.cache.size() > 0U)
+            {
+                AddressCache::Store(discovery.cache, meter.meterId, address);
+            }
+        }
+    }
+
+    if (found)
+    {
+        meter.hdlc.phy_address = address;
+    }
+    return found;
+}
+
 bool HasGoodLlc(csm_array *array)
 {
     bool ret = false;
@@ -369,6 +1061,20 @@ bool HasGoodLlc(csm_array *array)
     return ret;
 }
 
+// Confirmed service, normal priority, invoke-id on the 4 low bits
+uint8_t CosemClient::NextInvokeId()
+{
+    mInvokeId = static_cast<uint8_t>((mInvokeId + 1U) & 0x0FU);
+    return static_cast<uint8_t>(0xC0U | mInvokeId);
+}
+
+// Late answer to an earlier request (repeated UDP request, previous timeout): another invoke-id
+static bool IsStaleResponse(const csm_response &response, const csm_request &request)
+{
+    return (response.service != SVC_EXCEPTION) &&
+           ((response.invoke_id & 0x0FU) != (request.sender_invoke_id & 0x0FU));
+}
+
 
 Result CosemClient::Pass3And4(Meter &meter)
 {
@@ -396,7 +1102,7 @@ Result CosemClient::Pass3And4(Meter &meter)
 
     // For reception
     csm_array app_array;
-    csm_array_init(&app_array, &mAppBuffer[0], cAppBufferSize, 0, 0);
+    csm_array_init(&app_array, &mAppBuffer[0], static_cast<uint32_t>(mAppBuffer.size()), 0, 0);
 
 
     uint32_t digest_size = 0U;
@@ -428,7 +1134,7 @@ Result CosemClient::Pass3And4(Meter &meter)
             csm_hal_md5(&input_stoc[0U], input_stoc_size, &digest_stoc[0U]);
             csm_hal_md5(&input_ctos[0U], input_ctos_size, &digest_ctos[0U]);
             digest_size = 16U;
-            std::cout << "** Digest MD5: " << std::endl;
+            LOG(LOG_INFO, "** Digest MD5: ");
         }
         if (mAssoState.auth_level == CSM_AUTH_HIGH_LEVEL_SHA1)
         {
@@ -436,7 +1142,7 @@ Result CosemClient::Pass3And4(Meter &meter)
             csm_hal_sha1(&input_stoc[0U], input_stoc_size, &digest_stoc[0U]);
             csm_hal_sha1(&input_ctos[0U], input_ctos_size, &digest_ctos[0U]);
            digest_size = 20U;
-           std::cout << "** Digest SHA1: " << std::endl;
+           LOG(LOG_INFO, "** Digest SHA1: ");
         }
         else
         {
@@ -444,14 +1150,11 @@ Result CosemClient::Pass3And4(Meter &meter)
             csm_hal_sha256(&input_stoc[0U], input_stoc_size, &digest_stoc[0U]);
             csm_hal_sha256(&input_ctos[0U], input_ctos_size, &digest_ctos[0U]);
             digest_size = 32U;
-            std::cout << "** Digest SHA256 (Manufacturer): " << std::endl;
+            LOG(LOG_INFO, "** Digest SHA256 (Manufacturer): ");
         }
 
-        std::cout << "** Computed StoC: ";
-        Transport::Printer((char*)&digest_stoc[0U], digest_size, PRINT_HEX);
-        std::cout << std::endl << "** Computed CtoS: ";
-        Transport::Printer((char*)&digest_ctos[0U], digest_size, PRINT_HEX);
-        std::cout << std::endl;
+        Log::Hex(LOG_TRACE, "** Computed StoC: ", &digest_stoc[0U], digest_size);
+        Log::Hex(LOG_TRACE, "** Computed CtoS: ", &digest_ctos[0U], digest_size);
     }
     else if (mAssoState.auth_level == CSM_AUTH_HIGH_LEVEL_GMAC)
     {
@@ -471,7 +1174,7 @@ Result CosemClient::Pass3And4(Meter &meter)
     if (digest_size > 0U)
     {
         // Initialize data array for Action SET part
-        csm_array_init(&request.db_request.additional_data.data, &mAppBuffer[0], cAppBufferSize, 0, 0);
+        csm_array_init(&request.db_request.additional_data.data, &mAppBuffer[0], static_cast<uint32_t>(mAppBuffer.size()), 0, 0);
         request.db_request.additional_data.enable = TRUE;
 
         if (csm_axdr_wr_octetstring(&request.db_request.additional_data.data, &digest_stoc[0], digest_size))
@@ -494,15 +1197,13 @@ Result CosemClient::Pass3And4(Meter &meter)
 
                     if (valid)
                     {
-                        std::cout << "** Recieved CtoS: ";
-                        Transport::Printer((char*)csm_array_rd_data(&app_array), digest_size, PRINT_HEX);
-                        std::cout << std::endl;
+                        Log::Hex(LOG_TRACE, "** Recieved CtoS: ", csm_array_rd_data(&app_array), digest_size);
 
                         // Now compute the CtoS digest with the one we have computed
                         // FIXME: in GMAC, there is a security header
                         if (!std::memcmp(csm_array_rd_data(&app_array), &digest_ctos[0U], digest_size))
                         {
-                            std::cout << "** HLS Pass 3 and 4 success! " << std::endl;
+                            LOG(LOG_INFO, "** HLS Pass 3 and 4 success! ");
                         }
                         else
                         {
@@ -571,45 +1272,113 @@ std::string CosemClient::AuthResultToString(enum csm_asso_result result)
     return ss.str();
 }
 
+// Called between two exchanges only: the arrays over the buffers are not kept
+void CosemClient::SizeBuffers(uint16_t clientMaxPdu)
+{
+    mClientMaxPdu = (clientMaxPdu > 0U) ? clientMaxPdu : cDefaultMaxPdu;
+
+    uint32_t size = mClientMaxPdu + cFrameOverhead;
+    mSndBuffer.resize(size);
+    mScratch.resize(size);
+
+    if (mConf.stream)
+    {
+        mAppBuffer.resize(size);
+    }
+}
+
+void CosemClient::UsePreEstablished(Meter &meter)
+{
+    // The server opened the association at start-up: the configuration replaces the AARE
+    mAssoState.auth_level = meter.cosem.GetAuthLevelFromString();
+    mAssoState.ref = LN_REF;
+
+    mXdlms = Xdlms::Context();
+    mXdlms.conformance = meter.cosem.conformance;
+    mXdlms.maxPdu = meter.cosem.max_pdu;
+    mListAllowed = (mXdlms.conformance & Xdlms::cConformanceMultipleReferences) != 0U;
+    SizeBuffers(meter.cosem.client_max_pdu);
+
+    LOG(LOG_INFO, "** Pre-established association (client " << meter.cosem.client << "), conformance: 0x"
+        << std::hex << mXdlms.conformance << std::dec << ", server max PDU size: " << mXdlms.maxPdu
+        << ", client max PDU size: " << mClientMaxPdu);
+}
+
 Result CosemClient::ConnectAarq(Meter &meter)
 {
     Result result;
     result.subject = "CONNECT COSEM (AARQ)";
 
     csm_array scratch_array;
-    csm_array_init(&scratch_array, &mScratch[0], cBufferSize, 0, 3);
+    csm_array_init(&scratch_array, &mScratch[0], static_cast<uint32_t>(mScratch.size()), 0, 3);
 
     mAssoState.auth_level = meter.cosem.GetAuthLevelFromString();
     mAssoState.ref = LN_REF;
 
     if (csm_asso_encoder(&mAssoState, &scratch_array, CSM_ASSO_AARQ))
     {
-        std::string request_data = EncapsulateRequest(meter, &scratch_array);
-        std::string data;
+        uint8_t *aarq = &scratch_array.buff[scratch_array.offset];
+        uint32_t aarqSize = csm_array_written(&scratch_array);
+        Xdlms::Context proposed;
 
-        if (HdlcProcess(meter, request_data, data, mConf.timeout_request, true))
+        bool askList = (mConf.get_list_max > 1U);
+        bool askBlocks = (meter.cosem.gbt_window > 0U) && (meter.transport != HDLC);
+
+        if (Xdlms::DecodeInitiate(aarq, aarqSize, proposed))
         {
-            Transport::Printer(data.c_str(), data.size(), PRINT_HEX);
+            // Ask for GET-Request-With-List and General-Block-Transfer
+            if (askList)
+            {
+                proposed.conformance |= Xdlms::cConformanceMultipleReferences;
+            }
+            if (askBlocks)
+            {
+                proposed.conformance |= Xdlms::cConformanceGeneralBlockTransfer;
+            }
+            if (meter.cosem.client_max_pdu > 0U)
+            {
+                proposed.maxPdu = meter.cosem.client_max_pdu;
+            }
+            Xdlms::PatchInitiateRequest(aarq, aarqSize, proposed);
+        }
+
+        std::string request_data = EncapsulateRequest(meter, &scratch_array);
 
-            csm_array_init(&scratch_array, &mScratch[0], cBufferSize, 0, 0);
-            csm_array_write_buff(&scratch_array, (const uint8_t *)data.c_str(), data.size());
+        // The server sends no APDU bigger than the size proposed
+        SizeBuffers(proposed.maxPdu);
 
-            if (HasGoodLlc(&scratch_array))
+        // The AARE is received in place into the scratch buffer
+        csm_array_init(&scratch_array, &mScratch[0], static_cast<uint32_t>(mScratch.size()), 0, 0);
+
+        if (DataExchange(meter, request_data, scratch_array, mConf.timeout_request, true, false))
+        {
+            Log::Hex(LOG_TRACE, "AARE: ", &mScratch[0], csm_array_written(&scratch_array));
+
+            // The wrapper header replaces the LLC on TCP/IP and UDP/IP transports
+            if ((meter.transport != HDLC) || HasGoodLlc(&scratch_array))
             {
                 // Good Cosem server packet
+                mXdlms = Xdlms::Context();
+                if (Xdlms::DecodeInitiate(csm_array_rd_data(&scratch_array), csm_array_unread(&scratch_array), mXdlms))
+                {
+                    LOG(LOG_INFO, "** Negotiated conformance: 0x" << std::hex << mXdlms.conformance << std::dec
+                        << ", server max PDU size: " << mXdlms.maxPdu << ", client max PDU size: " << mClientMaxPdu);
+                }
+                mListAllowed = (mXdlms.conformance & Xdlms::cConformanceMultipleReferences) != 0U;
+
                 if (csm_asso_decoder(&mAssoState, &scratch_array, CSM_ASSO_AARE))
                 {
                     if (mAssoState.handshake.accepted)
                     {
                         if (mAssoState.auth_level <= CSM_AUTH_LOW_LEVEL)
                         {
-                            std::cout << "** Authentication success: access granted." << std::endl;
+                            LOG(LOG_INFO, "** Authentication success: access granted.");
                         }
                         else if (mAssoState.auth_level > CSM_AUTH_LOW_LEVEL)
                         {
                             if (mAssoState.handshake.result == CSM_ASSO_AUTH_REQUIRED)
                             {
-                                std::cout << "** High authentication: Starting pass 3." << std::endl;
+                                LOG(LOG_INFO, "** High authentication: Starting pass 3.");
                                 result = Pass3And4(meter);
                             }
                             else
@@ -655,13 +1424,7 @@ Result CosemClient::ConnectAarq(Meter &meter)
 
 std::string CosemClient::GetLls()
 {
-    std::string lls;
-
-    if (mConf.meters.size() > 0)
-    {
-        lls = mConf.meters[mMeterIndex].cosem.auth_password;
-    }
-    return lls;
+    return mLls;
 }
 
 std::string CosemClient::ResultToString(csm_data_access_result result)
@@ -723,7 +1486,7 @@ std::string CosemClient::ResultToString(csm_data_access_result result)
     return ss.str();
 }
 
-static AxdrPrinter gPrinter;
+static thread_local AxdrPrinter gPrinter;
 
 static void AxdrData(uint8_t type, uint32_t size, uint8_t *data)
 {
@@ -731,13 +1494,90 @@ static void AxdrData(uint8_t type, uint32_t size, uint8_t *data)
 }
 
 
+// The APDU has been received in place from 'written - overlap' in the application buffer:
+// keep its payload only. The first APDU header is just skipped; for the next blocks, the
+// header has been written over the last 'overlap' bytes of the previous payload (saved
+// before the reception), so that the payload already sits at its final place when the
+// header size does not change.
+static void AppendPayload(csm_array &app, csm_array &rx, uint32_t written, const uint8_t *saved, uint32_t overlap)
+{
+    uint8_t *payload = csm_array_rd_data(&rx);
+    uint32_t size = csm_array_unread(&rx);
+    uint32_t header = static_cast<uint32_t>(payload - rx.buff);
+
+    if (written == 0U)
+    {
+        app.wr_index += header + size;
+        csm_array_reader_jump(&app, header);
+    }
+    else
+    {
+        if (header != overlap)
+        {
+            std::memmove(&app.buff[written], payload, size);
+        }
+        std::memcpy(&app.buff[written - overlap], saved, overlap);
+        app.wr_index += size;
+    }
+}
+
+// Dates of the session file, checkpoints and cursors
+static std::string FormatDate(const std::tm &date)
+{
+    std::stringstream ss;
+    ss << std::put_time(&date, "%Y-%m-%d.%H:%M:%S");
+    return ss.str();
+}
+
+// The second after 'date': selective access ranges include their first value
+static bool NextSecond(const std::string &date, std::tm &next)
+{
+    std::tm tm = {};
+    std::stringstream ss(date);
+    ss >> std::get_time(&tm, "%Y-%m-%d.%H:%M:%S");
+
+    if (ss.fail())
+    {
+        return false;
+    }
+
+    // Normalized by mktime()
+    tm.tm_sec++;
+    tm.tm_isdst = -1;
+    std::mktime(&tm);
+    next = tm;
+    return true;
+}
+
+static std::string DumpFileName(const Meter &meter, const Object &obj)
+{
+    return meter.meterId + Util::DIR_SEPARATOR + obj.name + ".xml";
+}
+
 std::string CosemClient::EncapsulateRequest(Meter &meter, csm_array *request)
 {
     std::string request_data;
 
     if (request->offset != 3U)
     {
-        std::cout << "Cosem array must have room for LLC" << std::endl;
+        LOG(LOG_ERROR, "Cosem array must have room for LLC");
+    }
+    else if (meter.transport != HDLC)
+    {
+        // No LLC on wrapper transports, the APDU starts after the reserved room
+        uint32_t size = csm_array_written(request);
+
+        mSndBuffer[0] = static_cast<char>(cWrapperVersion >> 8U);
+        mSndBuffer[1] = static_cast<char>(cWrapperVersion & 0xFFU);
+        mSndBuffer[2] = static_cast<char>(meter.cosem.client >> 8U);
+        mSndBuffer[3] = static_cast<char>(meter.cosem.client & 0xFFU);
+        mSndBuffer[4] = static_cast<char>(meter.cosem.logical_device >> 8U);
+        mSndBuffer[5] = static_cast<char>(meter.cosem.logical_device & 0xFFU);
+        mSndBuffer[6] = static_cast<char>(size >> 8U);
+        mSndBuffer[7] = static_cast<char>(size & 0xFFU);
+
+        request_data.assign((char *)&mSndBuffer[0], cWrapperHeaderSize);
+        request_data.append((char *)&request->buff[request->offset], size);
     }
     else
     {
@@ -751,7 +1591,7 @@ std::string CosemClient::EncapsulateRequest(Meter &meter, csm_array *request)
 
         // Encode HDLC
         meter.hdlc.sender = HDLC_CLIENT;
-        int send_size = hdlc_encode_data(&meter.hdlc, (uint8_t *)&mSndBuffer[0], cBufferSize, request->buff, csm_array_written(request));
+        int send_size = hdlc_encode_data(&meter.hdlc, (uint8_t *)&mSndBuffer[0], static_cast<uint32_t>(mSndBuffer.size()), request->buff, csm_array_written(request));
 
         request_data.assign((char *)&mSndBuffer[0], send_size);
     }
@@ -801,17 +1641,19 @@ Result CosemClient::AccessObject(Meter &meter, const Object &obj, csm_request &r
         allowSelectiveAccess = true;
     }
 
+    std::string startDate = (obj.from_date.size() > 0U) ? obj.from_date : mConf.start_date;
+
     if (allowSelectiveAccess)
     {
-        if (mConf.start_date.size() > 0)
+        if (startDate.size() > 0)
         {
             // Try to decode start date
-            std::stringstream ss(mConf.start_date);
+            std::stringstream ss(startDate);
             ss >> std::get_time(&tm_start, "%Y-%m-%d.%H:%M:%S");
 
             if (ss.fail())
             {
-                std::cout << "** Parse start date failed\r\n";
+                LOG(LOG_ERROR, "** Parse start date failed");
                 allowSelectiveAccess = false;
             }
         }
@@ -827,7 +1669,7 @@ Result CosemClient::AccessObject(Meter &meter, const Object &obj, csm_request &r
             ss2 >> std::get_time(&tm_end, "%Y-%m-%d.%H:%M:%S");
             if (ss2.fail())
             {
-                std::cout << "** Parse end date failed\r\n";
+                LOG(LOG_ERROR, "** Parse end date failed");
                 allowSelectiveAccess = false;
             }
             else
@@ -839,10 +1681,37 @@ Result CosemClient::AccessObject(Meter &meter, const Object &obj, csm_request &r
         {
             // No end date
         	hasEndDate = false;
-            std::cout << "** No end date defined" << std::endl;
+            LOG(LOG_INFO, "** No end date defined");
+        }
+    }
+
+    // A profile read interrupted in a previous session goes on after the last row dumped
+    bool resume = false;
+    if ((obj.attribute_id == 2) && (obj.class_id == 7U) && obj.dump && mConf.stream &&
+        (mConf.checkpoint.size() > 0U) &&
+        Checkpoint::Find(mConf.checkpoint, meter.meterId, obj.name, mCheckpoint))
+    {
+        std::ifstream part(DumpFileName(meter, obj) + ".part");
+
+        if (part.good() && NextSecond(mCheckpoint.clock, tm_start))
+        {
+            LOG(LOG_INFO, "** Resuming " << obj.name << " after " << mCheckpoint.rows << " rows (" << mCheckpoint.clock << ")");
+            allowSelectiveAccess = true;
+            resume = true;
         }
     }
 
+    // Access by entry, encoded here: not supported by the Cosem library
+    bool byEntry = (obj.attribute_id == 2) && (obj.class_id == 7U) && (obj.from_entry > 0U) && !resume;
+    if (byEntry)
+    {
+        allowSelectiveAccess = false;
+    }
+
+    mDumped = false;
+    mDumpRows = 0U;
+    mDumpHasClock = false;
+
     if (allowSelectiveAccess)
     {
         // Setup selective access options
@@ -911,33 +1780,102 @@ Result CosemClient::AccessObject(Meter &meter, const Object &obj, csm_request &r
     request.db_request.logical_name.id = obj.attribute_id;
 
     csm_array scratch_array;
-    csm_array_init(&scratch_array, &mScratch[0], cBufferSize, 0, 3);
+    csm_array_init(&scratch_array, &mScratch[0], static_cast<uint32_t>(mScratch.size()), 0, 3);
+
+    bool encoded = false;
+    if (result.success && byEntry)
+    {
+        Xdlms::AttributeDescriptor descriptor;
+        uint8_t apdu[64];
+
+        descriptor.classId = obj.class_id;
+        descriptor.obis[0] = request.db_request.logical_name.obis.A;
+        descriptor.obis[1] = request.db_request.logical_name.obis.B;
+        descriptor.obis[2] = request.db_request.logical_name.obis.C;
+        descriptor.obis[3] = request.db_request.logical_name.obis.D;
+        descriptor.obis[4] = request.db_request.logical_name.obis.E;
+        descriptor.obis[5] = request.db_request.logical_name.obis.F;
+        descriptor.attribute = obj.attribute_id;
+
+        uint32_t size = Xdlms::EncodeGetByEntry(&apdu[0], sizeof(apdu), static_cast<uint8_t>(request.sender_invoke_id), descriptor,
+                                                obj.from_entry, obj.to_entry, obj.from_column, obj.to_column);
+        encoded = (size > 0U) && csm_array_write_buff(&scratch_array, &apdu[0], size);
+        LOG(LOG_INFO, "** Entries " << obj.from_entry << " to " << obj.to_entry << ", columns " << obj.from_column << " to " << obj.to_column);
+    }
+    else if (result.success)
+    {
+        encoded = svc_request_encoder(&request, &scratch_array);
+    }
+
+    // The whole response is reassembled in the application buffer: not when streaming
+    bool generalBlocks = encoded && !mConf.stream && GeneralBlocksAllowed(meter);
+    if (generalBlocks)
+    {
+        std::vector<uint8_t> apdu(&scratch_array.buff[scratch_array.offset],
+                                  &scratch_array.buff[scratch_array.offset + csm_array_written(&scratch_array)]);
 
-    if (result.success && svc_request_encoder(&request, &scratch_array))
+        std::vector<uint8_t> block(apdu.size() + 16U);
+        uint32_t size = Xdlms::EncodeGeneralBlock(&block[0], static_cast<uint32_t>(block.size()), Xdlms::cBlockLast | meter.cosem.gbt_window,
+                                                  1U, 0U, &apdu[0], static_cast<uint32_t>(apdu.size()));
+
+        csm_array_init(&scratch_array, &mScratch[0], static_cast<uint32_t>(mScratch.size()), 0, 3);
+        encoded = (size > 0U) && csm_array_write_buff(&scratch_array, &block[0], size);
+    }
+
+    if (encoded)
     {
-        std::cout << "** Sending request for object: " << obj.name << std::endl;
+        LOG(LOG_INFO, "** Sending request for object: " << obj.name);
 
         std::string request_data = EncapsulateRequest(meter, &scratch_array);
-        std::string data;
         bool loop = true;
         bool dump = false;
         uint32_t retries = 0U;
+        uint32_t lastBlock = 0U;
+        bool waitOnly = false;
+
+        // The APDUs are received in place at the end of the application buffer
+        uint8_t saved[cMaxHeaderOverlap];
+        uint32_t overlap = 0U;
+        csm_array rx;
+        bool streaming = false;
+
+        // The next block is requested as soon as the current one is known to be valid
+        bool sent = false;
+        std::chrono::steady_clock::time_point requestedAt;
+        uint32_t blocks = 0U;
+        uint32_t totalTurnaround = 0U;
+        uint32_t maxTurnaround = 0U;
 
         do
         {
-            data.clear();
+            uint32_t written = csm_array_written(&app_array);
+            uint32_t start = written - overlap;
+            bool appended = false;
+
+            std::memcpy(&saved[0], &app_array.buff[start], overlap);
+            // A shorter header moves the payload right by up to 'overlap' bytes: keep that room
+            csm_array_init(&rx, &app_array.buff[start], app_array.size - written, 0, 0);
 
-            if (HdlcProcess(meter, request_data, data, mConf.timeout_request, true))
+            if (!sent && !waitOnly)
             {
-                Transport::Printer(data.c_str(), data.size(), PRINT_HEX);
-                csm_array_init(&scratch_array, &mScratch[0], cBufferSize, 0, 0);
+                requestedAt = std::chrono::steady_clock::now();
+            }
+
+            // After a duplicate block, the expected one may still be on its way: do not ask again
+            bool exchanged = generalBlocks ?
+                    GeneralBlockExchange(meter, waitOnly ? std::string() : request_data, rx, sent) :
+                    DataExchange(meter, waitOnly ? std::string() : request_data, rx, mConf.timeout_request, true, sent);
+            waitOnly = false;
+            sent = false;
 
-                csm_array_write_buff(&scratch_array, (const uint8_t *)data.c_str(), data.size());
+            if (exchanged)
+            {
+                Log::Hex(LOG_TRACE, "APDU: ", rx.buff, csm_array_written(&rx));
 
-                if (HasGoodLlc(&scratch_array))
+                if ((meter.transport != HDLC) || HasGoodLlc(&rx))
                 {
                     // Good Cosem server packet
-                    if (csm_client_decode(&response, &scratch_array))
+                    if (csm_client_decode(&response, &rx))
                     {
                         bool isResponseValid = false;
 
@@ -961,59 +1899,115 @@ Result CosemClient::AccessObject(Meter &meter, const Object &obj, csm_request &r
                         }
 
 
-                        if (isResponseValid)
+                        if (IsStaleResponse(response, request))
+                        {
+                            LOG(LOG_TRACE, "** Response to another request discarded, invoke-id: " << static_cast<uint32_t>(response.invoke_id));
+                            waitOnly = true;
+                        }
+                        else if (isResponseValid)
                         {
-                            if (response.type == SVC_RESPONSE_NORMAL)
+                            if ((response.type == SVC_RESPONSE_NORMAL) && resume)
                             {
-                                // We have the data, copy it to the application buffer and stop
-                                csm_array_write_buff(&app_array, csm_array_rd_data(&scratch_array), csm_array_unread(&scratch_array));
+                                // The end of an interrupted read: append it to the dump
+                                streaming = StreamStart(meter, obj, true);
+                                if (streaming && !StreamBlock(meter, obj, csm_array_rd_data(&rx), csm_array_unread(&rx), 0U))
+                                {
+                                    result.SetError("** Cannot decode the data");
+                                }
                                 loop = false;
                                 dump = true;
                             }
-                            else if (response.type == SVC_RESPONSE_WITH_DATABLOCK)
+                            else if (response.type == SVC_RESPONSE_NORMAL)
+                            {
+                                // We have the data, keep it in the application buffer and stop
+                                AppendPayload(app_array, rx, written, &saved[0], overlap);
+                                appended = true;
+                                loop = false;
+                                dump = true;
+                            }
+                            else if ((response.type == SVC_RESPONSE_WITH_DATABLOCK) &&
+                                     (response.block_number <= lastBlock))
+                            {
+                                // Late answer to a repeated UDP request, the block is already stored
+                                LOG(LOG_TRACE, "** Duplicate block " << response.block_number << " discarded");
+                                waitOnly = true;
+                            }
+                            else if (response.type == SVC_RESPONSE_WITH_DATABLOCK)
                             {
                             	// Copy data into app data
 								uint32_t size = 0U;
-								if (csm_axdr_decode_block(&scratch_array, &size))
+								if (csm_axdr_decode_block(&rx, &size))
 								{
-									std::cout << "** Block of data of size: " << size << std::endl;
-									// FIXME: Test the size indicated in the packet and the real size received
-									// Add it
-									csm_array_write_buff(&app_array, csm_array_rd_data(&scratch_array), csm_array_unread(&scratch_array));
+									uint32_t turnaround = ElapsedMs(requestedAt);
+									bool more = csm_client_has_more_data(&response);
 
-									// Check if last block
-									if (csm_client_has_more_data(&response))
+									if (more)
 									{
-										// Send next block
-										request.type = SVC_REQUEST_NEXT;
-										request.db_request.block_number = response.block_number;
-										request.sender_invoke_id = response.invoke_id;
-
-										csm_array_init(&scratch_array, &mScratch[0], cBufferSize, 0, 3);
-
-										svc_request_encoder(&request, &scratch_array);
+										// Ask for the next block before storing this one, the meter prepares it meanwhile
+										if (lastBlock == 0U)
+										{
+											PrepareNextRequest(meter, static_cast<uint8_t>(response.invoke_id));
+										}
+										request_data = NextBlockRequest(meter, response.block_number);
+										sent = SendRequest(meter, request_data);
+										requestedAt = std::chrono::steady_clock::now();
+									}
 
-										hdlc_print_result(&meter.hdlc, HDLC_OK);
-										request_data = EncapsulateRequest(meter, &scratch_array);
+									blocks++;
+									totalTurnaround += turnaround;
+									maxTurnaround = std::max(maxTurnaround, turnaround);
+									LOG(LOG_TRACE, "** Block " << response.block_number << " of size: " << size << ", turnaround: " << turnaround << " ms");
+									// FIXME: Test the size indicated in the packet and the real size received
+									if (mConf.stream)
+									{
+										// Decoded and dumped now, the next block is received at the same place
+										if (obj.dump)
+										{
+											if (!streaming)
+											{
+												streaming = StreamStart(meter, obj, resume);
+											}
+											if (streaming && !StreamBlock(meter, obj, csm_array_rd_data(&rx), csm_array_unread(&rx), response.block_number))
+											{
+												result.SetError("** Cannot decode the data blocks");
+											}
+										}
+									}
+									else
+									{
+										// Add it, the next header is expected to have the same size
+										uint32_t header = static_cast<uint32_t>(csm_array_rd_data(&rx) - rx.buff);
+										AppendPayload(app_array, rx, written, &saved[0], overlap);
+										appended = true;
+										overlap = (header <= cMaxHeaderOverlap) ? header : 0U;
+									}
+									lastBlock = response.block_number;
 
-										printf("** Sending ReadProfile next...\r\n");
+									// Check if last block
+									if (!result.success)
+									{
+										loop = false;
+									}
+									else if (more)
+									{
+										LOG(LOG_TRACE, "** ReadProfile next requested");
 									}
 									else
 									{
-										std::cout << "** No more data" << std::endl;
+										LOG(LOG_INFO, "** No more data");
 										loop = false;
 										dump = true;
 									}
 								}
 								else
 								{
-									std::cout << "** ERROR: must be a block of data" << std::endl;
+									LOG(LOG_ERROR, "** ERROR: must be a block of data");
 									loop = false;
 								}
                             }
                             else
                             {
-                                std::cout << "** Service not supported" << std::endl;
+                                LOG(LOG_INFO, "** Service not supported");
                                 loop = false;
                             }
                         }
@@ -1026,6 +2020,7 @@ Result CosemClient::AccessObject(Meter &meter, const Object &obj, csm_request &r
                                 std::stringstream ss;
                                 ss << "** Data access result: " << ResultToString(response.access_result);
                                 result.SetError(ss.str());
+                                result.transient = (response.access_result == CSM_ACCESS_RESULT_TEMPORARY_FAILURE);
                             }
                             else if (response.service == SVC_EXCEPTION)
                             {
@@ -1041,91 +2036,745 @@ Result CosemClient::AccessObject(Meter &meter, const Object &obj, csm_request &r
                                     ss << "Service unknown.";
                                 }
 
-                                if (response.exception.service_err == 1)
-                                {
-                                    ss << "Operation not possible.";
-                                }
-                                else if (response.exception.service_err == 2)
-                                {
-                                    ss << "Service not supported.";
-                                }
-                                else
-                                {
-                                    ss << "Other reason.";
-                                }
+                                if (response.exception.service_err == 1)
+                                {
+                                    ss << "Operation not possible.";
+                                }
+                                else if (response.exception.service_err == 2)
+                                {
+                                    ss << "Service not supported.";
+                                }
+                                else
+                                {
+                                    ss << "Other reason.";
+                                }
+
+                                result.SetError(ss.str());
+                                result.released = true;
+                            }
+                            else
+                            {
+                                result.SetError("** Error, service not found! ");
+                            }
+                            loop = false;
+                        }
+                    }
+                    else
+                    {
+                        result.SetError("** Cannot decode Cosem response");
+                        loop = false;
+                    }
+                }
+                else
+                {
+                    result.SetError("** Not a compliant HDLC LLC");
+                    result.released = true;
+                    loop = false;
+                }
+            }
+            else if (mDisconnected)
+            {
+                result.SetError("** HDLC link disconnected by the meter");
+                result.released = true;
+                loop = false;
+            }
+            else
+            {
+                retries++;
+                if (retries > mConf.retries)
+                {
+                    result.SetError("** Cannot get Cosem data");
+                    result.transient = true;
+                    result.unanswered = true;
+                    loop = false;
+                }
+            }
+
+            if (!appended)
+            {
+                // Restore the end of the previous payload, overwritten by the reception
+                std::memcpy(&app_array.buff[written - overlap], &saved[0], overlap);
+            }
+        }
+        while(loop);
+
+        if (sent)
+        {
+            // Stopped on an error: collect the response of the next block, already requested
+            csm_array_init(&rx, &app_array.buff[0], app_array.size, 0, 0);
+            DataExchange(meter, std::string(), rx, mConf.timeout_request, false, false);
+        }
+
+        if (blocks > 0U)
+        {
+            LOG(LOG_INFO, "** " << blocks << " blocks, turnaround average: " << (totalTurnaround / blocks) << " ms, max: " << maxTurnaround << " ms");
+        }
+
+        if (streaming)
+        {
+            if (!StreamEnd(meter, obj, dump) && result.success)
+            {
+                result.SetError("** Incomplete data blocks");
+            }
+        }
+        else if (dump && obj.dump)
+        {
+            DumpObject(meter, obj, app_array);
+        }
+    }
+
+    return result;
+}
+
+void CosemClient::DumpObject(const Meter &meter, const Object &obj, csm_array &data)
+{
+    std::string infos = "Object=\"" + obj.name + "\"";
+    gPrinter.Start(infos);
+    csm_axdr_decode_tags(&data, AxdrData);
+    gPrinter.End();
+
+    mDumped = true;
+    mDumpRows = gPrinter.Rows();
+    mDumpHasClock = gPrinter.LastRowClock(mDumpClock);
+
+    std::string xml_data = gPrinter.Get();
+    LOG(LOG_TRACE, xml_data);
+
+    std::string fileName = DumpFileName(meter, obj);
+
+    LOG(LOG_INFO, "Dumping into file: " << fileName);
+
+    std::fstream f;
+
+    Util::Mkdir(meter.meterId);
+    f.open(fileName, std::ios_base::out | std::ios_base::binary);
+
+    if (f.is_open())
+    {
+        f << xml_data << std::endl;
+        f.close();
+    }
+    else
+    {
+        LOG(LOG_ERROR, "Cannot open file!");
+    }
+}
+
+// The GET-Request-Next APDU is encoded once per block transfer, with the LLC in front for HDLC
+void CosemClient::PrepareNextRequest(Meter &meter, uint8_t invokeId)
+{
+    mNextApdu[0] = 0xE6U;
+    mNextApdu[1] = 0xE6U;
+    mNextApdu[2] = 0x00U;
+    Xdlms::EncodeGetNext(&mNextApdu[cLlcSize], Xdlms::cGetNextSize, invokeId, 0U);
+
+    if (meter.transport != HDLC)
+    {
+        csm_array request;
+        csm_array_init(&request, &mScratch[0], static_cast<uint32_t>(mScratch.size()), 0, 3);
+        csm_array_write_buff(&request, &mNextApdu[cLlcSize], Xdlms::cGetNextSize);
+        mNextRequest = EncapsulateRequest(meter, &request);
+    }
+}
+
+// Only the block number is patched; the HDLC frame is encoded again for its sequence numbers
+std::string CosemClient::NextBlockRequest(Meter &meter, uint32_t block)
+{
+    uint8_t *number = &mNextApdu[sizeof(mNextApdu) - 4U];
+
+    number[0] = static_cast<uint8_t>(block >> 24U);
+    number[1] = static_cast<uint8_t>(block >> 16U);
+    number[2] = static_cast<uint8_t>(block >> 8U);
+    number[3] = static_cast<uint8_t>(block);
+
+    if (meter.transport != HDLC)
+    {
+        mNextRequest.replace(mNextRequest.size() - 4U, 4U, reinterpret_cast<const char *>(number), 4U);
+        return mNextRequest;
+    }
+
+    meter.hdlc.sender = HDLC_CLIENT;
+    int size = hdlc_encode_data(&meter.hdlc, (uint8_t *)&mSndBuffer[0], static_cast<uint32_t>(mSndBuffer.size()), &mNextApdu[0], sizeof(mNextApdu));
+    return std::string(&mSndBuffer[0], size);
+}
+
+bool CosemClient::GeneralBlocksAllowed(const Meter &meter) const
+{
+    // The server can stream without a poll from the client on wrapper transports only
+    return (meter.cosem.gbt_window > 0U) && (meter.transport != HDLC) &&
+           ((mXdlms.conformance & Xdlms::cConformanceGeneralBlockTransfer) != 0U);
+}
+
+// Acknowledge of the blocks received in sequence up to 'ack', it opens the next window
+std::string CosemClient::GeneralBlockAck(Meter &meter, uint16_t number, uint16_t ack)
+{
+    uint8_t apdu[16];
+    uint32_t size = Xdlms::EncodeGeneralBlock(&apdu[0], sizeof(apdu), Xdlms::cBlockLast | meter.cosem.gbt_window, number, ack, NULL, 0U);
+
+    csm_array request;
+    csm_array_init(&request, &mScratch[0], static_cast<uint32_t>(mScratch.size()), 0, 3);
+    csm_array_write_buff(&request, &apdu[0], size);
+    return EncapsulateRequest(meter, &request);
+}
+
+// The response blocks streamed by the server are reassembled in place into 'rcv', acknowledged
+// at the end of each window. A lost block is asked again by acknowledging the last one received
+// in sequence: the server goes on from there. A response not using General-Block-Transfer is
+// returned as received
+bool CosemClient::GeneralBlockExchange(Meter &meter, const std::string &send, csm_array &rcv, bool sent)
+{
+    std::string request = send;
+    uint16_t expected = 1U;
+    uint16_t number = 1U; // The request is the first client block
+    uint32_t retries = 0U;
+    uint32_t acks = 0U;
+    uint32_t lost = 0U;
+
+    while (true)
+    {
+        uint32_t written = csm_array_written(&rcv);
+        csm_array frame;
+        csm_array_init(&frame, &rcv.buff[written], rcv.size - written, 0, 0);
+
+        bool received = DataExchange(meter, request, frame, mConf.timeout_request, false, sent);
+        sent = false;
+        request.clear();
+
+        if (!received)
+        {
+            retries++;
+            if ((expected == 1U) || (retries > mConf.retries))
+            {
+                // Nothing received yet: the caller repeats the request
+                return false;
+            }
+            // End of the window lost
+            LOG(LOG_INFO, "** No block after " << (expected - 1U) << ", acknowledging again");
+            number++;
+            acks++;
+            request = GeneralBlockAck(meter, number, expected - 1U);
+            continue;
+        }
+
+        Xdlms::GeneralBlock block;
+        if (!Xdlms::DecodeGeneralBlock(frame.buff, csm_array_written(&frame), block))
+        {
+            if (expected == 1U)
+            {
+                // Plain response, already in place
+                rcv.wr_index += csm_array_written(&frame);
+                return true;
+            }
+            LOG(LOG_ERROR, "** Not a General-Block-Transfer APDU");
+            return false;
+        }
+
+        if (block.number == expected)
+        {
+            std::memmove(&rcv.buff[written], block.data, block.size);
+            rcv.wr_index += block.size;
+            expected++;
+            LOG(LOG_TRACE, "** General block " << block.number << " of size: " << block.size);
+
+            if ((block.control & Xdlms::cBlockLast) != 0U)
+            {
+                LOG(LOG_INFO, "** " << block.number << " general blocks, " << acks << " acknowledges, " << lost << " lost");
+                return true;
+            }
+        }
+        else if (block.number < expected)
+        {
+            LOG(LOG_TRACE, "** Duplicate general block " << block.number << " discarded");
+        }
+        else
+        {
+            lost++;
+            LOG(LOG_INFO, "** General block " << expected << " lost, received " << block.number);
+        }
+
+        if ((block.control & Xdlms::cBlockStreaming) == 0U)
+        {
+            // End of the window: the server waits for the acknowledge
+            retries = 0U;
+            number++;
+            acks++;
+            request = GeneralBlockAck(meter, number, expected - 1U);
+        }
+    }
+}
+
+// Opens the dump file of an object received by blocks: it is written as the blocks arrive.
+// When resuming, the rows are appended to the dump of the interrupted read
+bool CosemClient::StreamStart(const Meter &meter, const Object &obj, bool resume)
+{
+    std::string fileName = DumpFileName(meter, obj);
+
+    LOG(LOG_INFO, "Streaming into file: " << fileName);
+
+    // Renamed once complete, a failed read does not leave a truncated dump
+    mStreamFileName = fileName;
+    Util::Mkdir(meter.meterId);
+    mStreamFile.open(fileName + ".part", std::ios_base::out | std::ios_base::binary | (resume ? std::ios_base::app : std::ios_base::trunc));
+
+    if (!mStreamFile.is_open())
+    {
+        LOG(LOG_ERROR, "Cannot open file!");
+        return false;
+    }
+
+    if (!resume)
+    {
+        mCheckpoint = Checkpoint();
+    }
+    mStreamRows = 0U;
+
+    gPrinter.Clear();
+    if (resume)
+    {
+        gPrinter.Continue();
+    }
+    else
+    {
+        gPrinter.Start("Object=\"" + obj.name + "\"");
+    }
+    mStream.Start(AxdrData);
+    return true;
+}
+
+// Only complete rows are written, the checkpoint follows the last one
+bool CosemClient::StreamBlock(const Meter &meter, const Object &obj, const uint8_t *data, uint32_t size, uint32_t block)
+{
+    bool ok = mStream.Feed(data, size);
+
+    gPrinter.FlushRows(mStreamFile);
+    mStreamFile.flush();
+    LOG(LOG_TRACE, "** Streamed block, " << mStream.Pending() << " bytes pending");
+
+    std::tm clock;
+    if (ok && (mConf.checkpoint.size() > 0U) && (gPrinter.Rows() > mStreamRows) && gPrinter.LastRowClock(clock))
+    {
+        Checkpoint checkpoint;
+        checkpoint.clock = FormatDate(clock);
+        checkpoint.rows = mCheckpoint.rows + gPrinter.Rows();
+        checkpoint.block = block;
+        Checkpoint::Store(mConf.checkpoint, meter.meterId, obj.name, checkpoint);
+        mStreamRows = gPrinter.Rows();
+    }
+    return ok;
+}
+
+// Returns false if the object has not been received completely
+bool CosemClient::StreamEnd(const Meter &meter, const Object &obj, bool success)
+{
+    bool complete = success && mStream.Finished();
+
+    mDumped = true;
+    mDumpRows = gPrinter.Rows();
+    mDumpHasClock = gPrinter.LastRowClock(mDumpClock);
+
+    if (complete)
+    {
+        gPrinter.End();
+        gPrinter.Flush(mStreamFile);
+        mStreamFile << std::endl;
+    }
+    mStreamFile.close();
+
+    std::string partName = mStreamFileName + ".part";
+    Checkpoint checkpoint;
+    if (complete)
+    {
+        std::remove(mStreamFileName.c_str());
+        complete = (std::rename(partName.c_str(), mStreamFileName.c_str()) == 0);
+        if (mConf.checkpoint.size() > 0U)
+        {
+            Checkpoint::Remove(mConf.checkpoint, meter.meterId, obj.name);
+        }
+    }
+    else if ((mConf.checkpoint.size() > 0U) && Checkpoint::Find(mConf.checkpoint, meter.meterId, obj.name, checkpoint))
+    {
+        LOG(LOG_INFO, "** Read interrupted after " << checkpoint.rows << " rows (" << checkpoint.clock << "), kept for the next session");
+    }
+    else
+    {
+        std::remove(partName.c_str());
+    }
+    gPrinter.Clear();
+    return complete;
+}
+
+// Double-long-unsigned attribute of the object, such as the entries of a profile buffer
+bool CosemClient::ReadUnsigned32(Meter &meter, const Object &obj, int8_t attribute, uint32_t &value)
+{
+    Object attr;
+    attr.name = obj.name;
+    attr.ln = obj.ln;
+    attr.class_id = obj.class_id;
+    attr.attribute_id = attribute;
+    attr.dump = false;
+
+    csm_request request;
+    csm_response response;
+    request.db_request.service = SVC_GET;
+    request.type = SVC_REQUEST_NORMAL;
+    request.sender_invoke_id = NextInvokeId();
+
+    csm_array app_array;
+    csm_array_init(&app_array, &mAppBuffer[0], static_cast<uint32_t>(mAppBuffer.size()), 0, 0);
+
+    Result result = AccessObject(meter, attr, request, response, app_array);
+    const uint8_t *data = csm_array_rd_data(&app_array);
+
+    if (!result.success || (csm_array_unread(&app_array) < 5U) || (data[0] != AXDR_TAG_UNSIGNED32))
+    {
+        return false;
+    }
+    value = (static_cast<uint32_t>(data[1]) << 24U) | (static_cast<uint32_t>(data[2]) << 16U) |
+            (static_cast<uint32_t>(data[3]) << 8U) | data[4];
+    return true;
+}
+
+// Restricts the read of a profile buffer to the rows captured since the last read.
+// Returns false if there is no new row
+bool CosemClient::PrepareIncrementalRead(Meter &meter, const Object &obj, Incremental &read)
+{
+    ProfileCursor cursor;
+    uint32_t profileEntries = 0U;
+
+    read.object = obj;
+    read.entriesInUse = 0U;
+    read.counted = false;
+
+    if (mConf.cursor.size() == 0U)
+    {
+        LOG(LOG_ERROR, "** No cursor file in the session, " << obj.name << " is read completely");
+        return true;
+    }
+
+    if (!ProfileCursor::Find(mConf.cursor, meter.meterId, obj.name, cursor))
+    {
+        // First read: the whole buffer, or from the session start date
+        read.counted = ReadUnsigned32(meter, obj, 7, read.entriesInUse);
+        return true;
+    }
+
+    // entries_in_use and profile_entries, read once per poll
+    read.counted = ReadUnsigned32(meter, obj, 7, read.entriesInUse) &&
+                   ReadUnsigned32(meter, obj, 8, profileEntries);
+
+    std::tm next;
+    if (read.counted && (read.entriesInUse < profileEntries))
+    {
+        // The buffer is not full: the entries already read keep their number
+        if (read.entriesInUse == cursor.entries)
+        {
+            return false;
+        }
+        // Fewer entries than before: the buffer has been reset
+        read.object.from_entry = (read.entriesInUse > cursor.entries) ? (cursor.entries + 1U) : 1U;
+        read.object.to_entry = 0U;
+    }
+    else if (NextSecond(cursor.clock, next))
+    {
+        // The oldest rows are overwritten and the entries renumbered: by range after the last row
+        read.object.from_date = FormatDate(next);
+        read.object.from_entry = 0U;
+        if ((obj.from_column > 1U) || (obj.to_column != 0U))
+        {
+            // The range selector selects columns by capture object, not by number
+            LOG(LOG_INFO, "** " << obj.name << ": buffer wrapped, the columns selection is ignored, full rows are read");
+        }
+    }
+    LOG(LOG_INFO, "** " << obj.name << ": " << read.entriesInUse << " entries in use, " << cursor.entries << " already read");
+    return true;
+}
+
+void CosemClient::StoreCursor(const Meter &meter, const Object &obj)
+{
+    ProfileCursor cursor;
+
+    if (mConf.cursor.size() == 0U)
+    {
+        return;
+    }
+
+    ProfileCursor::Find(mConf.cursor, meter.meterId, obj.name, cursor);
+    if (mDumped && (obj.from_entry > 0U))
+    {
+        // Rows appended while reading are counted as well
+        cursor.entries = obj.from_entry - 1U + mDumpRows;
+    }
+    else if (mIncremental.counted)
+    {
+        cursor.entries = mIncremental.entriesInUse;
+    }
+    if (mDumpHasClock)
+    {
+        cursor.clock = FormatDate(mDumpClock);
+    }
+    ProfileCursor::Store(mConf.cursor, meter.meterId, obj.name, cursor);
+}
+
+// Number of the next objects that can be read with one GET-Request-With-List
+uint32_t CosemClient::ListBatchSize() const
+{
+    // Request: GET tag, choice, invoke ID, count (up to 3 bytes), 10 bytes per attribute descriptor
+    static const uint32_t cHeaderSize = 6U;
+    static const uint32_t cItemSize = 10U;
+    // Response: a clock, an identifier or a register value with its result; a bigger list
+    // response would come by blocks, and the list service would be given up
+    static const uint32_t cResponseItemSize = 32U;
+
+    uint32_t maxPdu = (mXdlms.maxPdu > 0U) ? mXdlms.maxPdu : 0xFFFFU;
+    uint32_t count = 0U;
+
+    while (mListAllowed &&
+           ((mReadIndex + count) < mConf.list.size()) &&
+           (count < mConf.get_list_max) &&
+           ((cHeaderSize + ((count + 1U) * cItemSize)) <= maxPdu) &&
+           ((cHeaderSize + ((count + 1U) * cResponseItemSize)) <= mClientMaxPdu))
+    {
+        const Object &obj = mConf.list[mReadIndex + count];
+
+        // Profile buffers are big and may use selective access: single GET, by blocks
+        if ((obj.class_id == 7U) && (obj.attribute_id == 2))
+        {
+            break;
+        }
+        // An object being retried after a temporary failure is read alone
+        if (((mReadIndex + count) == mRetryIndex) && (mObjectRetries > 0U))
+        {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+// Reads the next 'count' objects with one request. Returns 1 when all the results are
+// stored, 0 when the objects must be read one by one, -1 on failure. In continue-on-failure
+// mode, the results stop at the first temporary failure: 'count' is then the number of
+// results stored, the last one is that failure
+int CosemClient::ReadList(Meter &meter, uint32_t &count)
+{
+    std::vector<Xdlms::AttributeDescriptor> descriptors;
+
+    for (uint32_t k = 0U; k < count; k++)
+    {
+        const Object &obj = mConf.list[mReadIndex + k];
+        std::vector<std::string> obis = Util::Split(obj.ln, ".");
+        Xdlms::AttributeDescriptor descriptor;
+
+        if (obis.size() != 6)
+        {
+            // The single GET reports the error
+            return 0;
+        }
+        descriptor.classId = obj.class_id;
+        for (uint32_t i = 0U; i < 6U; i++)
+        {
+            descriptor.obis[i] = static_cast<uint8_t>(strtol(obis[i].c_str(), NULL, 10));
+        }
+        descriptor.attribute = obj.attribute_id;
+        descriptors.push_back(descriptor);
+    }
+
+    // Bounded by the server max PDU size, see ListBatchSize()
+    std::vector<uint8_t> apdu(mScratch.size());
+    uint8_t invokeId = NextInvokeId();
+    uint32_t size = Xdlms::EncodeGetWithList(&apdu[0], static_cast<uint32_t>(apdu.size()), invokeId, descriptors);
+    csm_array scratch_array;
+    csm_array_init(&scratch_array, &mScratch[0], static_cast<uint32_t>(mScratch.size()), 0, 3);
+
+    if ((size == 0U) || !csm_array_write_buff(&scratch_array, &apdu[0], size))
+    {
+        return 0;
+    }
+
+    LOG(LOG_INFO, "** Sending request for " << count << " objects, from: " << mConf.list[mReadIndex].name);
+    std::string request_data = EncapsulateRequest(meter, &scratch_array);
+
+    csm_array rx;
+    csm_array_init(&rx, &mAppBuffer[0], static_cast<uint32_t>(mAppBuffer.size()), 0, 0);
+
+    bool exchanged = DataExchange(meter, request_data, rx, mConf.timeout_request, true, false);
+    uint32_t llc = (meter.transport == HDLC) ? cLlcSize : 0U;
+    uint8_t responseId;
+    while (exchanged &&
+           Xdlms::GetResponseInvokeId(&rx.buff[llc], (csm_array_written(&rx) > llc) ? (csm_array_written(&rx) - llc) : 0U, responseId) &&
+           ((responseId & 0x0FU) != (invokeId & 0x0FU)))
+    {
+        LOG(LOG_TRACE, "** Response to another request discarded, invoke-id: " << static_cast<uint32_t>(responseId));
+        csm_array_init(&rx, &mAppBuffer[0], static_cast<uint32_t>(mAppBuffer.size()), 0, 0);
+        exchanged = DataExchange(meter, std::string(), rx, mConf.timeout_request, false, false);
+    }
+
+    if (!exchanged)
+    {
+        Result result;
+        result.subject = mConf.list[mReadIndex].name;
+        result.SetError("** Cannot send/receive GET-Request-With-List");
+        result.transient = true;
+        result.unanswered = true;
+        result.released = mDisconnected;
+        mResults.push_back(result);
+        return -1;
+    }
 
-                                result.SetError(ss.str());
-                            }
-                            else
-                            {
-                                result.SetError("** Error, service not found! ");
-                            }
-                            loop = false;
-                        }
-                    }
-                    else
-                    {
-                        result.SetError("** Cannot decode Cosem response");
-                        loop = false;
-                    }
-                }
-                else
-                {
-                    result.SetError("** Not a compliant HDLC LLC");
-                    loop = false;
-                }
+    Log::Hex(LOG_TRACE, "APDU: ", rx.buff, csm_array_written(&rx));
+
+    std::vector<Xdlms::ListItem> items;
+    std::vector<uint8_t> blocks; // Raw data of a response sent in data blocks, the items point into it
+    bool listed = false;
+
+    if ((meter.transport != HDLC) || HasGoodLlc(&rx))
+    {
+        listed = Xdlms::DecodeGetWithList(csm_array_rd_data(&rx), csm_array_unread(&rx), items);
+
+        csm_response response;
+        if (!listed && csm_client_decode(&response, &rx) &&
+            (response.service == SVC_GET) && (response.type == SVC_RESPONSE_WITH_DATABLOCK))
+        {
+            int ret = ReadListBlocks(meter, response, rx, blocks);
+            if (ret < 0)
+            {
+                Result result;
+                result.subject = mConf.list[mReadIndex].name;
+                result.SetError("** Cannot get the data blocks of GET-Request-With-List");
+                result.transient = true;
+                result.unanswered = true;
+                mResults.push_back(result);
+                return -1;
             }
-            else
+            listed = (ret > 0) && (blocks.size() > 0U) &&
+                     Xdlms::DecodeDataResults(&blocks[0], static_cast<uint32_t>(blocks.size()), items);
+        }
+    }
+
+    if ((!listed || (items.size() != count)) && mReused)
+    {
+        // The lists were accepted when the association was kept: the server has released it
+        Result result;
+        result.subject = mConf.list[mReadIndex].name;
+        result.SetError("** No list in the response on the reused association");
+        result.released = true;
+        mResults.push_back(result);
+        return -1;
+    }
+
+    if (!listed || (items.size() != count))
+    {
+        // Exception or unsupported service
+        LOG(LOG_INFO, "** No list in the response, reading the objects one by one");
+        mListAllowed = false;
+        return 0;
+    }
+
+    int ret = 1;
+    for (uint32_t k = 0U; k < count; k++)
+    {
+        const Object &obj = mConf.list[mReadIndex + k];
+        Result result;
+        result.subject = obj.name;
+
+        if (items[k].result == CSM_ACCESS_RESULT_SUCCESS)
+        {
+            LOG(LOG_INFO, "Object: " << obj.name << " access success!");
+            if (obj.dump)
             {
-                retries++;
-                if (retries > mConf.retries)
-                {
-                    result.SetError("** Cannot get HDLC data");
-                    loop = false;
-                }
+                csm_array data;
+                csm_array_init(&data, const_cast<uint8_t *>(items[k].data), items[k].size, items[k].size, 0);
+                DumpObject(meter, obj, data);
             }
         }
-        while(loop);
+        else
+        {
+            result.SetError(ResultToString(static_cast<csm_data_access_result>(items[k].result)));
+            result.transient = (items[k].result == CSM_ACCESS_RESULT_TEMPORARY_FAILURE);
+            ret = -1;
+        }
+        mResults.push_back(result);
 
-        if (dump && obj.dump)
+        if (result.transient && mConf.failure.keepOn)
         {
-            std::string infos = "Object=\"" + obj.name + "\"";
-            gPrinter.Start(infos);
-            csm_axdr_decode_tags(&app_array, AxdrData);
-            gPrinter.End();
+            // Read again alone, under the retry budget of the object
+            count = k + 1U;
+            break;
+        }
+    }
+
+    return ret;
+}
 
-            std::string xml_data = gPrinter.Get();
-            std::cout << xml_data << std::endl;
+// A list response larger than one APDU comes in data blocks, requested one by one with
+// GET-Request-Next: their raw data put end to end is the list of results. 'response' and
+// 'rx' hold the first block. Returns 1 when all the blocks are there, 0 when the server
+// answered with something else, -1 when a block was not received
+int CosemClient::ReadListBlocks(Meter &meter, csm_response &response, csm_array &rx, std::vector<uint8_t> &data)
+{
+    uint32_t lastBlock = 0U;
+    uint32_t size = 0U;
+    uint8_t invokeId = static_cast<uint8_t>(response.invoke_id);
+    int ret = 1;
 
-            std::string dirName = meter.meterId;
-            std::string fileName = dirName + Util::DIR_SEPARATOR + obj.name + ".xml";
+    PrepareNextRequest(meter, invokeId);
 
-            std::cout << "Dumping into file: " << fileName << std::endl;
+    while (ret > 0)
+    {
+        if ((response.access_result != CSM_ACCESS_RESULT_SUCCESS) || !csm_axdr_decode_block(&rx, &size))
+        {
+            LOG(LOG_ERROR, "** ERROR: must be a block of data");
+            ret = 0;
+            break;
+        }
 
-            std::fstream f;
+        const uint8_t *block = csm_array_rd_data(&rx);
+        data.insert(data.end(), block, block + csm_array_unread(&rx));
+        lastBlock = response.block_number;
+        LOG(LOG_TRACE, "** List block " << lastBlock << " of size: " << size);
 
-            Util::Mkdir(dirName);
-            f.open(fileName, std::ios_base::out | std::ios_base::binary);
+        if (!csm_client_has_more_data(&response))
+        {
+            break;
+        }
 
-            if (f.is_open())
+        std::string request = NextBlockRequest(meter, lastBlock);
+        bool waitOnly = false;
+        bool next = false;
+        do
+        {
+            csm_array_init(&rx, &mAppBuffer[0], static_cast<uint32_t>(mAppBuffer.size()), 0, 0);
+            if (!DataExchange(meter, waitOnly ? std::string() : request, rx, mConf.timeout_request, true, false))
+            {
+                ret = -1;
+            }
+            else if (((meter.transport == HDLC) && !HasGoodLlc(&rx)) ||
+                     !csm_client_decode(&response, &rx) ||
+                     (response.service != SVC_GET) || (response.type != SVC_RESPONSE_WITH_DATABLOCK))
+            {
+                ret = 0;
+            }
+            else if ((response.block_number <= lastBlock) || ((response.invoke_id & 0x0FU) != (invokeId & 0x0FU)))
             {
-                f << xml_data << std::endl;
-                f.close();
+                // Late answer to a repeated UDP request
+                LOG(LOG_TRACE, "** Duplicate block " << response.block_number << " discarded");
+                waitOnly = true;
             }
             else
             {
-                std::cout << "Cannot open file!" << std::endl;
+                next = true;
             }
-           // print_hex((const char *)&mAppBuffer[0], csm_array_written(&app_array));
         }
+        while ((ret > 0) && !next);
     }
 
-    return result;
+    return ret;
 }
 
 bool  CosemClient::PerformCosemRead(Meter &meter)
 {
-    bool ret = false;
+    // Each state stops the chart on failure; a restored association starts in ASSOCIATED
+    bool ret = true;
     uint32_t retries = 0U;
 
     do
@@ -1137,49 +2786,95 @@ bool  CosemClient::PerformCosemRead(Meter &meter)
             {
                 Result result;
                 result.subject = "CONNECT HDLC";
-                printf("** Sending HDLC SNRM (addr: %d)...\r\n", meter.hdlc.phy_address);
-                if (ConnectHdlc(meter) > 0)
+
+                if (meter.transport != HDLC)
                 {
-                   printf("** HDLC success!\r\n");
-                   ret = true;
-                   mCosemState = ASSOCIATION_PENDING;
+                    // No data link layer connection on wrapper transports
+                    ret = true;
+                    mCosemState = ASSOCIATION_PENDING;
                 }
                 else
                 {
-                    retries++;
-                    if (retries > mConf.retries)
+                    bool signedOn = true;
+                    if (mSerialParams.modeE)
                     {
-                        retries = 0;
-                        if (meter.testHdlcAddr)
-                        {
-                            // Keep this state, no error, scan next HDLC address
-                            meter.hdlc.phy_address++;
-                            ret = true;
-                        }
-                        else
+                        std::string identification;
+                        LOG(LOG_INFO, "** Sending mode E sign-on...");
+                        signedOn = mTransport->SignOnModeE(identification);
+                    }
+
+                    if (signedOn && meter.testHdlcAddr)
+                    {
+                        // Once per session, unless the cached address is wrong
+                        meter.testHdlcAddr = false;
+                        if (!DiscoverHdlcAddress(meter))
                         {
-                            result.SetError("** Cannot connect to meter.");
-                            mResults.push_back(result);
-                            ret = false;
+                            signedOn = false;
+                            retries = mConf.retries;
                         }
                     }
+
+                    if (signedOn)
+                    {
+                        LOG(LOG_INFO, "** Sending HDLC SNRM (addr: " << meter.hdlc.phy_address << ")...");
+                    }
+
+                    if (signedOn && (ConnectHdlc(meter) > 0))
+                    {
+                       LOG(LOG_INFO, "** HDLC success!");
+                       ret = true;
+                       mCosemState = ASSOCIATION_PENDING;
+                    }
                     else
                     {
-                        ret = true;
+                        retries++;
+                        if (retries > mConf.retries)
+                        {
+                            retries = 0;
+                            if (meter.hdlcAddrCached)
+                            {
+                                // Meter replaced or moved: forget the cached address and scan again
+                                LOG(LOG_INFO, "** Cached HDLC address not answering, scanning again");
+                                AddressCache::Remove(mConf.discovery.cache, meter.meterId);
+                                meter.hdlcAddrCached = false;
+                                meter.testHdlcAddr = true;
+                                ret = true;
+                            }
+                            else
+                            {
+                                result.SetError("** Cannot connect to meter.");
+                                mResults.push_back(result);
+                                ret = false;
+                            }
+                        }
+                        else
+                        {
+                            ret = true;
+                        }
                     }
                 }
             }
              break;
             case ASSOCIATION_PENDING:
             {
-                printf("** Sending AARQ...\r\n");
+                if (meter.cosem.pre_established)
+                {
+                    UsePreEstablished(meter);
+                    ret = true;
+                    mReadIndex = 0U;
+                    mCosemState = ASSOCIATED;
+                    break;
+                }
+
+                LOG(LOG_INFO, "** Sending AARQ...");
                 Result result = ConnectAarq(meter);
                 if (result.success)
                 {
-                   printf("** AARQ success!\r\n");
+                   LOG(LOG_INFO, "** AARQ success!");
                    ret = true;
                    mReadIndex = 0U;
                    mCosemState = ASSOCIATED;
+                   mNewAssociations++;
                 }
                 else
                 {
@@ -1190,29 +2885,137 @@ bool  CosemClient::PerformCosemRead(Meter &meter)
             }
             case ASSOCIATED:
             {
-                if (mReadIndex < mConf.list.size())
+                uint32_t count = ListBatchSize();
+                int listed = (count > 1U) ? ReadList(meter, count) : 0;
+
+                if ((listed < 0) && mReused)
+                {
+                    // The kept association is not trusted any more, whatever the failure
+                    mAssociations.erase(meter.meterId);
+                }
+
+                if (listed > 0)
+                {
+                    mReadIndex += count;
+                    mReused = false;
+                }
+                else if ((listed < 0) && mReused && (mResults.back().unanswered || mResults.back().released))
+                {
+                    // Only the failure of the exchange has been recorded
+                    mResults.pop_back();
+                    ReleasedAssociation();
+                    ret = true;
+                }
+                else if ((listed < 0) && mConf.failure.keepOn && mResults.back().transient && !mResults.back().unanswered)
+                {
+                    // Temporary failure of the last item: the objects before it are done
+                    mReadIndex += count - 1U;
+                    mReused = false;
+
+                    FailureAction action = OnObjectFailure(mResults.back());
+                    if (action == RETRY_OBJECT)
+                    {
+                        // Read alone by the next single GET, see ListBatchSize()
+                        mResults.pop_back();
+                    }
+                    else if (action == NEXT_OBJECT)
+                    {
+                        mReadIndex++;
+                    }
+                    else
+                    {
+                        ret = false;
+                    }
+                }
+                else if ((listed < 0) && mConf.failure.keepOn && mResults.back().transient)
+                {
+                    // No list response: read the objects one by one, each with its own retries
+                    if (OnObjectFailure(mResults.back()) != STOP_READ)
+                    {
+                        mResults.pop_back();
+                        mListAllowed = false;
+                    }
+                    else
+                    {
+                        ret = false;
+                    }
+                }
+                else if ((listed < 0) && mConf.failure.keepOn)
+                {
+                    // Failed items are recorded, go on with the next objects
+                    mReadIndex += count;
+                    mReused = false;
+                }
+                else if (listed < 0)
+                {
+                    // stop at first failure
+                    ret = false;
+                }
+                else if ((mReadIndex < mConf.list.size()) &&
+                         mConf.list[mReadIndex].since_last_read &&
+                         !PrepareIncrementalRead(meter, mConf.list[mReadIndex], mIncremental))
+                {
+                    Result result;
+                    result.subject = mConf.list[mReadIndex].name;
+                    LOG(LOG_INFO, "Object: " << result.subject << " has no new entry");
+                    mResults.push_back(result);
+                    mReadIndex++;
+                }
+                else if (mReadIndex < mConf.list.size())
                 {
                     Object obj = mConf.list[mReadIndex];
+                    if (obj.since_last_read)
+                    {
+                        obj = mIncremental.object;
+                    }
 
                     csm_request request;
                     csm_response response;
                     request.db_request.service = SVC_GET;
                     request.type = SVC_REQUEST_NORMAL;
-                    request.sender_invoke_id = 0xC1U;
+                    request.sender_invoke_id = NextInvokeId();
 
                     csm_array app_array;
-                    csm_array_init(&app_array, &mAppBuffer[0], cAppBufferSize, 0, 0);
+                    csm_array_init(&app_array, &mAppBuffer[0], static_cast<uint32_t>(mAppBuffer.size()), 0, 0);
 
                     Result result = AccessObject(meter, obj, request, response, app_array);
 
-                    mResults.push_back(result);
+                    if (!result.success && mReused)
+                    {
+                        // The kept association is not trusted any more, whatever the failure
+                        mAssociations.erase(meter.meterId);
+
+                        // Only an error answered by an associated server is a real one
+                        if (result.unanswered || result.released)
+                        {
+                            ReleasedAssociation();
+                            ret = true;
+                            break;
+                        }
+                    }
+                    mReused = false;
+
+                    FailureAction action = result.success ? NEXT_OBJECT : OnObjectFailure(result);
+                    if (action != RETRY_OBJECT)
+                    {
+                        mResults.push_back(result);
+                    }
 
                     if (result.success)
                     {
-                        std::cout << "Object: " << result.subject << " access success!" << std::endl;
+                        LOG(LOG_INFO, "Object: " << result.subject << " access success!");
+                        if (obj.since_last_read)
+                        {
+                            StoreCursor(meter, obj);
+                        }
                         mReadIndex++;
                     }
-                    else
+                    else if (action == NEXT_OBJECT)
+                    {
+                        LOG(LOG_INFO, "Object: " << result.subject << " failed, going on with the next one");
+                        mReadIndex++;
+                    }
+                    else if (action == STOP_READ)
                     {
                         // stop at first failure
                         ret = false;
@@ -1220,7 +3023,7 @@ bool  CosemClient::PerformCosemRead(Meter &meter)
                 }
                 else
                 {
-                    std::cout << "** No more data to read for that meter." << std::endl;
+                    LOG(LOG_INFO, "** No more data to read for that meter.");
                     ret = false;
                 }
                 break;
@@ -1244,13 +3047,13 @@ std::string now( const char* format = "%c" )
     return cstr ;
 }
 
-void CosemClient::PrintResult()
+void CosemClient::PrintResult(const std::vector<Result> &results)
 {
     std::string dirName = "result";
     std::string dateTime = now("_%Y%m%d_%H%M%S.xml");
     std::string fileName = dirName + Util::DIR_SEPARATOR + "result" + dateTime;
 
-    std::cout << "=============================   RESULT  ============================= " << std::endl;
+    LOG(LOG_INFO, "=============================   RESULT  ============================= ");
 
     std::fstream f;
 
@@ -1259,17 +3062,17 @@ void CosemClient::PrintResult()
 
     if (f.is_open())
     {
-        if (mResults.size() > 0U)
+        if (results.size() > 0U)
         {
             f << "<Result status=\"failure\">" << std::endl;
-            std::cout << "One or more problem was found." << std::endl;
-            for (uint32_t i = 0; i < mResults.size(); i++)
+            LOG(LOG_INFO, "One or more problem was found.");
+            for (uint32_t i = 0; i < results.size(); i++)
             {
-               if (!mResults[i].success)
+               if (!results[i].success)
                {
                    std::stringstream ss;
-                   ss << "Task: " << mResults[i].subject << " access failure: " << mResults[i].diagnostic << std::endl;
-                   std::cout << ss.str() << std::endl;
+                   ss << "Task: " << results[i].subject << " access failure: " << results[i].diagnostic << std::endl;
+                   LOG(LOG_ERROR, ss.str());
                    f << "    <Diagnostic>" << ss.str() << "</Diagnostic>" << std::endl;
                }
             }
@@ -1281,14 +3084,185 @@ void CosemClient::PrintResult()
             f << "<Result status=\"success\" />" << std::endl;
         }
 
-        std::cout << "Result file generated: " << fileName << std::endl;
+        LOG(LOG_INFO, "Result file generated: " << fileName);
         f.close();
     }
     else
     {
-       std::cout << "Cannot create result file!" << std::endl;
+       LOG(LOG_ERROR, "Cannot create result file!");
+    }
+
+}
+
+// One meter session, from the link opening to the last object of the list
+void CosemClient::ReadMeter(Meter meter)
+{
+    gCurrentClient = this;
+    // Meters of the worker pool are not in the configuration of the client
+    mLls = meter.cosem.auth_password;
+
+    LOG(LOG_INFO, "** Meter ID: " << meter.meterId);
+    LOG(LOG_INFO, "** Using Client: " << meter.cosem.client);
+
+    if (meter.transport == HDLC)
+    {
+        meter.hdlc.sender = HDLC_CLIENT;
+        meter.hdlc.logical_device = meter.cosem.logical_device;
+        meter.hdlc.client_addr = meter.cosem.client;
+        LOG(LOG_INFO, "** Using HDLC address: " << meter.hdlc.phy_address);
+    }
+    else
+    {
+        LOG(LOG_INFO, "** Using wrapper address: " << meter.wrapper.address << ":" << meter.wrapper.port);
+    }
+
+    if (meter.meterId.size() > 0U)
+    {
+        // Each meter starts its own session, unless its association is still open
+        uint32_t created = mNewAssociations;
+
+        mCosemState = CONNECT_HDLC;
+        mReadIndex = 0U;
+        mRetryIndex = 0U;
+        mObjectRetries = 0U;
+        mSessionRetries = 0U;
+        mReused = RestoreAssociation(meter);
+        bool reused = mReused;
+        if (OpenLink(meter))
+        {
+            PerformCosemRead(meter);
+        }
+        if (reused && (mNewAssociations == created))
+        {
+            mReusedAssociations++;
+        }
+        KeepAssociation(meter);
+    }
+    else
+    {
+        LOG(LOG_INFO, "** Please specify a valid meter ID");
+    }
+}
+
+void CosemClient::CloseLink()
+{
+    mTransport->Close();
+    // The associations do not survive the link
+    mAssociations.clear();
+}
+
+void CosemClient::StartCycle()
+{
+    mMeterIndex = 0U;
+    mResults.clear();
+}
+
+void CosemClient::GetAssociationStats(uint32_t &reused, uint32_t &created) const
+{
+    reused = mReusedAssociations;
+    created = mNewAssociations;
+}
+
+// Long-running mode: the HDLC connection and the association of the meter are still open
+// if the server has not released them since the previous cycle
+bool CosemClient::RestoreAssociation(Meter &meter)
+{
+    std::map<std::string, Association>::iterator iter = mAssociations.find(meter.meterId);
+
+    if (iter == mAssociations.end())
+    {
+        return false;
+    }
+
+    uint32_t idle = ElapsedMs(iter->second.lastActivity);
+    if ((mConf.polling.inactivity > 0U) && (idle >= mConf.polling.inactivity))
+    {
+        LOG(LOG_INFO, "** Association idle for " << idle << " ms, released by the meter");
+        mAssociations.erase(iter);
+        return false;
+    }
+
+    LOG(LOG_INFO, "** Reusing the association, idle for " << idle << " ms");
+    meter = iter->second.meter;
+    mAssoState = iter->second.state;
+    mXdlms = iter->second.xdlms;
+    mListAllowed = iter->second.listAllowed;
+    SizeBuffers(iter->second.clientMaxPdu);
+    mReadIndex = 0U;
+    mCosemState = ASSOCIATED;
+    return true;
+}
+
+void CosemClient::KeepAssociation(const Meter &meter)
+{
+    if ((mConf.polling.period > 0U) && (meter.transport == HDLC) && (mCosemState == ASSOCIATED))
+    {
+        Association &association = mAssociations[meter.meterId];
+        association.meter = meter;
+        association.state = mAssoState;
+        association.xdlms = mXdlms;
+        association.clientMaxPdu = mClientMaxPdu;
+        association.listAllowed = mListAllowed;
+        association.lastActivity = std::chrono::steady_clock::now();
+    }
+    else
+    {
+        mAssociations.erase(meter.meterId);
+    }
+}
+
+// Continue-on-failure mode: a transient failure is tried again while the object and session
+// budgets last, any other failure is recorded and the next object is read. The read stops
+// when the link is lost, or when the meter still does not answer once the budget is spent
+CosemClient::FailureAction CosemClient::OnObjectFailure(const Result &result)
+{
+    FailureAction action = NEXT_OBJECT;
+
+    if (mRetryIndex != mReadIndex)
+    {
+        mRetryIndex = mReadIndex;
+        mObjectRetries = 0U;
+    }
+
+    if (!mConf.failure.keepOn)
+    {
+        action = STOP_READ;
+    }
+    else if (!mTransport->IsOpen())
+    {
+        LOG(LOG_ERROR, "** Link lost, stopping the session");
+        action = STOP_READ;
+    }
+    else if (result.transient && (mSessionRetries >= mConf.failure.sessionRetries))
+    {
+        LOG(LOG_ERROR, "** Retry budget of the session spent, stopping the session");
+        action = STOP_READ;
+    }
+    else if (result.transient && (mObjectRetries < mConf.failure.objectRetries))
+    {
+        mObjectRetries++;
+        mSessionRetries++;
+        LOG(LOG_INFO, "** " << result.subject << ": " << result.diagnostic << ", trying again ("
+            << mObjectRetries << "/" << mConf.failure.objectRetries << ")");
+        action = RETRY_OBJECT;
     }
 
+    if ((action == STOP_READ) && mConf.failure.keepOn)
+    {
+        // The association is not kept for the next polling cycle
+        mCosemState = CONNECT_HDLC;
+    }
+    return action;
+}
+
+// The first request on a reused association got no answer, a DM/FRMR, no LLC or an exception:
+// the server has released it (inactivity time-out, power cycle...). Connect again and read from
+// the first object
+void CosemClient::ReleasedAssociation()
+{
+    LOG(LOG_INFO, "** Reused association released by the meter, connecting again");
+    mReused = false;
+    mCosemState = CONNECT_HDLC;
 }
 
 // Global state chart
@@ -1296,6 +3270,8 @@ bool CosemClient::PerformTask()
 {
     bool ret = false;
 
+    gCurrentClient = this;
+
     switch (mModemState)
     {
         case DISCONNECTED:
@@ -1304,9 +3280,9 @@ bool CosemClient::PerformTask()
             Result result;
             result.subject = "MODEM TEST";
 
-            if (SendModem(mConf.modem.init + "\r\n", "OK", modemReply, 2U) > 0)
+            if (SendModem(mConf.modem.init + "\r\n", "OK", modemReply, 2000U) > 0)
             {
-                std::cout << "** Modem test success!" << std::endl;
+                LOG(LOG_INFO, "** Modem test success!");
 
                 mModemState = DIAL;
                 ret = true;
@@ -1325,12 +3301,12 @@ bool CosemClient::PerformTask()
             Result result;
             result.subject = "MODEM DIAL";
 
-            std::cout << "** Dial: " << mConf.modem.phone << std::endl;
+            LOG(LOG_INFO, "** Dial: " << mConf.modem.phone);
             std::string dialRequest = std::string("ATD") + mConf.modem.phone + std::string("\r\n");
             std::string modemReply;
             if (SendModem(dialRequest, "CONNECT", modemReply, mConf.timeout_dial))
             {
-               std::cout << "** Modem dial success!" << std::endl;
+               LOG(LOG_INFO, "** Modem dial success!");
                ret = true;
                mModemState = CONNECTED;
             }
@@ -1356,32 +3332,13 @@ bool CosemClient::PerformTask()
         {
             if (mMeterIndex < mConf.meters.size())
             {
-                Meter meter = mConf.meters[mMeterIndex];
-
-                std::cout << "** Meter ID: " << meter.meterId << std::endl;
-                std::cout << "** Using Client: " << meter.cosem.client << std::endl;
-
-                if (meter.transport == HDLC)
-                {
-                    meter.hdlc.sender = HDLC_CLIENT;
-                    meter.hdlc.logical_device = meter.cosem.logical_device;
-                    meter.hdlc.client_addr = meter.cosem.client;
-                    std::cout << "** Using HDLC address: " << meter.hdlc.phy_address << std::endl;
-                }
-
-                if (meter.meterId.size() > 0U)
-                {
-                    ret = PerformCosemRead(meter);
-                }
-                else
-                {
-                    std::cout << "** Please specify a valid meter ID" << std::endl;
-                }
+                ReadMeter(mConf.meters[mMeterIndex]);
                 mMeterIndex++;
+                ret = true; // continue with the next meter, if any
             }
             else
             {
-                std::cout << "** No more meter to read, exiting." << std::endl;
+                LOG(LOG_INFO, "** No more meter to read, exiting.");
                 ret = false;
             }
 
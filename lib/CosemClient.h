@@ -25,11 +25,19 @@
 #include <condition_variable>
 #include <chrono>
 #include <list>
+#include <map>
+#include <vector>
+#include <fstream>
+#include <ctime>
 
 #include "csm_services.h"
 #include "hdlc.h"
 #include "Configuration.h"
 #include "Transport.h"
+#include "TransportReactor.h"
+#include "Xdlms.h"
+#include "AxdrStream.h"
+#include "Checkpoint.h"
 
 
 struct Compare
@@ -42,6 +50,9 @@ struct Result
 {
     Result()
         : success(true)
+        , transient(false)
+        , unanswered(false)
+        , released(false)
     {
 
     }
@@ -53,6 +64,9 @@ struct Result
     }
 
     bool success;
+    bool transient; // A new try may succeed: temporary failure or no response
+    bool unanswered; // The exchange itself failed: no response from the server
+    bool released; // The answer is not from an associated server: DM/FRMR, no LLC, exception
     std::string subject;
     std::string diagnostic;
 };
@@ -62,56 +76,169 @@ class CosemClient
 {
 public:
     CosemClient();
+    ~CosemClient();
 
-    bool Initialize(const std::string &commFile, const std::string &objectsFile, const std::string &meterFile);
+    bool Initialize(const Configuration &conf, const SerialPort &port);
 
-    void SetStartDate(const std::string &date);
-    void SetEndDate(const std::string &date);
+    // Optional: use a shared reactor instead of a reader thread for this session
+    void SetReactor(TransportReactor *reactor);
 
     void WaitForStop();
 
+    // Session running in the calling thread
+    static CosemClient *Current();
+
     bool SendModem(const std::string &command, const std::string &expected, std::string &modemReply, uint32_t timeout);
 
     bool PerformTask();
 
+    // Single meter session, for the worker pool (no modem)
+    void ReadMeter(Meter meter);
+    void CloseLink();
+    // Long-running mode: the meters are read again, the open associations are kept
+    void StartCycle();
+    void GetAssociationStats(uint32_t &reused, uint32_t &created) const;
+
     std::string ResultToString(csm_data_access_result result);
 
-    void PrintResult();
+    const std::vector<Result> &GetResults() const { return mResults; }
+    static void PrintResult(const std::vector<Result> &results);
     std::string GetLls();
 
 private:
     ModemState mModemState;
     CosemState mCosemState;
 
-    static const uint32_t cBufferSize = 40U*1024U;
-    char mSndBuffer[cBufferSize];
-    char mRcvBuffer[cBufferSize];
-    csm_array mRcvArray;
-
-    uint8_t mScratch[cBufferSize];
+    // Sized from the client max receive PDU size: one APDU with its LLC, HDLC or wrapper
+    // header, and the header overlap of the next block
+    static const uint32_t cFrameOverhead = 64U;
+    static const uint16_t cDefaultMaxPdu = 0xFFFFU;
+    uint16_t mClientMaxPdu; // Proposed in the AARQ, the server does not send bigger APDUs
+    std::vector<char> mSndBuffer;
+    std::vector<uint8_t> mScratch;
 
+    // Whole object, or one APDU only when the data blocks are streamed
     static const uint32_t cAppBufferSize = 2000U*1024U;
-    uint8_t mAppBuffer[cAppBufferSize];
+    std::vector<uint8_t> mAppBuffer;
+
+    // Streamed object being dumped
+    AxdrStream mStream;
+    std::fstream mStreamFile;
+    std::string mStreamFileName;
+    Checkpoint mCheckpoint; // Of the interrupted read being resumed
+    uint32_t mStreamRows;   // Rows of this read in the last checkpoint
+
+    // Rows of the last object dumped
+    bool mDumped;
+    uint32_t mDumpRows;
+    bool mDumpHasClock;
+    std::tm mDumpClock;
+
+    // "Since last read" profile being read
+    struct Incremental
+    {
+        Object object; // With the selective access of the new rows
+        bool counted;  // entriesInUse has been read
+        uint32_t entriesInUse;
+    };
+    Incremental mIncremental;
+
+    // Associations kept open between the polling cycles, by meter ID
+    struct Association
+    {
+        Meter meter; // With the HDLC sequence numbers
+        csm_asso_state state;
+        Xdlms::Context xdlms;
+        uint16_t clientMaxPdu;
+        bool listAllowed;
+        std::chrono::steady_clock::time_point lastActivity;
+    };
+    std::map<std::string, Association> mAssociations;
+    bool mReused; // Restored association, until its first successful request
+    bool mDisconnected; // The last HDLC exchange ended on a DM or FRMR frame
+    uint32_t mReusedAssociations;
+    uint32_t mNewAssociations;
+
+    // Continue-on-failure mode, see Configuration::failure
+    enum FailureAction
+    {
+        STOP_READ,
+        RETRY_OBJECT,
+        NEXT_OBJECT
+    };
+    uint32_t mRetryIndex;     // Object of mObjectRetries
+    uint32_t mObjectRetries;
+    uint32_t mSessionRetries; // Of the meter being read
+
+    // GET-Request-Next of the current block transfer, with room for the LLC: encoded once,
+    // only the block number changes
+    static const uint32_t cLlcSize = 3U;
+    uint8_t mNextApdu[cLlcSize + Xdlms::cGetNextSize];
+    // Invoke-id of the last GET request: rotated so that a late response is not taken for the next one
+    uint8_t mInvokeId;
+    std::string mNextRequest; // Whole frame on the wrapper transports
+
+    // Maximum size of an APDU header received over the end of the previous block
+    static const uint32_t cMaxHeaderOverlap = 32U;
 
     static const uint32_t cSelectiveAccessBufferSize = 256U;
     uint8_t mSelectiveAccessBuff[cSelectiveAccessBufferSize];
 
     std::uint32_t mReadIndex;
     uint32_t mMeterIndex;
+    std::string mLls; // Password of the meter being read
     Configuration mConf;
-    Transport mTransport;
+    Transport *mTransport; // Real link or capture replay
+    Transport::Params mSerialParams;
+    TransportReactor *mReactor;
     csm_asso_state mAssoState;
+    Xdlms::Context mXdlms; // Negotiated in the AARE
+    bool mListAllowed;
 
     std::vector<Result> mResults;
 
     std::string AuthResultToString(enum csm_asso_result result);
     Result Pass3And4(Meter &meter);
     int ConnectHdlc(Meter &meter);
-    bool HdlcProcess(Meter &meter, const std::string &send, std::string &rcv, int timeout, bool enableRetries);
+    bool SendHdlcCommand(const HdlcFrame::Address &server, const HdlcFrame::Address &client, uint8_t command, uint8_t &control, uint16_t &physical);
+    bool ProbeHdlcAddress(Meter &meter, uint16_t physical, uint16_t &found);
+    bool DiscoverHdlcAddress(Meter &meter);
+    uint32_t WaitTime(const Meter &meter, bool canRetry, const std::chrono::steady_clock::time_point &deadline,
+                      bool started, const std::chrono::steady_clock::time_point &frameDeadline);
+    uint8_t NextInvokeId();
+    bool SendHdlc(Meter &meter, const std::string &data, std::string &echo);
+    bool SendSegments(Meter &meter, const HdlcFrame::Frame &frame, std::string &echo);
+    bool WaitHdlcRr(Meter &meter, const HdlcFrame::Address &client, uint8_t &nr);
+    bool SendRequest(Meter &meter, const std::string &request);
+    bool HdlcProcess(Meter &meter, const std::string &send, csm_array &rcv, uint32_t timeout, bool enableRetries, bool sent);
+    bool WrapperProcess(Meter &meter, const std::string &send, csm_array &rcv, uint32_t timeout, bool sent);
+    bool DataExchange(Meter &meter, const std::string &send, csm_array &rcv, uint32_t timeout, bool enableRetries, bool sent);
+    void PrepareNextRequest(Meter &meter, uint8_t invokeId);
+    std::string NextBlockRequest(Meter &meter, uint32_t block);
+    bool GeneralBlocksAllowed(const Meter &meter) const;
+    std::string GeneralBlockAck(Meter &meter, uint16_t number, uint16_t ack);
+    bool GeneralBlockExchange(Meter &meter, const std::string &send, csm_array &rcv, bool sent);
+    bool OpenLink(Meter &meter);
     std::string EncapsulateRequest(Meter &meter, csm_array *request);
     bool PerformCosemRead(Meter &meter);
+    void SizeBuffers(uint16_t clientMaxPdu);
+    void UsePreEstablished(Meter &meter);
     Result ConnectAarq(Meter &meter);
     Result AccessObject(Meter &meter, const Object &obj, csm_request &request, csm_response &response, csm_array &app_array);
+    void DumpObject(const Meter &meter, const Object &obj, csm_array &data);
+    bool StreamStart(const Meter &meter, const Object &obj, bool resume);
+    bool StreamBlock(const Meter &meter, const Object &obj, const uint8_t *data, uint32_t size, uint32_t block);
+    bool StreamEnd(const Meter &meter, const Object &obj, bool success);
+    bool ReadUnsigned32(Meter &meter, const Object &obj, int8_t attribute, uint32_t &value);
+    bool PrepareIncrementalRead(Meter &meter, const Object &obj, Incremental &read);
+    void StoreCursor(const Meter &meter, const Object &obj);
+    bool RestoreAssociation(Meter &meter);
+    void KeepAssociation(const Meter &meter);
+    FailureAction OnObjectFailure(const Result &result);
+    void ReleasedAssociation();
+    uint32_t ListBatchSize() const;
+    int ReadList(Meter &meter, uint32_t &count);
+    int ReadListBlocks(Meter &meter, csm_response &response, csm_array &rx, std::vector<uint8_t> &data);
 };
 
 #endif // COSEM_CLIENT_H
@@ -0,0 +1,296 @@
+/**
+ * HDLC frame layout (IEC 62056-46), for the frames not produced by the HDLC library
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <cstring>
+#include "HdlcFrame.h"
+
+static const uint16_t cFcsInit = 0xFFFFU;
+static const uint16_t cFcsGood = 0xF0B8U;
+static const uint32_t cMinFrameSize = 9U; // flags, format, 1-byte addresses, control, FCS
+
+uint16_t HdlcFrame::Fcs16(const uint8_t *data, uint32_t size)
+{
+    uint16_t fcs = cFcsInit;
+
+    for (uint32_t i = 0U; i < size; i++)
+    {
+        fcs ^= data[i];
+        for (uint32_t bit = 0U; bit < 8U; bit++)
+        {
+            fcs = (fcs & 1U) ? static_cast<uint16_t>((fcs >> 1U) ^ 0x8408U) : static_cast<uint16_t>(fcs >> 1U);
+        }
+    }
+    return static_cast<uint16_t>(~fcs);
+}
+
+HdlcFrame::Address HdlcFrame::ClientAddress(uint8_t client)
+{
+    Address address;
+    address.bytes[0] = static_cast<uint8_t>((client << 1U) | 1U);
+    address.size = 1U;
+    return address;
+}
+
+HdlcFrame::Address HdlcFrame::ServerAddress(uint16_t logical, uint16_t physical, uint32_t size)
+{
+    Address address;
+
+    if (size == 4U)
+    {
+        address.bytes[0] = static_cast<uint8_t>((logical >> 7U) << 1U);
+        address.bytes[1] = static_cast<uint8_t>(logical << 1U);
+        address.bytes[2] = static_cast<uint8_t>((physical >> 7U) << 1U);
+        address.bytes[3] = static_cast<uint8_t>((physical << 1U) | 1U);
+    }
+    else if (size == 2U)
+    {
+        address.bytes[0] = static_cast<uint8_t>(logical << 1U);
+        address.bytes[1] = static_cast<uint8_t>((physical << 1U) | 1U);
+    }
+    else
+    {
+        size = 1U;
+        address.bytes[0] = static_cast<uint8_t>((logical << 1U) | 1U);
+    }
+    address.size = size;
+    return address;
+}
+
+uint8_t HdlcFrame::IControl(uint8_t rrr, uint8_t sss, bool pollFinal)
+{
+    return static_cast<uint8_t>(((rrr & 0x07U) << 5U) | (pollFinal ? cPollFinal : 0U) | ((sss & 0x07U) << 1U));
+}
+
+uint8_t HdlcFrame::RrControl(uint8_t rrr)
+{
+    return static_cast<uint8_t>(((rrr & 0x07U) << 5U) | cPollFinal | 0x01U);
+}
+
+uint32_t HdlcFrame::Encode(uint8_t *buf, uint32_t size, const Address &destination, const Address &source,
+                           uint8_t control, bool segmented, const uint8_t *info, uint32_t infoSize)
+{
+    uint32_t length = 2U + destination.size + source.size + 1U + 2U; // format, addresses, control, FCS
+    if (infoSize > 0U)
+    {
+        length += infoSize + 2U; // HCS
+    }
+
+    if (((length + 2U) > size) || (length > 0x7FFU))
+    {
+        return 0U;
+    }
+
+    uint32_t i = 0U;
+    buf[i++] = cFlag;
+    buf[i++] = static_cast<uint8_t>(0xA0U | (segmented ? 0x08U : 0U) | ((length >> 8U) & 0x07U));
+    buf[i++] = static_cast<uint8_t>(length & 0xFFU);
+    std::memcpy(&buf[i], destination.bytes, destination.size);
+    i += destination.size;
+    std::memcpy(&buf[i], source.bytes, source.size);
+    i += source.size;
+    buf[i++] = control;
+
+    if (infoSize > 0U)
+    {
+        uint16_t hcs = Fcs16(&buf[1], i - 1U);
+        buf[i++] = static_cast<uint8_t>(hcs & 0xFFU);
+        buf[i++] = static_cast<uint8_t>(hcs >> 8U);
+        std::memcpy(&buf[i], info, infoSize);
+        i += infoSize;
+    }
+
+    uint16_t fcs = Fcs16(&buf[1], i - 1U);
+    buf[i++] = static_cast<uint8_t>(fcs & 0xFFU);
+    buf[i++] = static_cast<uint8_t>(fcs >> 8U);
+    buf[i++] = cFlag;
+
+    return i;
+}
+
+uint16_t HdlcFrame::PhysicalAddress(const Address &server)
+{
+    uint16_t physical = 0U;
+
+    if (server.size == 4U)
+    {
+        physical = static_cast<uint16_t>(((server.bytes[2] >> 1U) << 7U) | (server.bytes[3] >> 1U));
+    }
+    else if (server.size == 2U)
+    {
+        physical = static_cast<uint16_t>(server.bytes[1] >> 1U);
+    }
+    return physical; // One byte address: no lower (physical) part
+}
+
+// Format identifier, group identifier, group length, then (parameter identifier, length, value)
+static const uint8_t cFormatId = 0x81U;
+static const uint8_t cGroupId = 0x80U;
+static const uint8_t cParamMaxInfoTx = 0x05U;
+static const uint8_t cParamMaxInfoRx = 0x06U;
+static const uint8_t cParamWindowTx = 0x07U;
+static const uint8_t cParamWindowRx = 0x08U;
+
+static uint32_t EncodeParameter(uint8_t *buf, uint8_t id, uint32_t value, uint32_t length)
+{
+    buf[0] = id;
+    buf[1] = static_cast<uint8_t>(length);
+    for (uint32_t i = 0U; i < length; i++)
+    {
+        buf[2U + i] = static_cast<uint8_t>(value >> (8U * (length - 1U - i)));
+    }
+    return 2U + length;
+}
+
+uint32_t HdlcFrame::EncodeParameters(uint8_t *buf, uint32_t size, const Parameters &params)
+{
+    static const uint32_t cMaxSize = 3U + 2U * (2U + 2U) + 2U * (2U + 4U);
+
+    if (size < cMaxSize)
+    {
+        return 0U;
+    }
+
+    uint32_t i = 3U;
+    i += EncodeParameter(&buf[i], cParamMaxInfoTx, params.maxInfoTx, (params.maxInfoTx > 0xFFU) ? 2U : 1U);
+    i += EncodeParameter(&buf[i], cParamMaxInfoRx, params.maxInfoRx, (params.maxInfoRx > 0xFFU) ? 2U : 1U);
+    i += EncodeParameter(&buf[i], cParamWindowTx, params.windowTx, 4U);
+    i += EncodeParameter(&buf[i], cParamWindowRx, params.windowRx, 4U);
+
+    buf[0] = cFormatId;
+    buf[1] = cGroupId;
+    buf[2] = static_cast<uint8_t>(i - 3U);
+    return i;
+}
+
+bool HdlcFrame::DecodeParameters(const uint8_t *info, uint32_t size, Parameters &params)
+{
+    if ((size < 3U) || (info[0] != cFormatId) || (info[1] != cGroupId) || ((info[2] + 3U) > size))
+    {
+        return false;
+    }
+
+    uint32_t end = info[2] + 3U;
+    uint32_t pos = 3U;
+    while ((pos + 2U) <= end)
+    {
+        uint8_t id = info[pos];
+        uint32_t length = info[pos + 1U];
+        uint32_t value = 0U;
+
+        pos += 2U;
+        if (((pos + length) > end) || (length > 4U))
+        {
+            return false;
+        }
+        for (uint32_t i = 0U; i < length; i++)
+        {
+            value = (value << 8U) | info[pos++];
+        }
+
+        if (id == cParamMaxInfoTx)
+        {
+            params.maxInfoTx = static_cast<uint16_t>(value);
+        }
+        else if (id == cParamMaxInfoRx)
+        {
+            params.maxInfoRx = static_cast<uint16_t>(value);
+        }
+        else if (id == cParamWindowTx)
+        {
+            params.windowTx = static_cast<uint8_t>(value);
+        }
+        else if (id == cParamWindowRx)
+        {
+            params.windowRx = static_cast<uint8_t>(value);
+        }
+    }
+    return true;
+}
+
+// Address field: the last byte has its least significant bit set
+static bool DecodeAddress(const uint8_t *data, uint32_t size, HdlcFrame::Address &address)
+{
+    bool ok = false;
+
+    address.size = 0U;
+    while ((address.size < size) && (address.size < HdlcFrame::cMaxAddressSize))
+    {
+        uint8_t byte = data[address.size];
+        address.bytes[address.size++] = byte;
+        if (byte & 1U)
+        {
+            ok = (address.size != 3U);
+            break;
+        }
+    }
+    return ok;
+}
+
+int HdlcFrame::Decode(const uint8_t *data, uint32_t size, Frame &frame)
+{
+    if (size < 3U)
+    {
+        return 0;
+    }
+
+    if ((data[0] != cFlag) || ((data[1] & 0xF0U) != 0xA0U))
+    {
+        return -1;
+    }
+
+    uint32_t length = (static_cast<uint32_t>(data[1] & 0x07U) << 8U) | data[2];
+    if (length < (cMinFrameSize - 2U))
+    {
+        return -1;
+    }
+    if (size < (length + 2U))
+    {
+        return 0;
+    }
+
+    const uint8_t *end = &data[length + 1U]; // Closing flag
+    if ((*end != cFlag) || (Fcs16(&data[1], length) != static_cast<uint16_t>(~cFcsGood)))
+    {
+        return -1;
+    }
+
+    const uint8_t *ptr = &data[3];
+    uint32_t remaining = length - 4U; // format, FCS
+    if (!DecodeAddress(ptr, remaining, frame.destination))
+    {
+        return -1;
+    }
+    ptr += frame.destination.size;
+    remaining -= frame.destination.size;
+
+    if (!DecodeAddress(ptr, remaining, frame.source) || (remaining <= frame.source.size))
+    {
+        return -1;
+    }
+    ptr += frame.source.size;
+    remaining -= frame.source.size;
+
+    frame.control = *ptr++;
+    remaining--;
+    frame.segmented = (data[1] & 0x08U) != 0U;
+    frame.info = NULL;
+    frame.infoSize = 0U;
+
+    if (remaining > 2U)
+    {
+        // HCS, then information
+        frame.info = ptr + 2U;
+        frame.infoSize = remaining - 2U;
+    }
+    frame.frameSize = length + 2U;
+
+    return 1;
+}
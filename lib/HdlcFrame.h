@@ -0,0 +1,101 @@
+/**
+ * HDLC frame layout (IEC 62056-46), for the frames not produced by the HDLC library
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef HDLC_FRAME_H
+#define HDLC_FRAME_H
+
+#include <cstdint>
+
+/**
+ * Flag, frame format (type 3, segmentation bit, 11-bit length), destination and
+ * source addresses, control, HCS, information, FCS, flag.
+ */
+class HdlcFrame
+{
+public:
+    static const uint8_t cFlag = 0x7EU;
+
+    // Control fields, poll/final bit set
+    static const uint8_t cSnrm = 0x93U;
+    static const uint8_t cDisc = 0x53U;
+    static const uint8_t cUa = 0x73U;
+    static const uint8_t cDm = 0x1FU;
+    static const uint8_t cFrmr = 0x97U;
+    static const uint8_t cPollFinal = 0x10U;
+
+    static const uint32_t cMaxAddressSize = 4U;
+    static const uint16_t cAllStations = 0x3FFFU; // Physical broadcast address, 0x7F with 2-byte addresses
+
+    struct Address
+    {
+        uint8_t bytes[cMaxAddressSize];
+        uint32_t size;
+    };
+
+    // Link parameters negotiated by SNRM/UA, from the point of view of the sender of the frame
+    struct Parameters
+    {
+        Parameters()
+            : maxInfoTx(cDefaultMaxInfo)
+            , maxInfoRx(cDefaultMaxInfo)
+            , windowTx(1U)
+            , windowRx(1U)
+        {
+
+        }
+
+        uint16_t maxInfoTx;
+        uint16_t maxInfoRx;
+        uint8_t windowTx;
+        uint8_t windowRx;
+    };
+
+    static const uint16_t cDefaultMaxInfo = 128U;
+    static const uint8_t cMaxWindow = 7U;
+    static const uint32_t cMaxFrameSize = 0x7FFU + 2U; // 11-bit length, and both flags
+
+    struct Frame
+    {
+        Address destination;
+        Address source;
+        uint8_t control;
+        bool segmented;
+        const uint8_t *info;
+        uint32_t infoSize;
+        uint32_t frameSize; // Including both flags
+    };
+
+    // Returns the frame size, 0 if the buffer is too small
+    static uint32_t Encode(uint8_t *buf, uint32_t size, const Address &destination, const Address &source,
+                           uint8_t control, bool segmented, const uint8_t *info, uint32_t infoSize);
+
+    // Decodes the frame at the start of data: 1 when complete, 0 when more data is needed,
+    // -1 when data does not start with a valid frame (skip one byte and retry)
+    static int Decode(const uint8_t *data, uint32_t size, Frame &frame);
+
+    // SNRM/UA information field; a missing parameter keeps its default value
+    static uint32_t EncodeParameters(uint8_t *buf, uint32_t size, const Parameters &params);
+    static bool DecodeParameters(const uint8_t *info, uint32_t size, Parameters &params);
+
+    static Address ClientAddress(uint8_t client);
+    static Address ServerAddress(uint16_t logical, uint16_t physical, uint32_t size);
+    static uint16_t PhysicalAddress(const Address &server);
+
+    static bool IsIFrame(uint8_t control) { return (control & 0x01U) == 0U; }
+    static bool IsRr(uint8_t control) { return (control & 0x0FU) == 0x01U; }
+    static uint8_t IControl(uint8_t rrr, uint8_t sss, bool pollFinal);
+    static uint8_t RrControl(uint8_t rrr);
+
+    // PPP FCS-16 (RFC 1662), transmitted least significant byte first
+    static uint16_t Fcs16(const uint8_t *data, uint32_t size);
+};
+
+#endif // HDLC_FRAME_H
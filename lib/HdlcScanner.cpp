@@ -0,0 +1,96 @@
+/**
+ * Incremental HDLC frame delimiter for the reception path
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <cstring>
+#include "HdlcScanner.h"
+#include "HdlcFrame.h"
+
+// Flag, format (2 bytes), one byte addresses, control, FCS, flag
+static const uint32_t cMinFrameSize = 9U;
+static const uint32_t cHeaderSize = 3U;
+
+HdlcScanner::HdlcScanner()
+{
+    Reset();
+}
+
+void HdlcScanner::Reset()
+{
+    mFrameSize = 0U;
+    mNeeded = 1U;
+}
+
+HdlcScanner::Status HdlcScanner::Skip(uint32_t count, uint32_t &length)
+{
+    Reset();
+    length = count;
+    return SKIP;
+}
+
+HdlcScanner::Status HdlcScanner::Scan(const uint8_t *data, uint32_t size, uint32_t &length)
+{
+    if (size < mNeeded)
+    {
+        // Still in the middle of a frame (or header) that has been located already
+        return NEED_MORE;
+    }
+
+    if (mFrameSize == 0U)
+    {
+        if (data[0] != HdlcFrame::cFlag)
+        {
+            // Resynchronize on the next flag
+            const void *flag = std::memchr(data, HdlcFrame::cFlag, size);
+            return Skip((flag != NULL) ? static_cast<uint32_t>(static_cast<const uint8_t *>(flag) - data) : size, length);
+        }
+
+        if (size < cHeaderSize)
+        {
+            mNeeded = cHeaderSize;
+            return NEED_MORE;
+        }
+
+        if (data[1] == HdlcFrame::cFlag)
+        {
+            // Closing flag of a previous frame followed by an opening one
+            return Skip(1U, length);
+        }
+
+        // Frame format type 3, 11-bit length without the flags
+        uint32_t frameSize = ((static_cast<uint32_t>(data[1] & 0x07U) << 8U) | data[2]) + 2U;
+        if (((data[1] & 0xF0U) != 0xA0U) || (frameSize < cMinFrameSize))
+        {
+            return Skip(1U, length);
+        }
+
+        mFrameSize = frameSize;
+        mNeeded = frameSize;
+        if (size < mNeeded)
+        {
+            return NEED_MORE;
+        }
+    }
+
+    uint32_t frameSize = mFrameSize;
+    uint16_t fcs = HdlcFrame::Fcs16(&data[1], frameSize - 4U);
+
+    if ((data[frameSize - 1U] != HdlcFrame::cFlag) ||
+        (data[frameSize - 3U] != static_cast<uint8_t>(fcs & 0xFFU)) ||
+        (data[frameSize - 2U] != static_cast<uint8_t>(fcs >> 8U)))
+    {
+        // Wrong length or corrupted frame: this flag was not an opening one
+        return Skip(1U, length);
+    }
+
+    Reset();
+    length = frameSize;
+    return FRAME;
+}
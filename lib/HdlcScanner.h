@@ -0,0 +1,50 @@
+/**
+ * Incremental HDLC frame delimiter for the reception path
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef HDLC_SCANNER_H
+#define HDLC_SCANNER_H
+
+#include <cstdint>
+
+/**
+ * Finds the frames in the unread bytes of the transport. The opening flag is
+ * always the first unread byte (garbage is skipped first) and the length field is
+ * parsed once, so a frame received in many small chunks is not scanned again on
+ * each chunk; the FCS is checked once, when the declared length is available.
+ */
+class HdlcScanner
+{
+public:
+    enum Status
+    {
+        NEED_MORE, // Wait for Needed() bytes
+        FRAME,     // A frame with a good FCS of 'length' bytes, flags included
+        SKIP       // Consume 'length' bytes of garbage, then scan again
+    };
+
+    HdlcScanner();
+
+    void Reset();
+
+    // 'data' must start at the same position until a FRAME or SKIP result has been consumed
+    Status Scan(const uint8_t *data, uint32_t size, uint32_t &length);
+
+    // Minimal number of unread bytes for the next Scan() to progress
+    uint32_t Needed() const { return mNeeded; }
+
+private:
+    uint32_t mFrameSize; // Declared size of the frame being received, 0 when not parsed yet
+    uint32_t mNeeded;
+
+    Status Skip(uint32_t count, uint32_t &length);
+};
+
+#endif // HDLC_SCANNER_H
@@ -0,0 +1,293 @@
+/**
+ * Asynchronous leveled logger
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include "Log.h"
+
+namespace Log {
+
+struct Entry
+{
+    LogLevel level;
+    bool hex;
+    std::chrono::system_clock::time_point date;
+    std::string prefix;
+    std::string text;
+};
+
+// Bounded multi-producer/single-consumer queue (D. Vyukov's algorithm)
+class Queue
+{
+public:
+    Queue()
+        : mEnqueuePos(0U)
+        , mDequeuePos(0U)
+    {
+        for (uint32_t i = 0U; i < cSize; i++)
+        {
+            mCells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool Push(Entry &entry)
+    {
+        Cell *cell;
+        uint32_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            cell = &mCells[pos & cMask];
+            uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(seq - pos);
+
+            if (diff == 0)
+            {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1U, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->entry = std::move(entry);
+        cell->sequence.store(pos + 1U, std::memory_order_release);
+        return true;
+    }
+
+    // Single consumer
+    bool Pop(Entry &entry)
+    {
+        Cell *cell = &mCells[mDequeuePos & cMask];
+        uint32_t seq = cell->sequence.load(std::memory_order_acquire);
+
+        if (seq != (mDequeuePos + 1U))
+        {
+            return false; // empty
+        }
+
+        entry = std::move(cell->entry);
+        cell->sequence.store(mDequeuePos + cSize, std::memory_order_release);
+        mDequeuePos++;
+        return true;
+    }
+
+private:
+    static const uint32_t cSize = 8192U; // power of two
+    static const uint32_t cMask = cSize - 1U;
+
+    struct Cell
+    {
+        std::atomic<uint32_t> sequence;
+        Entry entry;
+    };
+
+    Cell mCells[cSize];
+    alignas(64) std::atomic<uint32_t> mEnqueuePos;
+    alignas(64) uint32_t mDequeuePos;
+};
+
+static Queue gQueue;
+static std::atomic<int> gLevel(LOG_INFO);
+static std::atomic<bool> gStarted(false);
+static std::atomic<bool> gTerminate(false);
+static std::atomic<uint32_t> gDropped(0U);
+static std::thread gWriter;
+
+static void Write(const Entry &entry)
+{
+    static std::time_t lastSecond = 0;
+    static char dateStr[32] = "";
+
+    std::time_t t = std::chrono::system_clock::to_time_t(entry.date);
+    if (t != lastSecond)
+    {
+        // Formatting the date is expensive, do it once per second
+        std::strftime(dateStr, sizeof(dateStr), "%Y-%m-%d.%X", std::localtime(&t));
+        lastSecond = t;
+    }
+
+    FILE *out = (entry.level == LOG_ERROR) ? stderr : stdout;
+
+    fputs(dateStr, out);
+    fputs(": ", out);
+    fputs(entry.prefix.c_str(), out);
+
+    if (entry.hex)
+    {
+        static const char cDigits[] = "0123456789ABCDEF";
+        std::string line;
+
+        line.reserve(entry.text.size() * 3U);
+        for (size_t i = 0U; i < entry.text.size(); i++)
+        {
+            uint8_t byte = static_cast<uint8_t>(entry.text[i]);
+            line += cDigits[byte >> 4U];
+            line += cDigits[byte & 0x0FU];
+            line += ' ';
+        }
+        fwrite(line.data(), 1U, line.size(), out);
+    }
+    else
+    {
+        fwrite(entry.text.data(), 1U, entry.text.size(), out);
+    }
+    fputc('\n', out);
+}
+
+static void Drain()
+{
+    Entry entry;
+    bool written = false;
+
+    while (gQueue.Pop(entry))
+    {
+        Write(entry);
+        written = true;
+    }
+
+    uint32_t dropped = gDropped.exchange(0U);
+    if (dropped > 0U)
+    {
+        fprintf(stdout, "** Log queue full, %u message(s) dropped\n", dropped);
+        written = true;
+    }
+
+    if (written)
+    {
+        fflush(stdout);
+        fflush(stderr);
+    }
+}
+
+static void Writer()
+{
+    while (!gTerminate)
+    {
+        Drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    Drain();
+}
+
+static void Push(Entry &entry)
+{
+    entry.date = std::chrono::system_clock::now();
+
+    if (gStarted)
+    {
+        if (!gQueue.Push(entry))
+        {
+            gDropped++;
+        }
+    }
+    else
+    {
+        // No writer thread (start-up or tools): synchronous output
+        Write(entry);
+    }
+}
+
+void Start()
+{
+    if (!gStarted)
+    {
+        gTerminate = false;
+        gWriter = std::thread(Writer);
+        gStarted = true;
+    }
+}
+
+void Stop()
+{
+    if (gStarted)
+    {
+        gTerminate = true;
+        gWriter.join();
+        gStarted = false;
+    }
+    fflush(stdout);
+}
+
+void SetLevel(LogLevel level)
+{
+    gLevel = level;
+}
+
+bool SetLevel(const std::string &level)
+{
+    bool ret = true;
+
+    if (level == "error")
+    {
+        SetLevel(LOG_ERROR);
+    }
+    else if (level == "info")
+    {
+        SetLevel(LOG_INFO);
+    }
+    else if (level == "frame")
+    {
+        SetLevel(LOG_FRAME);
+    }
+    else if (level == "trace")
+    {
+        SetLevel(LOG_TRACE);
+    }
+    else
+    {
+        ret = false;
+    }
+    return ret;
+}
+
+bool Enabled(LogLevel level)
+{
+    return level <= gLevel.load(std::memory_order_relaxed);
+}
+
+void Print(LogLevel level, const std::string &text)
+{
+    if (Enabled(level))
+    {
+        Entry entry;
+        entry.level = level;
+        entry.hex = false;
+        entry.text = text;
+        Push(entry);
+    }
+}
+
+void Hex(LogLevel level, const std::string &prefix, const uint8_t *data, uint32_t size)
+{
+    if (Enabled(level))
+    {
+        Entry entry;
+        entry.level = level;
+        entry.hex = true;
+        entry.prefix = prefix;
+        entry.text.assign(reinterpret_cast<const char *>(data), size);
+        Push(entry);
+    }
+}
+
+} // namespace Log
@@ -0,0 +1,56 @@
+/**
+ * Asynchronous leveled logger
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <string>
+#include <sstream>
+#include <cstdint>
+
+enum LogLevel
+{
+    LOG_ERROR,
+    LOG_INFO,
+    LOG_FRAME,  // Link frames, hexadecimal dumps
+    LOG_TRACE   // Reassembled APDUs, decoded data, protocol details
+};
+
+/**
+ * Messages are pushed into a lock-free queue and written by a background thread,
+ * so the protocol threads never wait for the console. Disabled levels cost a
+ * comparison: nothing is formatted, hexadecimal dumps are formatted by the writer.
+ */
+namespace Log {
+
+void Start();
+void Stop(); // Flushes all the pending messages
+
+void SetLevel(LogLevel level);
+bool SetLevel(const std::string &level);
+bool Enabled(LogLevel level);
+
+void Print(LogLevel level, const std::string &text);
+void Hex(LogLevel level, const std::string &prefix, const uint8_t *data, uint32_t size);
+
+}
+
+// Stream-like helper: LOG(LOG_INFO, "Meter: " << id);
+#define LOG(level, expr) \
+    do { \
+        if (Log::Enabled(level)) { \
+            std::ostringstream log_ss__; \
+            log_ss__ << expr; \
+            Log::Print(level, log_ss__.str()); \
+        } \
+    } while (0)
+
+#endif // LOG_H
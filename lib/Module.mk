@@ -1,4 +1,4 @@
 LOCAL_DIR = $(call my-dir)/
 
-SOURCES += $(addprefix $(LOCAL_DIR), AxdrPrinter.cpp CosemClient.cpp Transport.cpp Configuration.cpp)
+SOURCES += $(addprefix $(LOCAL_DIR), AddressCache.cpp AxdrPrinter.cpp AxdrStream.cpp Capture.cpp Checkpoint.cpp CosemClient.cpp HdlcFrame.cpp HdlcScanner.cpp Log.cpp ProfileCursor.cpp ReplayTransport.cpp RttEstimator.cpp SessionPool.cpp Transport.cpp TransportReactor.cpp UdpEndpoint.cpp Xdlms.cpp Configuration.cpp)
 
@@ -0,0 +1,89 @@
+/**
+ * Cursor file of the profiles polled incrementally ("since last read" objects)
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <fstream>
+#include <json/json.h>
+#include "ProfileCursor.h"
+#include "Log.h"
+
+std::mutex ProfileCursor::mMutex;
+
+// A missing file has no cursor
+static void Load(const std::string &file, Json::Value &root)
+{
+    std::ifstream ifs(file, std::ifstream::binary);
+    root = Json::Value(Json::objectValue);
+
+    if (ifs)
+    {
+        Json::CharReaderBuilder builder;
+        JSONCPP_STRING errs;
+
+        if (!parseFromStream(builder, ifs, &root, &errs) || !root.isObject())
+        {
+            LOG(LOG_ERROR, "** Error parsing " << file << " : " << errs);
+            root = Json::Value(Json::objectValue);
+        }
+    }
+}
+
+static bool Save(const std::string &file, const Json::Value &root)
+{
+    std::ofstream ofs(file, std::ofstream::binary | std::ofstream::trunc);
+
+    if (!ofs)
+    {
+        LOG(LOG_ERROR, "** Cannot write cursor file: " << file);
+        return false;
+    }
+
+    Json::StreamWriterBuilder builder;
+    ofs << Json::writeString(builder, root) << std::endl;
+    return true;
+}
+
+bool ProfileCursor::Find(const std::string &file, const std::string &meterId, const std::string &object, ProfileCursor &cursor)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Json::Value root;
+
+    Load(file, root);
+    Json::Value meter = root.get(meterId, Json::Value());
+    if (!meter.isObject())
+    {
+        return false;
+    }
+
+    Json::Value entry = meter.get(object, Json::Value());
+    if (!entry.isObject())
+    {
+        return false;
+    }
+
+    cursor.entries = entry["entries"].isInt() ? static_cast<uint32_t>(entry["entries"].asInt()) : 0U;
+    cursor.clock = entry["clock"].isString() ? entry["clock"].asString() : std::string();
+    return true;
+}
+
+bool ProfileCursor::Store(const std::string &file, const std::string &meterId, const std::string &object, const ProfileCursor &cursor)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Json::Value root;
+
+    Load(file, root);
+    Json::Value &entry = root[meterId][object];
+    entry["entries"] = static_cast<int>(cursor.entries);
+    if (cursor.clock.size() > 0U)
+    {
+        entry["clock"] = cursor.clock;
+    }
+    return Save(file, root);
+}
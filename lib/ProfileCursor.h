@@ -0,0 +1,47 @@
+/**
+ * Cursor file of the profiles polled incrementally ("since last read" objects)
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef PROFILE_CURSOR_H
+#define PROFILE_CURSOR_H
+
+#include <string>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * JSON object, one member per meter ID then per object name:
+ *
+ * { "saphir0899": { "load_profile": { "entries": 2880, "clock": "2017-03-02.10:15:00" } } }
+ *
+ * While the profile buffer is not full, the entries already read are enough to
+ * ask for the new ones. Once it is full, the oldest rows are overwritten and
+ * the entry numbers move: the read goes on after the clock of the last row.
+ */
+class ProfileCursor
+{
+public:
+    ProfileCursor()
+        : entries(0U)
+    {
+
+    }
+
+    uint32_t entries;  // Entries of the buffer already read
+    std::string clock; // Of the last row read, same format as the session start date
+
+    static bool Find(const std::string &file, const std::string &meterId, const std::string &object, ProfileCursor &cursor);
+    static bool Store(const std::string &file, const std::string &meterId, const std::string &object, const ProfileCursor &cursor);
+
+private:
+    static std::mutex mMutex;
+};
+
+#endif // PROFILE_CURSOR_H
@@ -0,0 +1,152 @@
+/**
+ * Transport playing back a capture file
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include "ReplayTransport.h"
+#include "Log.h"
+
+ReplayTransport::ReplayTransport(const std::string &fileName, bool realTime)
+    : mIndex(0U)
+    , mRealTime(realTime)
+    , mStop(false)
+{
+    if (Capture::Load(fileName, mRecords))
+    {
+        LOG(LOG_INFO, "** Replaying " << mRecords.size() << " records from " << fileName);
+    }
+
+    if (mRealTime)
+    {
+        mPlayer = std::thread(&ReplayTransport::Player, this);
+    }
+}
+
+ReplayTransport::~ReplayTransport()
+{
+    WaitForStop();
+}
+
+void ReplayTransport::Start()
+{
+    // No link to read, the records are delivered by Send() or by the player thread
+}
+
+void ReplayTransport::WaitForStop()
+{
+    mMutex.lock();
+    mStop = true;
+    mMutex.unlock();
+    mCond.notify_one();
+
+    if (mPlayer.joinable())
+    {
+        mPlayer.join();
+    }
+}
+
+bool ReplayTransport::Open(const Params &params)
+{
+    // Each session keeps going on with the capture where the previous one has stopped
+    Flush();
+    SetOpened(params, true);
+    return true;
+}
+
+void ReplayTransport::Close()
+{
+    SetOpened(GetParams(), false);
+}
+
+bool ReplayTransport::SetupLink(unsigned int baudrate, bool sevenEven)
+{
+    (void) baudrate;
+    (void) sevenEven;
+    return true;
+}
+
+int ReplayTransport::Send(const std::string &data, PrintFormat format)
+{
+    if (format == PRINT_RAW)
+    {
+        LOG(LOG_INFO, "====> Sending: " << data);
+    }
+    else if (format == PRINT_HEX)
+    {
+        Log::Hex(LOG_FRAME, "====> Sending: ", (const uint8_t *)data.c_str(), data.size());
+    }
+
+    while ((mIndex < mRecords.size()) && (mRecords[mIndex].direction != Capture::SENT))
+    {
+        mIndex++;
+    }
+
+    if (mIndex >= mRecords.size())
+    {
+        LOG(LOG_INFO, "** End of the capture");
+        return -1;
+    }
+
+    if (mRecords[mIndex].data != data)
+    {
+        LOG(LOG_TRACE, "** Request differs from the capture");
+    }
+
+    uint64_t sentAt = mRecords[mIndex].timestamp;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    mIndex++;
+    while ((mIndex < mRecords.size()) && (mRecords[mIndex].direction == Capture::RECEIVED))
+    {
+        if (mRealTime)
+        {
+            Pending pending;
+            pending.index = mIndex;
+            pending.due = now + std::chrono::microseconds(mRecords[mIndex].timestamp - sentAt);
+
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPending.push_back(pending);
+        }
+        else
+        {
+            const Capture::Record &record = mRecords[mIndex];
+            Push((const uint8_t *)record.data.data(), static_cast<uint32_t>(record.data.size()));
+        }
+        mIndex++;
+    }
+
+    mCond.notify_one();
+    return static_cast<int>(data.size());
+}
+
+void ReplayTransport::Player()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (!mStop)
+    {
+        if (mPending.empty())
+        {
+            mCond.wait(lock);
+        }
+        else if (std::chrono::steady_clock::now() < mPending.front().due)
+        {
+            mCond.wait_until(lock, mPending.front().due);
+        }
+        else
+        {
+            // Records are never modified after the load: deliver without the lock
+            const Capture::Record &record = mRecords[mPending.front().index];
+            mPending.pop_front();
+            lock.unlock();
+            Push((const uint8_t *)record.data.data(), static_cast<uint32_t>(record.data.size()));
+            lock.lock();
+        }
+    }
+}
@@ -0,0 +1,59 @@
+/**
+ * Transport playing back a capture file
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef REPLAY_TRANSPORT_H
+#define REPLAY_TRANSPORT_H
+
+#include <deque>
+#include <condition_variable>
+#include "Transport.h"
+
+/**
+ * Each Send() moves to the next sent record of the capture, then the received
+ * records that follow it are delivered, either with their original delays
+ * (relative to the request) or immediately.
+ */
+class ReplayTransport : public Transport
+{
+public:
+    ReplayTransport(const std::string &fileName, bool realTime);
+    virtual ~ReplayTransport();
+
+    virtual void Start();
+    virtual void WaitForStop();
+
+    virtual bool Open(const Params &params);
+    virtual void Close();
+    virtual int Send(const std::string &data, PrintFormat format);
+
+private:
+    struct Pending
+    {
+        uint32_t index;
+        std::chrono::steady_clock::time_point due;
+    };
+
+    std::vector<Capture::Record> mRecords;
+    uint32_t mIndex; // Next record to replay
+    bool mRealTime;
+
+    std::thread mPlayer;
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    std::deque<Pending> mPending;
+    bool mStop;
+
+    virtual int GetHandle() const { return -1; }
+    virtual bool SetupLink(unsigned int baudrate, bool sevenEven);
+    void Player();
+};
+
+#endif // REPLAY_TRANSPORT_H
@@ -0,0 +1,73 @@
+/**
+ * Round-trip time estimation for the adaptive response timeouts
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include "RttEstimator.h"
+
+static const uint32_t cDefaultMin = 100U;
+static const uint32_t cDefaultMax = 5000U;
+
+RttEstimator::RttEstimator()
+    : mSrtt(0U)
+    , mRttVar(0U)
+    , mTimeout(cDefaultMax)
+    , mMin(cDefaultMin)
+    , mMax(cDefaultMax)
+    , mValid(false)
+{
+
+}
+
+void RttEstimator::SetBounds(uint32_t minimum, uint32_t maximum)
+{
+    mMax = maximum;
+    mMin = (minimum < maximum) ? minimum : maximum;
+    Clamp(mValid ? ((mSrtt >> 3U) + mRttVar) : mMax);
+}
+
+void RttEstimator::Sample(uint32_t rtt)
+{
+    if (!mValid)
+    {
+        // SRTT = R, RTTVAR = R / 2
+        mSrtt = rtt << 3U;
+        mRttVar = rtt << 1U;
+        mValid = true;
+    }
+    else
+    {
+        // RTTVAR += (|SRTT - R| - RTTVAR) / 4, SRTT += (R - SRTT) / 8
+        uint32_t srtt = mSrtt >> 3U;
+        uint32_t delta = (srtt > rtt) ? (srtt - rtt) : (rtt - srtt);
+        mRttVar = mRttVar - (mRttVar >> 2U) + delta;
+        mSrtt = mSrtt - srtt + rtt;
+    }
+
+    // RTTVAR is scaled by 4: 4 * RTTVAR is the stored value
+    Clamp((mSrtt >> 3U) + mRttVar);
+}
+
+void RttEstimator::Backoff()
+{
+    Clamp(mTimeout * 2U);
+}
+
+void RttEstimator::Clamp(uint32_t timeout)
+{
+    if (timeout < mMin)
+    {
+        timeout = mMin;
+    }
+    if (timeout > mMax)
+    {
+        timeout = mMax;
+    }
+    mTimeout = timeout;
+}
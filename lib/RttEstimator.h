@@ -0,0 +1,46 @@
+/**
+ * Round-trip time estimation for the adaptive response timeouts
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef RTT_ESTIMATOR_H
+#define RTT_ESTIMATOR_H
+
+#include <cstdint>
+
+/**
+ * Smoothed RTT and RTT variation (RFC 6298) of the request/response exchanges with
+ * one meter, all values in milliseconds. The timeout is SRTT + 4 * RTTVAR, kept
+ * between the bounds; before the first sample it is the upper bound. Samples of
+ * retransmitted exchanges must not be given (Karn's algorithm).
+ */
+class RttEstimator
+{
+public:
+    RttEstimator();
+
+    void SetBounds(uint32_t minimum, uint32_t maximum);
+    void Sample(uint32_t rtt);
+    void Backoff(); // After a timeout: double the timeout until the next sample
+
+    uint32_t Timeout() const { return mTimeout; }
+    uint32_t Srtt() const { return mSrtt >> 3U; }
+
+private:
+    uint32_t mSrtt;   // Scaled by 8
+    uint32_t mRttVar; // Scaled by 4
+    uint32_t mTimeout;
+    uint32_t mMin;
+    uint32_t mMax;
+    bool mValid;
+
+    void Clamp(uint32_t timeout);
+};
+
+#endif // RTT_ESTIMATOR_H
@@ -0,0 +1,349 @@
+/**
+ * Concurrent Cosem sessions
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include "SessionPool.h"
+#include "Log.h"
+
+SessionPool::SessionPool()
+    : mReactor(NULL)
+{
+
+}
+
+SessionPool::~SessionPool()
+{
+    for (uint32_t i = 0U; i < mClients.size(); i++)
+    {
+        delete mClients[i];
+    }
+    for (uint32_t i = 0U; i < mPoolClients.size(); i++)
+    {
+        delete mPoolClients[i];
+    }
+}
+
+bool SessionPool::Initialize(const std::string &commFile, const std::string &objectsFile, const std::string &meterFile)
+{
+    Transport::Params params;
+
+    if(!mConf.ParseComFile(commFile, params))
+        return false;
+    if(!mConf.ParseObjectsFile(objectsFile))
+        return false;
+    if(!mConf.ParseSessionFile(meterFile))
+        return false;
+
+    if ((mConf.log_level.size() > 0U) && !Log::SetLevel(mConf.log_level))
+    {
+        LOG(LOG_ERROR, "** Unknown log level: " << mConf.log_level);
+    }
+
+    // A session with TCP/IP meters only does not declare any serial port
+    std::vector<SerialPort> ports = mConf.ports;
+    if (ports.size() == 0U)
+    {
+        ports.push_back(SerialPort());
+    }
+
+    // Dispatch the meters: HDLC meters to their port, wrapper meters to the worker pool
+    std::vector<std::vector<Meter> > meters(ports.size());
+    for (uint32_t i = 0U; i < mConf.meters.size(); i++)
+    {
+        const Meter &meter = mConf.meters[i];
+        uint32_t index = 0U;
+
+        if (meter.transport != HDLC)
+        {
+            mJobs.push_back(meter);
+            continue;
+        }
+
+        if (meter.port.size() > 0U)
+        {
+            while ((index < ports.size()) && (ports[index].name != meter.port))
+            {
+                index++;
+            }
+        }
+
+        if (index < ports.size())
+        {
+            meters[index].push_back(meter);
+        }
+        else
+        {
+            Result result;
+            result.subject = meter.meterId;
+            result.SetError("** Unknown serial port: " + meter.port);
+            mConfigResults.push_back(result);
+        }
+    }
+
+    bool ok = false;
+    for (uint32_t i = 0U; i < ports.size(); i++)
+    {
+        // The default port is always opened, as before, the other ones only if used
+        if ((i == 0U) || (meters[i].size() > 0U))
+        {
+            Configuration conf = mConf;
+            conf.meters = meters[i];
+            if (i > 0U)
+            {
+                // The modem is on the default port
+                conf.modem.useModem = false;
+            }
+
+            CosemClient *client = new CosemClient();
+            client->SetReactor(mReactor);
+            // A port that cannot be opened does not prevent the other ones to be read
+            bool ready = client->Initialize(conf, ports[i]);
+            ok = ok || ready;
+            mClients.push_back(client);
+            mReady.push_back(ready);
+        }
+    }
+
+    // Pool workers: no serial port, no modem, meters given one by one
+    uint32_t workers = (mConf.concurrency < mJobs.size()) ? mConf.concurrency : static_cast<uint32_t>(mJobs.size());
+    Configuration conf = mConf;
+    conf.meters.clear();
+    conf.modem.useModem = false;
+    QueueJobs();
+
+    for (uint32_t i = 0U; i < workers; i++)
+    {
+        CosemClient *client = new CosemClient();
+        client->SetReactor(mReactor);
+        if (client->Initialize(conf, SerialPort()))
+        {
+            mPoolClients.push_back(client);
+            ok = true;
+        }
+        else
+        {
+            delete client;
+        }
+    }
+
+    if ((mJobs.size() > 0U) && (mPoolClients.size() == 0U))
+    {
+        Result result;
+        result.subject = "WORKER POOL";
+        result.SetError("** Cannot start any worker for the TCP/IP and UDP/IP meters");
+        mConfigResults.push_back(result);
+    }
+
+    return ok;
+}
+
+void SessionPool::SetReactor(TransportReactor *reactor)
+{
+    mReactor = reactor;
+}
+
+void SessionPool::SetStartDate(const std::string &date)
+{
+    mConf.start_date = date;
+}
+
+void SessionPool::SetEndDate(const std::string &date)
+{
+    mConf.end_date = date;
+}
+
+void SessionPool::Worker(CosemClient *client)
+{
+    while (client->PerformTask());
+}
+
+// Next meter of a gateway below its limit, waits for a slot if all of them are busy
+bool SessionPool::NextJob(uint32_t &job)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    for (;;)
+    {
+        bool pending = false;
+
+        for (std::map<std::string, Gateway>::iterator iter = mGateways.begin(); iter != mGateways.end(); ++iter)
+        {
+            Gateway &gateway = iter->second;
+            if (gateway.jobs.size() > 0U)
+            {
+                pending = true;
+                if (gateway.active < mConf.gateway_concurrency)
+                {
+                    job = gateway.jobs.front();
+                    gateway.jobs.pop_front();
+                    gateway.active++;
+                    return true;
+                }
+            }
+        }
+
+        if (!pending)
+        {
+            return false;
+        }
+        mCondition.wait(lock);
+    }
+}
+
+void SessionPool::JobDone(uint32_t job, const std::vector<Result> &results)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mGateways[mJobs[job].wrapper.address].active--;
+    mJobResults[job] = results;
+    mCondition.notify_all();
+}
+
+void SessionPool::PoolWorker(CosemClient *client)
+{
+    uint32_t job;
+
+    while (NextJob(job))
+    {
+        const std::vector<Result> &all = client->GetResults();
+        size_t first = all.size();
+
+        client->ReadMeter(mJobs[job]);
+        // The gateway may accept only one connection at a time
+        client->CloseLink();
+
+        JobDone(job, std::vector<Result>(all.begin() + first, all.end()));
+    }
+}
+
+// All the wrapper meters wait for a worker, in session file order
+void SessionPool::QueueJobs()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mJobResults.assign(mJobs.size(), std::vector<Result>());
+    for (uint32_t i = 0U; i < mJobs.size(); i++)
+    {
+        mGateways[mJobs[i].wrapper.address].jobs.push_back(i);
+    }
+}
+
+void SessionPool::Run()
+{
+    uint32_t cycle = 0U;
+
+    for (;;)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        RunCycle();
+        cycle++;
+
+        if (mConf.polling.period == 0U)
+        {
+            break;
+        }
+
+        uint32_t reused = 0U;
+        uint32_t created = 0U;
+        for (uint32_t i = 0U; i < mClients.size(); i++)
+        {
+            uint32_t clientReused;
+            uint32_t clientCreated;
+            mClients[i]->GetAssociationStats(clientReused, clientCreated);
+            reused += clientReused;
+            created += clientCreated;
+        }
+        for (uint32_t i = 0U; i < mPoolClients.size(); i++)
+        {
+            uint32_t clientReused;
+            uint32_t clientCreated;
+            mPoolClients[i]->GetAssociationStats(clientReused, clientCreated);
+            reused += clientReused;
+            created += clientCreated;
+        }
+        if ((reused + created) > 0U)
+        {
+            LOG(LOG_INFO, "** Cycle " << cycle << ", association reuse: " << reused << "/" << (reused + created)
+                << " (" << ((reused * 100U) / (reused + created)) << "%)");
+        }
+
+        if ((mConf.polling.cycles > 0U) && (cycle >= mConf.polling.cycles))
+        {
+            // The last results are printed by the caller
+            break;
+        }
+
+        PrintResult();
+        for (uint32_t i = 0U; i < mClients.size(); i++)
+        {
+            mClients[i]->StartCycle();
+        }
+        for (uint32_t i = 0U; i < mPoolClients.size(); i++)
+        {
+            mPoolClients[i]->StartCycle();
+        }
+        QueueJobs();
+
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(mConf.polling.period));
+    }
+}
+
+void SessionPool::RunCycle()
+{
+    for (uint32_t i = 0U; i < mClients.size(); i++)
+    {
+        if (mReady[i])
+        {
+            mWorkers.push_back(std::thread(SessionPool::Worker, mClients[i]));
+        }
+    }
+
+    for (uint32_t i = 0U; i < mPoolClients.size(); i++)
+    {
+        mWorkers.push_back(std::thread(&SessionPool::PoolWorker, this, mPoolClients[i]));
+    }
+
+    for (uint32_t i = 0U; i < mWorkers.size(); i++)
+    {
+        mWorkers[i].join();
+    }
+    mWorkers.clear();
+}
+
+void SessionPool::WaitForStop()
+{
+    for (uint32_t i = 0U; i < mClients.size(); i++)
+    {
+        mClients[i]->WaitForStop();
+    }
+    for (uint32_t i = 0U; i < mPoolClients.size(); i++)
+    {
+        mPoolClients[i]->WaitForStop();
+    }
+}
+
+void SessionPool::PrintResult()
+{
+    std::vector<Result> results = mConfigResults;
+
+    for (uint32_t i = 0U; i < mClients.size(); i++)
+    {
+        const std::vector<Result> &session = mClients[i]->GetResults();
+        results.insert(results.end(), session.begin(), session.end());
+    }
+
+    for (uint32_t i = 0U; i < mJobResults.size(); i++)
+    {
+        results.insert(results.end(), mJobResults[i].begin(), mJobResults[i].end());
+    }
+
+    CosemClient::PrintResult(results);
+}
@@ -0,0 +1,88 @@
+/**
+ * Concurrent Cosem sessions
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef SESSION_POOL_H
+#define SESSION_POOL_H
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "CosemClient.h"
+
+/**
+ * Splits the session file by serial port: one CosemClient per port, each one
+ * reading its HDLC meters in its own thread. The TCP/IP and UDP/IP meters are
+ * independent: they are read by a bounded pool of workers, each one with its own
+ * CosemClient, with a limit of sessions per gateway address. The results are
+ * collected in port order, then in session file order, for PrintResult().
+ */
+class SessionPool
+{
+public:
+    SessionPool();
+    ~SessionPool();
+
+    bool Initialize(const std::string &commFile, const std::string &objectsFile, const std::string &meterFile);
+
+    // Optional: use a shared reactor instead of a reader thread per session
+    void SetReactor(TransportReactor *reactor);
+
+    void SetStartDate(const std::string &date);
+    void SetEndDate(const std::string &date);
+
+    // Runs all the sessions to completion; in long-running mode, once per polling
+    // period with the results printed after each cycle
+    void Run();
+
+    void WaitForStop();
+    void PrintResult();
+
+private:
+    struct Gateway
+    {
+        Gateway()
+            : active(0U)
+        {
+
+        }
+
+        std::deque<uint32_t> jobs; // Indexes in mJobs, in session file order
+        uint32_t active;
+    };
+
+    Configuration mConf;
+    TransportReactor *mReactor;
+    std::vector<CosemClient *> mClients;
+    std::vector<bool> mReady; // Link opened, the session can run
+    std::vector<std::thread> mWorkers;
+    std::vector<Result> mConfigResults; // Session file errors, reported with every cycle
+
+    // Worker pool of the wrapper meters
+    std::vector<CosemClient *> mPoolClients;
+    std::vector<Meter> mJobs;
+    std::vector<std::vector<Result> > mJobResults;
+    std::map<std::string, Gateway> mGateways;
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+
+    static void Worker(CosemClient *client);
+    void RunCycle();
+    void QueueJobs();
+    void PoolWorker(CosemClient *client);
+    bool NextJob(uint32_t &job);
+    void JobDone(uint32_t job, const std::vector<Result> &results);
+};
+
+#endif // SESSION_POOL_H
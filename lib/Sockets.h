@@ -0,0 +1,33 @@
+/**
+ * BSD sockets portability definitions
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef SOCKETS_H
+#define SOCKETS_H
+
+#ifdef USE_WINDOWS_OS
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define close_socket closesocket
+typedef int socklen_t;
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#define close_socket close
+#endif
+
+static const int cInvalidSocket = -1;
+
+#endif // SOCKETS_H
@@ -10,54 +10,116 @@
  */
 
 #include <chrono>
+#include <cstring>
 #include <stdio.h>
 #include "Transport.h"
+#include "TransportReactor.h"
 #include "serial.h"
 #include "os_util.h"
 #include "Util.h"
+#include "Log.h"
+#include "Sockets.h"
+#include "UdpEndpoint.h"
+
+#ifndef USE_WINDOWS_OS
+#include <termios.h>
+#endif
 
 Transport::Transport()
-    : mStarted(false)
+    : mRing(RingSize(cMaxFrameSize))
+    , mStarted(false)
     , mUseTcpGateway(false)
-    , mSerialHandle(0)
+    , mSerialHandle(-1)
+    , mSocket(cInvalidSocket)
+    , mUdpEndpoint(NULL)
+    , mOpened(false)
     , mTerminate(false)
+    , mWaiting(false)
+    , mReactor(NULL)
+    , mPaused(false)
 {
 
 }
 
-void Transport::Printer(const char *text, int size, PrintFormat format)
+// The reactor may still be dispatching an event of the link: Close() and Detach() wait for its end
+Transport::~Transport()
+{
+    Close();
+    Detach();
+}
+
+// A whole frame and the beginning of the next one
+uint32_t Transport::RingSize(uint32_t frameSize)
 {
-    std::cout << Util::CurrentDateTime("%Y-%m-%d.%X") << ": ";
+    return frameSize + (frameSize / 2U);
+}
 
-    if (format != NO_PRINT)
+void Transport::Printer(const char *text, int size, PrintFormat format)
+{
+    if (format == PRINT_RAW)
     {
-        if (format == PRINT_RAW)
-        {
-            fwrite(text, size, 1, stdout);
-        }
-        else
-        {
-            print_hex(text, size);
-        }
+        LOG(LOG_INFO, std::string(text, size));
+    }
+    else if (format == PRINT_HEX)
+    {
+        Log::Hex(LOG_FRAME, "", (const uint8_t *)text, size);
     }
 }
 
-
-
 bool Transport::Open(const Transport::Params &params)
 {
     bool ret = false;
 
+    Close();
+
+    {
+        // Forget any data received on a previous link. Nothing is read from the closed link,
+        // the ring can be sized for the frames of the new one
+        std::lock_guard<std::mutex> lock(mReadMutex);
+        mRing.Resize(RingSize((params.frameSize > 0U) ? params.frameSize : cMaxFrameSize));
+        std::vector<uint8_t>().swap(mLinear);
+    }
+
+    std::lock_guard<std::mutex> lock(mLinkMutex);
     mConf = params;
+    mUseTcpGateway = (mConf.type != SERIAL);
+    mPaused = false;
 
-    std::cout << "** Opening serial port " << mConf.port << " at " << mConf.baudrate << std::endl;
+    if (mConf.type == TCP_IP)
+    {
+        ret = OpenTcp();
+    }
+    else if (mConf.type == UDP_IP)
+    {
+        ret = OpenUdp();
+    }
+    else
+    {
+        ret = OpenSerial();
+    }
+
+    mOpened = ret;
+
+    // The shared UDP endpoint has its own reader
+    if (ret && (mReactor != NULL) && (GetHandle() >= 0))
+    {
+        mReactor->Watch(GetHandle(), this);
+    }
+    return ret;
+}
+
+bool Transport::OpenSerial()
+{
+    bool ret = false;
+
+    LOG(LOG_INFO, "** Opening serial port " << mConf.port << " at " << mConf.baudrate);
     mSerialHandle = serial_open(mConf.port.c_str());
 
     if (mSerialHandle >= 0)
     {
         if (serial_setup(mSerialHandle, mConf.baudrate) == 0)
         {
-            printf("** Serial port success!\r\n");
+            LOG(LOG_INFO, "** Serial port success!");
             ret = true;
         }
     }
@@ -65,47 +127,440 @@ bool Transport::Open(const Transport::Params &params)
     return ret;
 }
 
+bool Transport::OpenTcp()
+{
+    bool ret = false;
+
+    LOG(LOG_INFO, "** Connecting to " << mConf.address << ":" << mConf.port);
+
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    if (getaddrinfo(mConf.address.c_str(), mConf.port.c_str(), &hints, &result) == 0)
+    {
+        for (struct addrinfo *rp = result; (rp != NULL) && !ret; rp = rp->ai_next)
+        {
+            int fd = static_cast<int>(socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol));
+            if (fd != cInvalidSocket)
+            {
+                if (connect(fd, rp->ai_addr, static_cast<int>(rp->ai_addrlen)) == 0)
+                {
+                    // APDUs are small and strictly request/response: do not wait for Nagle coalescing
+                    int flag = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&flag, sizeof(flag));
+                    mSocket = fd;
+                    ret = true;
+                }
+                else
+                {
+                    close_socket(fd);
+                }
+            }
+        }
+        freeaddrinfo(result);
+    }
+
+    if (ret)
+    {
+        LOG(LOG_INFO, "** TCP connection success!");
+    }
+    else
+    {
+        LOG(LOG_INFO, "** Cannot connect to " << mConf.address << ":" << mConf.port);
+    }
+
+    return ret;
+}
+
+bool Transport::OpenUdp()
+{
+    bool ret = false;
+
+    if (mConf.sharedPort != 0U)
+    {
+        LOG(LOG_INFO, "** Attaching " << mConf.address << ":" << mConf.port << " to UDP port " << mConf.sharedPort);
+        mUdpEndpoint = UdpEndpoint::Get(mConf.sharedPort, mReactor);
+        if (mUdpEndpoint != NULL)
+        {
+            ret = mUdpEndpoint->Attach(this, mConf.address, mConf.port, mConf.wPort);
+            if (!ret)
+            {
+                mUdpEndpoint = NULL;
+            }
+        }
+    }
+    else
+    {
+        LOG(LOG_INFO, "** Opening UDP socket to " << mConf.address << ":" << mConf.port);
+
+        struct addrinfo hints;
+        struct addrinfo *result = NULL;
+
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        hints.ai_protocol = IPPROTO_UDP;
+
+        if (getaddrinfo(mConf.address.c_str(), mConf.port.c_str(), &hints, &result) == 0)
+        {
+            for (struct addrinfo *rp = result; (rp != NULL) && !ret; rp = rp->ai_next)
+            {
+                int fd = static_cast<int>(socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol));
+                if (fd != cInvalidSocket)
+                {
+                    // Connected datagram socket: the kernel filters out the other sources
+                    if (connect(fd, rp->ai_addr, static_cast<int>(rp->ai_addrlen)) == 0)
+                    {
+                        mSocket = fd;
+                        ret = true;
+                    }
+                    else
+                    {
+                        close_socket(fd);
+                    }
+                }
+            }
+            freeaddrinfo(result);
+        }
+    }
+
+    if (ret)
+    {
+        mDatagram.resize((mConf.frameSize > 0U) ? mConf.frameSize : cMaxFrameSize);
+    }
+    else
+    {
+        LOG(LOG_INFO, "** Cannot open UDP link to " << mConf.address << ":" << mConf.port);
+    }
+
+    return ret;
+}
+
+// Only called by the protocol thread, like Send(): a link closed by the peer or failing
+// is only marked as closed by the reader, its handle is released here
+void Transport::Close()
+{
+    TransportReactor *reactor = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(mLinkMutex);
+
+        if (mOpened)
+        {
+            mOpened = false;
+            if ((mReactor != NULL) && (GetHandle() >= 0))
+            {
+                mReactor->Unwatch(GetHandle());
+            }
+
+            if (mUdpEndpoint != NULL)
+            {
+                mUdpEndpoint->Detach(this);
+                mUdpEndpoint = NULL;
+            }
+        }
+
+        if (mSocket != cInvalidSocket)
+        {
+            close_socket(mSocket);
+            mSocket = cInvalidSocket;
+        }
+
+        if (mSerialHandle >= 0)
+        {
+            serial_close(mSerialHandle);
+            mSerialHandle = -1;
+        }
+        reactor = mReactor;
+    }
+
+    // Outside of the lock: the event being dispatched may be waiting for it
+    if (reactor != NULL)
+    {
+        reactor->Barrier();
+    }
+}
+
 int Transport::Send(const std::string &data, PrintFormat format)
 {
     int ret = -1;
 
     // Print request
-    puts("====> Sending: ");
-    Printer(data.c_str(), data.size(), format);
-    puts("\r\n");
+    if (format == PRINT_RAW)
+    {
+        LOG(LOG_INFO, "====> Sending: " << data);
+    }
+    else if (format == PRINT_HEX)
+    {
+        Log::Hex(LOG_FRAME, "====> Sending: ", (const uint8_t *)data.c_str(), data.size());
+    }
 
-    if (mUseTcpGateway)
+    if (!mOpened)
+    {
+        LOG(LOG_INFO, "** Link is not opened!");
+    }
+    else if (mUdpEndpoint != NULL)
     {
-        // TODO
-      //  socket.write(data);
-      //  socket.flush();
+        ret = mUdpEndpoint->SendTo(this, data);
+    }
+    else if (mConf.type == UDP_IP)
+    {
+        // One APDU per datagram, never split
+        ret = static_cast<int>(send(mSocket, data.c_str(), static_cast<int>(data.size()), 0));
+    }
+    else if (mUseTcpGateway)
+    {
+        const char *ptr = data.c_str();
+        size_t remaining = data.size();
+
+        ret = 0;
+        while (remaining > 0U)
+        {
+            int sent = static_cast<int>(send(mSocket, ptr, static_cast<int>(remaining), 0));
+            if (sent <= 0)
+            {
+                ret = -1;
+                break;
+            }
+            ptr += sent;
+            remaining -= static_cast<size_t>(sent);
+            ret += sent;
+        }
     }
     else
     {
         ret = serial_write(mSerialHandle, data.c_str(), data.size());
     }
 
+    if (ret > 0)
+    {
+        mCapture.Write(Capture::SENT, (const uint8_t *)data.c_str(), static_cast<uint32_t>(ret));
+    }
+
     return ret;
 }
 
-bool Transport::WaitForData(std::string &data, int timeout)
+// Waits until more than 'known' bytes are readable
+bool Transport::WaitReadable(uint32_t known, uint32_t timeout)
 {
-    bool notified = mSem.wait(timeout);
+    if (mRing.Readable() > known)
+    {
+        return true;
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    std::unique_lock<std::mutex> lock(mWaitMutex);
+
+    // Announced before checking the ring again: the reader either sees the flag or
+    // has already published the bytes
+    mWaiting.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool ready = mWaitCondition.wait_until(lock, deadline, [this, known] { return mRing.Readable() > known; });
+    mWaiting.store(false);
+
+    return ready;
+}
+
+// Reader side, after publishing: the protocol thread is only signaled when it waits
+void Transport::WakeConsumer()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mWaiting.load())
+    {
+        std::lock_guard<std::mutex> lock(mWaitMutex);
+        mWaitCondition.notify_one();
+    }
+}
+
+bool Transport::WaitForMore(uint32_t known, uint32_t timeout)
+{
+    bool notified = WaitReadable(known, timeout);
+
+    if (!notified)
+    {
+        LOG(LOG_INFO, "** Read timeout!");
+    }
+    return notified;
+}
+
+uint32_t Transport::Peek(const uint8_t *&ptr)
+{
+    uint32_t size = mRing.ReadSpan(ptr);
+
+    if (size < mRing.Readable())
+    {
+        // The data wraps around the end of the ring
+        if (mLinear.empty())
+        {
+            mLinear.resize(mRing.Capacity());
+        }
+        size = mRing.Peek(ptr, &mLinear[0], static_cast<uint32_t>(mLinear.size()));
+    }
+    return size;
+}
+
+void Transport::Consume(uint32_t size)
+{
+    mRing.Consume(size);
+    ResumeReading();
+}
+
+void Transport::Flush()
+{
+    mRing.Clear();
+    ResumeReading();
+}
+
+bool Transport::WaitForData(std::string &data, uint32_t timeout)
+{
+    bool notified = WaitReadable(0U, timeout);
 
     if (!notified)
     {
-        puts("** Serial read timeout!\r\n");
+        LOG(LOG_INFO, "** Read timeout!");
     }
 
-    mMutex.lock();
-    data += mData;
-    mData.clear();
-    mMutex.unlock();
+    // Drain the ring (at most two spans when the data wraps around)
+    const uint8_t *ptr;
+    uint32_t size = mRing.ReadSpan(ptr);
+    while (size > 0U)
+    {
+        data.append(reinterpret_cast<const char *>(ptr), size);
+        mRing.Consume(size);
+        size = mRing.ReadSpan(ptr);
+    }
 
     return notified;
 }
 
 
+// IEC 62056-21 baud rate identification characters, modes C and E
+static const unsigned int cModeEBaudrates[] = { 300U, 600U, 1200U, 2400U, 4800U, 9600U, 19200U };
+static const uint32_t cModeENbBaudrates = sizeof(cModeEBaudrates) / sizeof(cModeEBaudrates[0]);
+static const uint32_t cModeEResponseTime = 2000U; // milliseconds, 1.5 s max. for the meter identification
+
+// The opening sequence is sent in 7 data bits, even parity, serial_setup() only knows 8N1
+static bool SetSevenEvenParity(int fd)
+{
+#ifdef USE_WINDOWS_OS
+    (void) fd;
+    return false;
+#else
+    bool ok = false;
+    struct termios tio;
+
+    if (tcgetattr(fd, &tio) == 0)
+    {
+        tio.c_cflag &= ~(CSIZE | PARODD);
+        tio.c_cflag |= (CS7 | PARENB);
+        ok = (tcsetattr(fd, TCSANOW, &tio) == 0);
+    }
+    return ok;
+#endif
+}
+
+// Waits until the pending output has left the UART
+static void DrainOutput(int fd)
+{
+#ifdef USE_WINDOWS_OS
+    (void) fd;
+#else
+    tcdrain(fd);
+#endif
+}
+
+bool Transport::SetupLink(unsigned int baudrate, bool sevenEven)
+{
+    std::lock_guard<std::mutex> lock(mLinkMutex);
+
+    DrainOutput(mSerialHandle);
+    bool ok = (serial_setup(mSerialHandle, baudrate) == 0);
+
+    if (ok && sevenEven && !SetSevenEvenParity(mSerialHandle))
+    {
+        LOG(LOG_INFO, "** 7E1 not available, opening sequence sent in 8N1");
+    }
+    return ok;
+}
+
+bool Transport::SignOnModeE(std::string &identification)
+{
+    bool ok = false;
+
+    if (mUseTcpGateway || !mOpened)
+    {
+        return false;
+    }
+
+    if (!SetupLink(cModeEBaudrates[0], true))
+    {
+        LOG(LOG_ERROR, "** Cannot set the serial port to 300 bauds");
+    }
+    mRing.Clear();
+
+    // Request message, then identification message: /XXXZ\2Ident CR LF
+    identification.clear();
+    if (Send("/?!\r\n", PRINT_RAW) > 0)
+    {
+        bool loop = true;
+        while (loop && (identification.find("\r\n") == std::string::npos))
+        {
+            loop = WaitForData(identification, cModeEResponseTime);
+        }
+        ok = loop;
+    }
+
+    std::string::size_type start = identification.find('/');
+    if (ok && ((start == std::string::npos) || ((identification.size() - start) < 7U)))
+    {
+        LOG(LOG_ERROR, "** Bad mode E identification: " << identification);
+        ok = false;
+    }
+
+    if (ok)
+    {
+        identification.erase(0, start);
+        uint32_t advertised = static_cast<uint32_t>(identification[4] - '0');
+
+        if ((advertised >= cModeENbBaudrates) || (identification.compare(5, 2, "\\2") != 0))
+        {
+            LOG(LOG_ERROR, "** Meter does not support mode E HDLC: " << identification);
+            ok = false;
+        }
+        else
+        {
+            // Highest rate supported by both sides
+            uint32_t index = advertised;
+            while ((index > 0U) && (cModeEBaudrates[index] > mConf.baudrate))
+            {
+                index--;
+            }
+
+            // Acknowledge: ACK, protocol control '2' (HDLC), baud rate, mode control '2' (binary)
+            std::string ack("\x06" "2");
+            ack.push_back(static_cast<char>('0' + index));
+            ack.append("2\r\n");
+
+            ok = (Send(ack, PRINT_HEX) > 0);
+            if (ok)
+            {
+                ok = SetupLink(cModeEBaudrates[index], false);
+                // The meter switches 200 to 300 ms after the acknowledge
+                std::this_thread::sleep_for(std::chrono::milliseconds(300));
+                mRing.Clear();
+                LOG(LOG_INFO, "** Mode E: switched to " << cModeEBaudrates[index] << " bauds");
+            }
+        }
+    }
+
+    return ok;
+}
+
 void Transport::WaitForStop()
 {
     mTerminate = true;
@@ -118,44 +573,305 @@ void Transport::WaitForStop()
 
 
 
+// Reads directly into the ring free room: returns the number of bytes read,
+// 0 on timeout, -1 on fatal link error. The bytes must then be published by Deliver().
+int Transport::ReadLink(uint8_t *&ptr, int timeout)
+{
+    int ret = 0;
+    uint32_t room = mRing.WriteSpan(ptr);
+
+    std::unique_lock<std::mutex> lock(mLinkMutex);
+
+    if (!mOpened || (room == 0U) || (mUdpEndpoint != NULL))
+    {
+        lock.unlock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+    }
+    else if (mConf.type == UDP_IP)
+    {
+        fd_set readfds;
+        struct timeval tv;
+
+        FD_ZERO(&readfds);
+        FD_SET(mSocket, &readfds);
+        tv.tv_sec = 0;
+        tv.tv_usec = timeout * 1000;
+
+        ret = select(mSocket + 1, &readfds, NULL, NULL, &tv);
+        if (ret > 0)
+        {
+            // The datagram may be larger than the contiguous room: read it whole aside
+            ret = static_cast<int>(recv(mSocket, (char *)&mDatagram[0], static_cast<int>(mDatagram.size()), 0));
+            if (ret < 0)
+            {
+                // ICMP port unreachable and the like: the request will be repeated
+                ret = 0;
+            }
+            ptr = &mDatagram[0];
+        }
+    }
+    else if (mUseTcpGateway)
+    {
+        fd_set readfds;
+        struct timeval tv;
+
+        FD_ZERO(&readfds);
+        FD_SET(mSocket, &readfds);
+        tv.tv_sec = 0;
+        tv.tv_usec = timeout * 1000;
+
+        ret = select(mSocket + 1, &readfds, NULL, NULL, &tv);
+        if (ret > 0)
+        {
+            ret = static_cast<int>(recv(mSocket, (char *)ptr, static_cast<int>(room), 0));
+            if (ret <= 0)
+            {
+                // Peer has closed the connection: not fatal, the next meter may use another link.
+                // The socket is closed by the protocol thread, its number cannot be reused while
+                // Send() may still use it
+                LOG(LOG_INFO, "** TCP connection closed by peer");
+                if (mReactor != NULL)
+                {
+                    mReactor->Unwatch(mSocket);
+                }
+                mOpened = false;
+                ret = 0;
+            }
+        }
+    }
+    else
+    {
+        ret = serial_read(mSerialHandle, (char *)ptr, static_cast<int>(room), timeout);
+    }
+
+    return ret;
+}
+
+int Transport::GetHandle() const
+{
+    int handle = mSerialHandle;
+
+    if (mUdpEndpoint != NULL)
+    {
+        handle = -1;
+    }
+    else if (mUseTcpGateway)
+    {
+        handle = mSocket;
+    }
+    return handle;
+}
+
+void Transport::Deliver(const uint8_t *data, int size)
+{
+    mCapture.Write(Capture::RECEIVED, data, static_cast<uint32_t>(size));
+
+    if (Log::Enabled(LOG_FRAME))
+    {
+        std::stringstream ss;
+        ss << "<==== Got data: " << size << " bytes: ";
+        Log::Hex(LOG_FRAME, ss.str(), data, size);
+    }
+
+    // Publish to the protocol thread
+    if (!mDatagram.empty() && (data == &mDatagram[0]))
+    {
+        if (mRing.Write(data, static_cast<uint32_t>(size)) != static_cast<uint32_t>(size))
+        {
+            LOG(LOG_ERROR, "** Receive buffer full, data truncated");
+        }
+    }
+    else
+    {
+        mRing.Commit(static_cast<uint32_t>(size));
+    }
+    WakeConsumer();
+}
+
+void Transport::DeliverDatagram(const uint8_t *data, uint32_t size)
+{
+    mCapture.Write(Capture::RECEIVED, data, size);
+    Push(data, size);
+}
+
+void Transport::Push(const uint8_t *data, uint32_t size)
+{
+    if (Log::Enabled(LOG_FRAME))
+    {
+        std::stringstream ss;
+        ss << "<==== Got data: " << size << " bytes: ";
+        Log::Hex(LOG_FRAME, ss.str(), data, size);
+    }
+
+    if (mRing.Write(data, size) != size)
+    {
+        LOG(LOG_ERROR, "** Receive buffer full, data truncated");
+    }
+    WakeConsumer();
+}
+
+void Transport::SetOpened(const Params &params, bool opened)
+{
+    mConf = params;
+    mOpened = opened;
+}
+
+bool Transport::StartCapture(const std::string &fileName)
+{
+    return mCapture.Open(fileName);
+}
+
 void Transport::Reader()
 {
     mStarted = true;
 
     while (!mTerminate)
     {
-        int ret = serial_read(mSerialHandle, &mRcvBuffer[0], cBufferSize, 10);
+        if (!mOpened)
+        {
+            // Not holding the ring while Open() replaces it
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mReadMutex);
+        uint8_t *data;
+        int ret = ReadLink(data, 10);
 
         if (ret > 0)
         {
-            printf("<==== Got data: %d bytes: ", ret);
-            std::string data(&mRcvBuffer[0], ret);
+            Deliver(data, ret);
+        }
+        else if (ret == 0)
+        {
+            if (mOpened && !mUseTcpGateway)
+            {
+                LOG(LOG_TRACE, "Still waiting for data...");
+            }
+        }
+        else
+        {
+            LinkFailed();
+        }
+    }
+}
 
-            Printer(data.c_str(), data.size(), PRINT_HEX);
+bool Transport::Attach(TransportReactor *reactor)
+{
+    bool ret = true;
+    std::lock_guard<std::mutex> lock(mLinkMutex);
 
-            puts("\r\n");
+    mReactor = reactor;
+    if (mOpened)
+    {
+        if (GetHandle() >= 0)
+        {
+            ret = mReactor->Watch(GetHandle(), this);
+        }
+    }
 
-            // Add data
-            mMutex.lock();
-            mData += data;
-            mMutex.unlock();
+    if (!ret)
+    {
+        // The caller falls back to the reader thread: the next links must not be watched
+        mReactor = NULL;
+    }
+    return ret;
+}
 
-            // Signal new data available
-            mSem.signal();
+void Transport::Detach()
+{
+    TransportReactor *reactor = NULL;
+
+    {
+        std::lock_guard<std::mutex> lock(mLinkMutex);
+
+        if ((mReactor != NULL) && mOpened && (GetHandle() >= 0))
+        {
+            mReactor->Unwatch(GetHandle());
         }
-        else if (ret == 0)
+        reactor = mReactor;
+        mReactor = NULL;
+    }
+
+    if (reactor != NULL)
+    {
+        reactor->Barrier();
+    }
+}
+
+// Called from the reactor thread: the link has some data, it must not block
+void Transport::OnReadable()
+{
+    std::lock_guard<std::mutex> lock(mReadMutex);
+    uint8_t *data;
+
+    if (mRing.WriteSpan(data) == 0U)
+    {
+        // Level-triggered: the handle would be reported again and again until there is room
+        PauseReading();
+        return;
+    }
+
+    int ret = ReadLink(data, 0);
+
+    if (ret > 0)
+    {
+        Deliver(data, ret);
+    }
+    else if (ret < 0)
+    {
+        LinkFailed();
+    }
+}
+
+// Reactor thread, the ring is full
+void Transport::PauseReading()
+{
+    std::lock_guard<std::mutex> lock(mLinkMutex);
+
+    if ((mReactor != NULL) && mOpened && (GetHandle() >= 0))
+    {
+        mReactor->Unwatch(GetHandle());
+        mPaused.store(true);
+
+        // The consumer may have made room before seeing the flag
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint8_t *span;
+        if ((mRing.WriteSpan(span) > 0U) && mPaused.exchange(false))
         {
-            puts("Still waiting for data...\r\n");
+            mReactor->Watch(GetHandle(), this);
         }
-        else
+    }
+}
+
+// Protocol thread, after making room in the ring
+void Transport::ResumeReading()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mPaused.load())
+    {
+        std::lock_guard<std::mutex> lock(mLinkMutex);
+        if (mPaused.exchange(false) && (mReactor != NULL) && mOpened && (GetHandle() >= 0))
         {
-            puts("Serial read error, exiting...\r\n");
-            mTerminate = true;
-            exit(1);
+            mReactor->Watch(GetHandle(), this);
         }
     }
 }
 
+// Fatal read error: only this link is lost, its session fails on the next exchange and
+// the other sessions go on. The handle is released by Close()
+void Transport::LinkFailed()
+{
+    LOG(LOG_ERROR, "** Link read error, link closed");
+
+    std::lock_guard<std::mutex> lock(mLinkMutex);
+    if ((mReactor != NULL) && mOpened && (GetHandle() >= 0))
+    {
+        mReactor->Unwatch(GetHandle());
+    }
+    mOpened = false;
+}
+
 void Transport::Start()
 {
     mThread = std::thread(Transport::EntryPoint, this);
@@ -18,7 +18,14 @@
 #include <thread>
 #include <queue>
 #include <mutex>
-#include "sema.h"
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include "ByteRing.h"
+#include "Capture.h"
+#include "TransportReactor.h"
+
+class UdpEndpoint;
 
 enum PrintFormat
 {
@@ -28,14 +35,15 @@ enum PrintFormat
 };
 
 
-class Transport
+class Transport : public TransportReactor::Handler
 {
 public:
 
     enum Type
     {
         SERIAL,
-        TCP_IP
+        TCP_IP,
+        UDP_IP
     };
 
     struct Params
@@ -43,44 +51,122 @@ public:
         Params()
             : type(SERIAL)
             , baudrate(9600)
+            , sharedPort(0U)
+            , wPort(0U)
+            , modeE(false)
+            , frameSize(0U)
         {
 
         }
+
+        bool operator==(const Params &other) const
+        {
+            return (type == other.type) &&
+                   (address == other.address) &&
+                   (port == other.port) &&
+                   (baudrate == other.baudrate) &&
+                   (sharedPort == other.sharedPort) &&
+                   (wPort == other.wPort) &&
+                   (modeE == other.modeE) &&
+                   (frameSize == other.frameSize);
+        }
+
         Type type;
-        std::string address;
-        std::string port;
-        unsigned int baudrate;
+        std::string address; // TCP/IP: host name or IP address
+        std::string port;    // Serial: device name, TCP/IP: service port
+        unsigned int baudrate; // Mode E: highest baud rate allowed after the opening sequence
+        uint16_t sharedPort; // UDP/IP: local port shared with other meters, 0 for a dedicated socket
+        uint16_t wPort;      // UDP/IP shared port: server wPort (logical device) of the session
+        bool modeE;          // Serial: IEC 62056-21 mode E opening (optical probe) before HDLC
+        uint32_t frameSize;  // Largest frame to receive whole, sizes the ring; 0 for the largest wrapper frame
     };
 
     Transport();
+    virtual ~Transport();
+
+    virtual void Start();
+    virtual void WaitForStop();
 
-    void Start();
-    void WaitForStop();
+    virtual bool Open(const Params &params);
+    virtual void Close();
+    bool IsOpen() const { return mOpened; }
+    const Params &GetParams() const { return mConf; }
+    virtual int Send(const std::string &data, PrintFormat format);
+    bool WaitForData(std::string &data, uint32_t timeout); // timeouts in milliseconds
 
-    bool Open(const Params &params);
-    int Send(const std::string &data, PrintFormat format);
-    bool WaitForData(std::string &data, int timeout);
+    // IEC 62056-21 mode E: sign-on at 300 bauds then switch to the HDLC baud rate
+    bool SignOnModeE(std::string &identification);
+
+    // Zero-copy reception: parse the received bytes in place, then consume them
+    bool WaitForMore(uint32_t known, uint32_t timeout);
+    uint32_t Peek(const uint8_t *&ptr);
+    uint32_t Readable() const { return mRing.Readable(); }
+    void Consume(uint32_t size);
+    void Flush();
 
     static void Printer(const char *text, int size, PrintFormat format);
 
+    // Called by the shared UDP endpoint reader, one call per datagram
+    void DeliverDatagram(const uint8_t *data, uint32_t size);
+
+    // Records every chunk sent and received until the transport is destroyed
+    bool StartCapture(const std::string &fileName);
+
+protected:
+    // For the transports without a real link
+    void SetOpened(const Params &params, bool opened);
+    void Push(const uint8_t *data, uint32_t size);
+
 private:
+    friend class TransportReactor;
 
-    static const uint32_t cBufferSize = 40U*1024U;
-    char mRcvBuffer[cBufferSize];
+    // Wrapper frame of the largest APDU (65535 bytes) and its header
+    static const uint32_t cMaxFrameSize = 0xFFFFU + 8U;
+    ByteRing mRing; // Reader (producer) to protocol thread (consumer)
+    std::vector<uint8_t> mLinear; // Consumer side, allocated when the data first wraps around the ring
+    std::mutex mReadMutex; // Producer side of the ring: held while a chunk is read and published
 
     bool mStarted;
     Params mConf;
-    bool mUseTcpGateway;
+    bool mUseTcpGateway; // Socket gateway (TCP or UDP), otherwise serial port
     int mSerialHandle;
+    int mSocket;
+    UdpEndpoint *mUdpEndpoint; // Shared UDP socket, NULL for a dedicated socket
+    std::vector<uint8_t> mDatagram; // A datagram is read whole, then copied into the ring
+    std::atomic<bool> mOpened;
     bool mTerminate;
-    std::string mData;
+
+    // The protocol thread sleeps until the reader has delivered what it waits for
+    std::mutex mWaitMutex;
+    std::condition_variable mWaitCondition;
+    std::atomic<bool> mWaiting;
 
     std::thread mThread;
-    Semaphore mSem;
-    std::mutex mMutex;
+    std::mutex mLinkMutex; // Protects the handles against a concurrent Open/Close
+    TransportReactor *mReactor;
+    std::atomic<bool> mPaused; // Ring full: the handle is not watched until the consumer makes room
+    Capture mCapture;
 
     static void EntryPoint(void *pthis);
+    static uint32_t RingSize(uint32_t frameSize);
     void Reader();
+    bool OpenSerial();
+    bool OpenTcp();
+    bool OpenUdp();
+    int ReadLink(uint8_t *&ptr, int timeout);
+    virtual int GetHandle() const;
+    virtual bool SetupLink(unsigned int baudrate, bool sevenEven);
+    void Deliver(const uint8_t *data, int size);
+    void LinkFailed();
+    bool WaitReadable(uint32_t known, uint32_t timeout);
+    void WakeConsumer();
+
+    // Reactor interface
+    bool Attach(TransportReactor *reactor);
+    void Detach();
+    virtual void OnReadable();
+    void PauseReading();
+    void ResumeReading();
 };
 
 
@@ -0,0 +1,219 @@
+/**
+ * Event-driven reactor shared by all the transports of the process
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <iostream>
+#include "TransportReactor.h"
+#include "Transport.h"
+#include "Log.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#define HAS_EPOLL
+#endif
+
+TransportReactor::TransportReactor()
+    : mEpollHandle(-1)
+    , mWakeHandle(-1)
+    , mTerminate(false)
+    , mStarted(false)
+    , mLoops(0U)
+    , mRunning(false)
+{
+
+}
+
+TransportReactor::~TransportReactor()
+{
+    Stop();
+}
+
+bool TransportReactor::Start()
+{
+#ifdef HAS_EPOLL
+    if (!mStarted)
+    {
+        mEpollHandle = epoll_create1(EPOLL_CLOEXEC);
+        mWakeHandle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if ((mEpollHandle >= 0) && (mWakeHandle >= 0))
+        {
+            // The wake-up event has no handler attached
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = NULL;
+
+            if (epoll_ctl(mEpollHandle, EPOLL_CTL_ADD, mWakeHandle, &ev) == 0)
+            {
+                mTerminate = false;
+                mRunning = true;
+                mThread = std::thread(&TransportReactor::Loop, this);
+                mStarted = true;
+            }
+        }
+
+        if (!mStarted)
+        {
+            LOG(LOG_ERROR, "** Cannot start transport reactor");
+            Stop();
+        }
+    }
+#endif
+    return mStarted;
+}
+
+void TransportReactor::Stop()
+{
+#ifdef HAS_EPOLL
+    if (mStarted)
+    {
+        uint64_t value = 1U;
+        mTerminate = true;
+        if (write(mWakeHandle, &value, sizeof(value)) > 0)
+        {
+            mThread.join();
+        }
+        else
+        {
+            mThread.detach();
+        }
+        mStarted = false;
+    }
+
+    if (mWakeHandle >= 0)
+    {
+        close(mWakeHandle);
+        mWakeHandle = -1;
+    }
+
+    if (mEpollHandle >= 0)
+    {
+        close(mEpollHandle);
+        mEpollHandle = -1;
+    }
+#endif
+}
+
+bool TransportReactor::Register(Transport &transport)
+{
+    bool ret = false;
+
+    if (mStarted)
+    {
+        ret = transport.Attach(this);
+    }
+    return ret;
+}
+
+void TransportReactor::Unregister(Transport &transport)
+{
+    transport.Detach();
+}
+
+bool TransportReactor::Watch(int handle, Handler *handler)
+{
+    bool ret = false;
+#ifdef HAS_EPOLL
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = handler;
+
+    ret = (epoll_ctl(mEpollHandle, EPOLL_CTL_ADD, handle, &ev) == 0);
+#else
+    (void) handle;
+    (void) handler;
+#endif
+    return ret;
+}
+
+void TransportReactor::Unwatch(int handle)
+{
+#ifdef HAS_EPOLL
+    struct epoll_event ev; // Unused, but required by old kernels
+    (void) epoll_ctl(mEpollHandle, EPOLL_CTL_DEL, handle, &ev);
+#else
+    (void) handle;
+#endif
+}
+
+void TransportReactor::Barrier()
+{
+    std::unique_lock<std::mutex> lock(mLoopMutex);
+
+    if (mRunning && (std::this_thread::get_id() != mThread.get_id()))
+    {
+        // The loop in progress may hold an event of the unwatched handle, the next one cannot
+        uint64_t loops = mLoops;
+        Wake();
+        mLoopCondition.wait(lock, [this, loops] { return (mLoops != loops) || !mRunning; });
+    }
+}
+
+void TransportReactor::Wake()
+{
+#ifdef HAS_EPOLL
+    uint64_t value = 1U;
+    if (write(mWakeHandle, &value, sizeof(value)) < 0)
+    {
+        LOG(LOG_ERROR, "** Cannot wake the transport reactor up");
+    }
+#endif
+}
+
+void TransportReactor::Loop()
+{
+#ifdef HAS_EPOLL
+    struct epoll_event events[cMaxEvents];
+
+    while (!mTerminate)
+    {
+        int nb = epoll_wait(mEpollHandle, &events[0], cMaxEvents, -1);
+
+        if (nb < 0)
+        {
+            if (errno != EINTR)
+            {
+                LOG(LOG_ERROR, "** Transport reactor failure, exiting...");
+                mTerminate = true;
+            }
+        }
+
+        for (int i = 0; i < nb; i++)
+        {
+            Handler *handler = static_cast<Handler *>(events[i].data.ptr);
+
+            if (handler != NULL)
+            {
+                handler->OnReadable();
+            }
+            else
+            {
+                // Wake-up event, level-triggered: reset the counter
+                uint64_t value;
+                if (read(mWakeHandle, &value, sizeof(value)) < 0)
+                {
+                    LOG(LOG_ERROR, "** Cannot reset the transport reactor wake-up");
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mLoopMutex);
+        mLoops++;
+        mLoopCondition.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(mLoopMutex);
+    mRunning = false;
+    mLoopCondition.notify_all();
+#endif
+}
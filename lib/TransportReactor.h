@@ -0,0 +1,79 @@
+/**
+ * Event-driven reactor shared by all the transports of the process
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef TRANSPORT_REACTOR_H
+#define TRANSPORT_REACTOR_H
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+class Transport;
+
+/**
+ * One thread waits on the readiness of every registered serial port and socket
+ * (epoll) and dispatches the events to the owning Transport or shared UDP
+ * endpoint, instead of one polling reader thread per Transport.
+ *
+ * Only available on Linux; Start() returns false elsewhere and the sessions
+ * fall back to Transport::Start().
+ */
+class TransportReactor
+{
+public:
+    // Owner of a watched handle, called from the reactor thread: it must not block
+    class Handler
+    {
+    public:
+        virtual ~Handler() {}
+        virtual void OnReadable() = 0;
+    };
+
+    TransportReactor();
+    ~TransportReactor();
+
+    bool Start();
+    void Stop();
+
+    // Registered transports are watched each time they open a link
+    bool Register(Transport &transport);
+    void Unregister(Transport &transport);
+
+    // Called by the transports when their link is opened or closed, and by the shared UDP endpoints
+    bool Watch(int handle, Handler *handler);
+    void Unwatch(int handle);
+
+    // Waits for the end of the events being dispatched: a handler whose handle has been
+    // unwatched is not called any more and may be destroyed. Not to be called by a handler
+    void Barrier();
+
+private:
+    static const int cMaxEvents = 64;
+
+    int mEpollHandle;
+    int mWakeHandle;
+    std::atomic<bool> mTerminate;
+    bool mStarted;
+    std::thread mThread;
+
+    // Dispatch loops completed, for Barrier()
+    std::mutex mLoopMutex;
+    std::condition_variable mLoopCondition;
+    uint64_t mLoops;
+    bool mRunning;
+
+    void Loop();
+    void Wake();
+};
+
+#endif // TRANSPORT_REACTOR_H
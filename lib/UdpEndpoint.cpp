@@ -0,0 +1,285 @@
+/**
+ * UDP socket shared by several meters, demultiplexed by source address and wPort
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include "UdpEndpoint.h"
+#include "Transport.h"
+#include "Sockets.h"
+#include "Log.h"
+
+static std::mutex gEndpointsMutex;
+static std::map<uint16_t, UdpEndpoint *> gEndpoints;
+
+// Numeric "address:port" string, identical for the resolved and the received addresses
+static std::string AddressKey(const struct sockaddr *addr, socklen_t len)
+{
+    char host[NI_MAXHOST];
+    char serv[NI_MAXSERV];
+    std::string key;
+
+    if (getnameinfo(addr, len, host, sizeof(host), serv, sizeof(serv), NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+    {
+        key = std::string(host) + ":" + std::string(serv);
+    }
+    return key;
+}
+
+// Several sessions may reach the same meter, each one with its own logical device
+static std::string RouteKey(const std::string &peer, uint16_t wPort)
+{
+    std::stringstream ss;
+    ss << peer << "/" << wPort;
+    return ss.str();
+}
+
+// IEC 62056-47 wrapper header: version, source wPort, destination wPort, length
+static const uint32_t cWrapperHeaderSize = 8U;
+
+#ifdef MSG_DONTWAIT
+static const int cNoWait = MSG_DONTWAIT;
+#else
+static const int cNoWait = 0;
+#endif
+
+UdpEndpoint::UdpEndpoint()
+    : mSocket(cInvalidSocket)
+    , mTerminate(false)
+    , mReactor(NULL)
+{
+
+}
+
+UdpEndpoint *UdpEndpoint::Get(uint16_t localPort, TransportReactor *reactor)
+{
+    std::lock_guard<std::mutex> lock(gEndpointsMutex);
+    UdpEndpoint *endpoint = NULL;
+
+    std::map<uint16_t, UdpEndpoint *>::iterator iter = gEndpoints.find(localPort);
+    if (iter != gEndpoints.end())
+    {
+        endpoint = iter->second;
+    }
+    else
+    {
+        std::unique_ptr<UdpEndpoint> created(new UdpEndpoint());
+        if (created->Open(localPort, reactor))
+        {
+            endpoint = created.release();
+            gEndpoints[localPort] = endpoint;
+        }
+    }
+    return endpoint;
+}
+
+void UdpEndpoint::CloseAll()
+{
+    std::lock_guard<std::mutex> lock(gEndpointsMutex);
+
+    for (std::map<uint16_t, UdpEndpoint *>::iterator iter = gEndpoints.begin(); iter != gEndpoints.end(); ++iter)
+    {
+        iter->second->Close();
+        delete iter->second;
+    }
+    gEndpoints.clear();
+}
+
+bool UdpEndpoint::Open(uint16_t localPort, TransportReactor *reactor)
+{
+    bool ret = false;
+
+    // IPv6 socket accepting IPv4-mapped addresses as well
+    int fd = static_cast<int>(socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP));
+    if (fd != cInvalidSocket)
+    {
+        int off = 0;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, (const char *)&off, sizeof(off));
+
+        struct sockaddr_in6 local;
+        std::memset(&local, 0, sizeof(local));
+        local.sin6_family = AF_INET6;
+        local.sin6_addr = in6addr_any;
+        local.sin6_port = htons(localPort);
+
+        if (bind(fd, (const struct sockaddr *)&local, sizeof(local)) == 0)
+        {
+            mSocket = fd;
+            mTerminate = false;
+            if ((reactor != NULL) && reactor->Watch(mSocket, this))
+            {
+                mReactor = reactor;
+            }
+            else
+            {
+                mThread = std::thread(&UdpEndpoint::Reader, this);
+            }
+            ret = true;
+            LOG(LOG_INFO, "** Shared UDP endpoint listening on port " << localPort);
+        }
+        else
+        {
+            close_socket(fd);
+        }
+    }
+
+    if (!ret)
+    {
+        LOG(LOG_ERROR, "** Cannot open shared UDP endpoint on port " << localPort);
+    }
+    return ret;
+}
+
+// No event of this endpoint is dispatched any more once the socket is unwatched
+void UdpEndpoint::Close()
+{
+    if (mReactor != NULL)
+    {
+        mReactor->Unwatch(mSocket);
+        mReactor->Barrier();
+        mReactor = NULL;
+    }
+    mTerminate = true;
+    if (mThread.joinable())
+    {
+        mThread.join();
+    }
+    if (mSocket != cInvalidSocket)
+    {
+        close_socket(mSocket);
+        mSocket = cInvalidSocket;
+    }
+}
+
+bool UdpEndpoint::Attach(Transport *transport, const std::string &address, const std::string &port, uint16_t wPort)
+{
+    bool ret = false;
+    struct addrinfo hints;
+    struct addrinfo *result = NULL;
+
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET6;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_V4MAPPED | AI_ALL;
+
+    if (getaddrinfo(address.c_str(), port.c_str(), &hints, &result) == 0)
+    {
+        Peer peer;
+        peer.key = RouteKey(AddressKey(result->ai_addr, static_cast<socklen_t>(result->ai_addrlen)), wPort);
+        peer.address.assign((const char *)result->ai_addr, result->ai_addrlen);
+        freeaddrinfo(result);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mRoutes.find(peer.key) == mRoutes.end())
+        {
+            mRoutes[peer.key] = transport;
+            mPeers[transport] = peer;
+            ret = true;
+        }
+        else
+        {
+            LOG(LOG_ERROR, "** UDP peer and wPort " << peer.key << " already in use by another session");
+        }
+    }
+    else
+    {
+        LOG(LOG_ERROR, "** Cannot resolve UDP peer " << address << ":" << port);
+    }
+    return ret;
+}
+
+void UdpEndpoint::Detach(Transport *transport)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::map<Transport *, Peer>::iterator iter = mPeers.find(transport);
+    if (iter != mPeers.end())
+    {
+        mRoutes.erase(iter->second.key);
+        mPeers.erase(iter);
+    }
+}
+
+int UdpEndpoint::SendTo(Transport *transport, const std::string &data)
+{
+    int ret = -1;
+    std::string address;
+
+    mMutex.lock();
+    std::map<Transport *, Peer>::iterator iter = mPeers.find(transport);
+    if (iter != mPeers.end())
+    {
+        address = iter->second.address;
+    }
+    mMutex.unlock();
+
+    if (address.size() > 0U)
+    {
+        ret = static_cast<int>(sendto(mSocket, data.c_str(), static_cast<int>(data.size()), 0,
+                                      (const struct sockaddr *)address.data(), static_cast<socklen_t>(address.size())));
+    }
+    return ret;
+}
+
+// Fallback without reactor
+void UdpEndpoint::Reader()
+{
+    while (!mTerminate)
+    {
+        fd_set readfds;
+        struct timeval tv;
+
+        FD_ZERO(&readfds);
+        FD_SET(mSocket, &readfds);
+        tv.tv_sec = 0;
+        tv.tv_usec = 10000;
+
+        if (select(mSocket + 1, &readfds, NULL, NULL, &tv) > 0)
+        {
+            Receive(0);
+        }
+    }
+}
+
+// Called from the reactor thread: one datagram per event, the others are reported again
+void UdpEndpoint::OnReadable()
+{
+    Receive(cNoWait);
+}
+
+void UdpEndpoint::Receive(int flags)
+{
+    struct sockaddr_storage from;
+    socklen_t fromLen = sizeof(from);
+    int size = static_cast<int>(recvfrom(mSocket, (char *)&mBuffer[0], cMaxDatagramSize, flags, (struct sockaddr *)&from, &fromLen));
+
+    if (size >= static_cast<int>(cWrapperHeaderSize))
+    {
+        // Routed by the source wPort of the wrapper header
+        uint16_t wPort = static_cast<uint16_t>((mBuffer[2] << 8U) | mBuffer[3]);
+        std::string key = RouteKey(AddressKey((const struct sockaddr *)&from, fromLen), wPort);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::map<std::string, Transport *>::iterator iter = mRoutes.find(key);
+        if (iter != mRoutes.end())
+        {
+            iter->second->DeliverDatagram(&mBuffer[0], static_cast<uint32_t>(size));
+        }
+        else
+        {
+            LOG(LOG_TRACE, "** UDP datagram from unknown peer " << key << " dropped");
+        }
+    }
+    else if (size > 0)
+    {
+        LOG(LOG_TRACE, "** UDP datagram without wrapper header dropped");
+    }
+}
@@ -0,0 +1,68 @@
+/**
+ * UDP socket shared by several meters, demultiplexed by source address and wPort
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef UDP_ENDPOINT_H
+#define UDP_ENDPOINT_H
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include "TransportReactor.h"
+
+class Transport;
+
+/**
+ * One local UDP port: each datagram is routed to the Transport attached to its
+ * source address and source wPort (the logical device of the session). The
+ * socket is watched by the reactor when there is one, otherwise read by its own
+ * thread. Endpoints are created on demand, one per local port, and live until
+ * CloseAll().
+ */
+class UdpEndpoint : public TransportReactor::Handler
+{
+public:
+    static UdpEndpoint *Get(uint16_t localPort, TransportReactor *reactor);
+    static void CloseAll();
+
+    bool Attach(Transport *transport, const std::string &address, const std::string &port, uint16_t wPort);
+    void Detach(Transport *transport);
+    int SendTo(Transport *transport, const std::string &data);
+
+private:
+    static const uint32_t cMaxDatagramSize = 65536U;
+
+    struct Peer
+    {
+        std::string key;     // Route: peer address and wPort
+        std::string address; // struct sockaddr_storage contents
+    };
+
+    int mSocket;
+    std::atomic<bool> mTerminate;
+    std::thread mThread;
+    TransportReactor *mReactor; // NULL when read by mThread
+    std::mutex mMutex; // Protects the routes
+    std::map<std::string, Transport *> mRoutes;
+    std::map<Transport *, Peer> mPeers;
+    uint8_t mBuffer[cMaxDatagramSize];
+
+    UdpEndpoint();
+    bool Open(uint16_t localPort, TransportReactor *reactor);
+    void Close();
+    void Reader();
+    void Receive(int flags);
+    virtual void OnReadable();
+};
+
+#endif // UDP_ENDPOINT_H
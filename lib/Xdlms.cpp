@@ -0,0 +1,515 @@
+/**
+ * xDLMS APDU parts not handled by the Cosem library: InitiateRequest/Response
+ * fields of the association, GET-Request/Response-With-List and General-Block-Transfer
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include "Xdlms.h"
+#include <cstring>
+
+static const uint8_t cAarqTag = 0x60U;
+static const uint8_t cAareTag = 0x61U;
+static const uint8_t cUserInformationTag = 0xBEU;
+static const uint8_t cOctetStringTag = 0x04U;
+static const uint8_t cInitiateRequestTag = 0x01U;
+static const uint8_t cInitiateResponseTag = 0x08U;
+static const uint8_t cConformanceTag[] = { 0x5FU, 0x1FU, 0x04U, 0x00U }; // [APPLICATION 31], length, unused bits
+
+static const uint8_t cGetRequestTag = 0xC0U;
+static const uint8_t cGetResponseTag = 0xC4U;
+static const uint8_t cNormal = 0x01U;
+static const uint8_t cNext = 0x02U;
+static const uint8_t cWithList = 0x03U;
+static const uint8_t cAccessByEntry = 0x02U;
+static const uint8_t cGeneralBlockTransferTag = 0xE0U;
+static const uint32_t cGeneralBlockHeaderSize = 6U; // Tag, block control, block number, acknowledged block
+
+// BER length; returns the number of bytes of the length field, 0 if invalid
+static uint32_t BerLength(const uint8_t *data, uint32_t size, uint32_t &length)
+{
+    if (size == 0U)
+    {
+        return 0U;
+    }
+    if (data[0] < 0x80U)
+    {
+        length = data[0];
+        return 1U;
+    }
+
+    uint32_t bytes = data[0] & 0x7FU;
+    if ((bytes == 0U) || (bytes > 2U) || (size < (bytes + 1U)))
+    {
+        return 0U;
+    }
+    length = 0U;
+    for (uint32_t i = 1U; i <= bytes; i++)
+    {
+        length = (length << 8U) | data[i];
+    }
+    return bytes + 1U;
+}
+
+// A-XDR length (same encoding as BER, up to 4 bytes)
+static uint32_t AxdrLength(const uint8_t *data, uint32_t size, uint32_t &length)
+{
+    if ((size > 0U) && (data[0] >= 0x80U) && ((data[0] & 0x7FU) <= 4U) && (size > (data[0] & 0x7FU)))
+    {
+        uint32_t bytes = data[0] & 0x7FU;
+        length = 0U;
+        for (uint32_t i = 1U; i <= bytes; i++)
+        {
+            length = (length << 8U) | data[i];
+        }
+        return bytes + 1U;
+    }
+    return BerLength(data, size, length);
+}
+
+static uint32_t EncodeAxdrLength(uint8_t *buf, uint32_t length)
+{
+    if (length < 0x80U)
+    {
+        buf[0] = static_cast<uint8_t>(length);
+        return 1U;
+    }
+    buf[0] = 0x82U;
+    buf[1] = static_cast<uint8_t>(length >> 8U);
+    buf[2] = static_cast<uint8_t>(length);
+    return 3U;
+}
+
+// Position of the xDLMS APDU inside the user-information of an AARQ or AARE
+static const uint8_t *FindInitiate(const uint8_t *apdu, uint32_t size, uint32_t &initiateSize)
+{
+    uint32_t length;
+    uint32_t pos;
+
+    if ((size < 2U) || ((apdu[0] != cAarqTag) && (apdu[0] != cAareTag)))
+    {
+        return NULL;
+    }
+    pos = 1U + BerLength(&apdu[1], size - 1U, length);
+    if ((pos == 1U) || ((pos + length) > size))
+    {
+        return NULL;
+    }
+    size = pos + length;
+
+    // Walk the components of the association APDU
+    while ((pos + 2U) <= size)
+    {
+        uint8_t tag = apdu[pos];
+        uint32_t header = BerLength(&apdu[pos + 1U], size - pos - 1U, length);
+        if ((header == 0U) || ((pos + 1U + header + length) > size))
+        {
+            return NULL;
+        }
+
+        const uint8_t *value = &apdu[pos + 1U + header];
+        if ((tag == cUserInformationTag) && (length > 2U) && (value[0] == cOctetStringTag))
+        {
+            uint32_t inner;
+            uint32_t innerHeader = BerLength(&value[1], length - 1U, inner);
+            if ((innerHeader == 0U) || ((1U + innerHeader + inner) > length))
+            {
+                return NULL;
+            }
+            initiateSize = inner;
+            return &value[1U + innerHeader];
+        }
+        pos += 1U + header + length;
+    }
+    return NULL;
+}
+
+// Offset of the conformance tag inside the InitiateRequest/Response, 0 if not found
+static uint32_t FindConformance(const uint8_t *initiate, uint32_t size)
+{
+    uint32_t pos = 1U;
+
+    if ((size < 1U) || ((initiate[0] != cInitiateRequestTag) && (initiate[0] != cInitiateResponseTag)))
+    {
+        return 0U;
+    }
+
+    if (initiate[0] == cInitiateRequestTag)
+    {
+        // dedicated-key OPTIONAL
+        if ((pos < size) && (initiate[pos] != 0U))
+        {
+            if ((pos + 1U) >= size)
+            {
+                return 0U;
+            }
+            pos += 1U + initiate[pos + 1U];
+        }
+        pos++;
+        // response-allowed DEFAULT TRUE
+        if ((pos < size) && (initiate[pos] != 0U))
+        {
+            pos++;
+        }
+        pos++;
+    }
+
+    // proposed/negotiated-quality-of-service OPTIONAL
+    if ((pos < size) && (initiate[pos] != 0U))
+    {
+        pos++;
+    }
+    pos++;
+
+    // dlms-version-number, then conformance, then max receive PDU size
+    pos++;
+    if ((pos + sizeof(cConformanceTag) + 3U + 2U) > size)
+    {
+        return 0U;
+    }
+    for (uint32_t i = 0U; i < sizeof(cConformanceTag); i++)
+    {
+        if (initiate[pos + i] != cConformanceTag[i])
+        {
+            return 0U;
+        }
+    }
+    return pos;
+}
+
+bool Xdlms::DecodeInitiate(const uint8_t *apdu, uint32_t size, Context &context)
+{
+    uint32_t initiateSize;
+    const uint8_t *initiate = FindInitiate(apdu, size, initiateSize);
+    uint32_t pos = (initiate != NULL) ? FindConformance(initiate, initiateSize) : 0U;
+
+    if (pos == 0U)
+    {
+        return false;
+    }
+
+    const uint8_t *conformance = &initiate[pos + sizeof(cConformanceTag)];
+    context.conformance = (static_cast<uint32_t>(conformance[0]) << 16U) |
+                          (static_cast<uint32_t>(conformance[1]) << 8U) | conformance[2];
+    context.maxPdu = static_cast<uint16_t>((conformance[3] << 8U) | conformance[4]);
+    return true;
+}
+
+bool Xdlms::PatchInitiateRequest(uint8_t *apdu, uint32_t size, const Context &context)
+{
+    uint32_t initiateSize;
+    const uint8_t *initiate = FindInitiate(apdu, size, initiateSize);
+    uint32_t pos = (initiate != NULL) ? FindConformance(initiate, initiateSize) : 0U;
+
+    if ((pos == 0U) || (initiate[0] != cInitiateRequestTag))
+    {
+        return false;
+    }
+
+    uint8_t *conformance = &apdu[(initiate - apdu) + pos + sizeof(cConformanceTag)];
+    conformance[0] = static_cast<uint8_t>(context.conformance >> 16U);
+    conformance[1] = static_cast<uint8_t>(context.conformance >> 8U);
+    conformance[2] = static_cast<uint8_t>(context.conformance);
+    conformance[3] = static_cast<uint8_t>(context.maxPdu >> 8U);
+    conformance[4] = static_cast<uint8_t>(context.maxPdu);
+    return true;
+}
+
+static uint32_t WriteBe32(uint8_t *buf, uint32_t value)
+{
+    buf[0] = static_cast<uint8_t>(value >> 24U);
+    buf[1] = static_cast<uint8_t>(value >> 16U);
+    buf[2] = static_cast<uint8_t>(value >> 8U);
+    buf[3] = static_cast<uint8_t>(value);
+    return 4U;
+}
+
+uint32_t Xdlms::EncodeGetNext(uint8_t *buf, uint32_t size, uint8_t invokeId, uint32_t block)
+{
+    if (size < cGetNextSize)
+    {
+        return 0U;
+    }
+
+    buf[0] = cGetRequestTag;
+    buf[1] = cNext;
+    buf[2] = invokeId;
+    WriteBe32(&buf[3], block);
+    return cGetNextSize;
+}
+
+uint32_t Xdlms::EncodeGetByEntry(uint8_t *buf, uint32_t size, uint8_t invokeId, const AttributeDescriptor &item,
+                                 uint32_t fromEntry, uint32_t toEntry, uint16_t fromColumn, uint16_t toColumn)
+{
+    static const uint32_t cSize = 3U + 9U + 2U + 2U + (2U * 5U) + (2U * 3U);
+
+    if (size < cSize)
+    {
+        return 0U;
+    }
+
+    uint32_t i = 0U;
+    buf[i++] = cGetRequestTag;
+    buf[i++] = cNormal;
+    buf[i++] = invokeId;
+    buf[i++] = static_cast<uint8_t>(item.classId >> 8U);
+    buf[i++] = static_cast<uint8_t>(item.classId);
+    for (uint32_t j = 0U; j < 6U; j++)
+    {
+        buf[i++] = item.obis[j];
+    }
+    buf[i++] = static_cast<uint8_t>(item.attribute);
+
+    // Access selection present, entry_descriptor structure
+    buf[i++] = 1U;
+    buf[i++] = cAccessByEntry;
+    buf[i++] = 2U;
+    buf[i++] = 4U;
+    buf[i++] = 6U; // double-long-unsigned
+    i += WriteBe32(&buf[i], fromEntry);
+    buf[i++] = 6U;
+    i += WriteBe32(&buf[i], toEntry);
+    buf[i++] = 18U; // long-unsigned
+    buf[i++] = static_cast<uint8_t>(fromColumn >> 8U);
+    buf[i++] = static_cast<uint8_t>(fromColumn);
+    buf[i++] = 18U;
+    buf[i++] = static_cast<uint8_t>(toColumn >> 8U);
+    buf[i++] = static_cast<uint8_t>(toColumn);
+    return i;
+}
+
+uint32_t Xdlms::EncodeGeneralBlock(uint8_t *buf, uint32_t size, uint8_t control, uint16_t number, uint16_t ack,
+                                   const uint8_t *data, uint32_t dataSize)
+{
+    if ((dataSize > 0xFFFFU) || (size < (cGeneralBlockHeaderSize + 3U + dataSize)))
+    {
+        return 0U;
+    }
+
+    buf[0] = cGeneralBlockTransferTag;
+    buf[1] = control;
+    buf[2] = static_cast<uint8_t>(number >> 8U);
+    buf[3] = static_cast<uint8_t>(number);
+    buf[4] = static_cast<uint8_t>(ack >> 8U);
+    buf[5] = static_cast<uint8_t>(ack);
+
+    uint32_t pos = cGeneralBlockHeaderSize;
+    pos += EncodeAxdrLength(&buf[pos], dataSize);
+    if (dataSize > 0U)
+    {
+        std::memcpy(&buf[pos], data, dataSize);
+    }
+    return pos + dataSize;
+}
+
+bool Xdlms::DecodeGeneralBlock(const uint8_t *apdu, uint32_t size, GeneralBlock &block)
+{
+    if ((size <= cGeneralBlockHeaderSize) || (apdu[0] != cGeneralBlockTransferTag))
+    {
+        return false;
+    }
+
+    uint32_t length = 0U;
+    uint32_t bytes = AxdrLength(&apdu[cGeneralBlockHeaderSize], size - cGeneralBlockHeaderSize, length);
+    uint32_t pos = cGeneralBlockHeaderSize + bytes;
+
+    if ((bytes == 0U) || ((size - pos) < length))
+    {
+        return false;
+    }
+
+    block.control = apdu[1];
+    block.number = static_cast<uint16_t>((apdu[2] << 8U) | apdu[3]);
+    block.ack = static_cast<uint16_t>((apdu[4] << 8U) | apdu[5]);
+    block.data = &apdu[pos];
+    block.size = length;
+    return true;
+}
+
+uint32_t Xdlms::EncodeGetWithList(uint8_t *buf, uint32_t size, uint8_t invokeId, const std::vector<AttributeDescriptor> &items)
+{
+    static const uint32_t cItemSize = 2U + 6U + 1U + 1U; // class, instance, attribute, no access selection
+
+    if (size < (3U + 3U + (items.size() * cItemSize)))
+    {
+        return 0U;
+    }
+
+    uint32_t i = 0U;
+    buf[i++] = cGetRequestTag;
+    buf[i++] = cWithList;
+    buf[i++] = invokeId;
+    i += EncodeAxdrLength(&buf[i], static_cast<uint32_t>(items.size()));
+
+    for (uint32_t k = 0U; k < items.size(); k++)
+    {
+        buf[i++] = static_cast<uint8_t>(items[k].classId >> 8U);
+        buf[i++] = static_cast<uint8_t>(items[k].classId);
+        for (uint32_t j = 0U; j < 6U; j++)
+        {
+            buf[i++] = items[k].obis[j];
+        }
+        buf[i++] = static_cast<uint8_t>(items[k].attribute);
+        buf[i++] = 0U;
+    }
+    return i;
+}
+
+bool Xdlms::GetResponseInvokeId(const uint8_t *apdu, uint32_t size, uint8_t &invokeId)
+{
+    if ((size < 3U) || (apdu[0] != cGetResponseTag))
+    {
+        return false;
+    }
+    invokeId = apdu[2];
+    return true;
+}
+
+bool Xdlms::DecodeGetWithList(const uint8_t *apdu, uint32_t size, std::vector<ListItem> &items)
+{
+    items.clear();
+    if ((size < 4U) || (apdu[0] != cGetResponseTag) || (apdu[1] != cWithList))
+    {
+        return false;
+    }
+
+    return DecodeDataResults(&apdu[3], size - 3U, items);
+}
+
+bool Xdlms::DecodeDataResults(const uint8_t *apdu, uint32_t size, std::vector<ListItem> &items)
+{
+    uint32_t count;
+
+    items.clear();
+    uint32_t pos = 0U;
+    uint32_t header = AxdrLength(&apdu[pos], size - pos, count);
+    if (header == 0U)
+    {
+        return false;
+    }
+    pos += header;
+
+    for (uint32_t k = 0U; k < count; k++)
+    {
+        ListItem item;
+
+        if ((pos + 2U) > size)
+        {
+            return false;
+        }
+        if (apdu[pos] == 0U)
+        {
+            // data
+            item.result = 0U;
+            item.data = &apdu[pos + 1U];
+            item.size = DataSize(item.data, size - pos - 1U);
+            if (item.size == 0U)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            // data-access-result
+            item.result = apdu[pos + 1U];
+            item.data = NULL;
+            item.size = 1U;
+        }
+        pos += 1U + item.size;
+        items.push_back(item);
+    }
+    return true;
+}
+
+uint32_t Xdlms::DataSize(const uint8_t *data, uint32_t size)
+{
+    if (size == 0U)
+    {
+        return 0U;
+    }
+
+    uint32_t fixed = 0U;
+    switch (data[0])
+    {
+    case 0U:   // null-data
+    case 255U: // dont-care
+        return 1U;
+    case 3U:   // boolean
+    case 13U:  // bcd
+    case 15U:  // integer
+    case 17U:  // unsigned
+    case 22U:  // enum
+        fixed = 1U;
+        break;
+    case 16U:  // long
+    case 18U:  // long-unsigned
+        fixed = 2U;
+        break;
+    case 5U:   // double-long
+    case 6U:   // double-long-unsigned
+    case 23U:  // float32
+    case 27U:  // time
+        fixed = 4U;
+        break;
+    case 26U:  // date
+        fixed = 5U;
+        break;
+    case 20U:  // long64
+    case 21U:  // long64-unsigned
+    case 24U:  // float64
+        fixed = 8U;
+        break;
+    case 25U:  // date-time
+        fixed = 12U;
+        break;
+    case 1U:   // array
+    case 2U:   // structure
+    {
+        uint32_t count;
+        uint32_t pos = 1U;
+        uint32_t header = AxdrLength(&data[pos], size - pos, count);
+        if (header == 0U)
+        {
+            return 0U;
+        }
+        pos += header;
+        for (uint32_t k = 0U; k < count; k++)
+        {
+            uint32_t element = DataSize(&data[pos], size - pos);
+            if (element == 0U)
+            {
+                return 0U;
+            }
+            pos += element;
+        }
+        return pos;
+    }
+    case 4U:   // bit-string, length in bits
+    case 9U:   // octet-string
+    case 10U:  // visible-string
+    case 12U:  // utf8-string
+    {
+        uint32_t length;
+        uint32_t header = AxdrLength(&data[1], size - 1U, length);
+        if (header == 0U)
+        {
+            return 0U;
+        }
+        if (data[0] == 4U)
+        {
+            length = (length + 7U) / 8U;
+        }
+        return ((1U + header + length) <= size) ? (1U + header + length) : 0U;
+    }
+    default:
+        // compact-array and unknown types are not supported
+        return 0U;
+    }
+
+    return ((1U + fixed) <= size) ? (1U + fixed) : 0U;
+}
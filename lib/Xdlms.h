@@ -0,0 +1,103 @@
+/**
+ * xDLMS APDU parts not handled by the Cosem library: InitiateRequest/Response
+ * fields of the association, GET-Request/Response-With-List and General-Block-Transfer
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef XDLMS_H
+#define XDLMS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Xdlms
+{
+public:
+    // Conformance block bits, 24-bit value (first transmitted byte is the most significant)
+    static const uint32_t cConformanceMultipleReferences = 0x000200U;
+    static const uint32_t cConformanceBlockTransferWithGet = 0x001000U;
+    static const uint32_t cConformanceSelectiveAccess = 0x000004U;
+    static const uint32_t cConformanceGeneralBlockTransfer = 0x200000U;
+
+    // General-Block-Transfer block control: last block, streaming, window size (6 bits)
+    static const uint8_t cBlockLast = 0x80U;
+    static const uint8_t cBlockStreaming = 0x40U;
+    static const uint8_t cBlockWindowMask = 0x3FU;
+
+    struct Context
+    {
+        Context()
+            : conformance(0U)
+            , maxPdu(0U)
+        {
+
+        }
+
+        uint32_t conformance;
+        uint16_t maxPdu; // Client max receive PDU size in the AARQ, server one in the AARE
+    };
+
+    struct GeneralBlock
+    {
+        uint8_t control;
+        uint16_t number;
+        uint16_t ack;         // Last block received by the sender
+        const uint8_t *data;  // Block data, points into the decoded APDU
+        uint32_t size;
+    };
+
+    struct AttributeDescriptor
+    {
+        uint16_t classId;
+        uint8_t obis[6];
+        int8_t attribute;
+    };
+
+    struct ListItem
+    {
+        uint8_t result;       // Data access result, 0 for success
+        const uint8_t *data;  // Encoded A-XDR data of the item, when successful
+        uint32_t size;
+    };
+
+    // Context of the InitiateRequest (AARQ user-information) or InitiateResponse (AARE)
+    static bool DecodeInitiate(const uint8_t *apdu, uint32_t size, Context &context);
+    // Rewrites the conformance and max PDU size of the AARQ InitiateRequest in place
+    static bool PatchInitiateRequest(uint8_t *apdu, uint32_t size, const Context &context);
+
+    // GET-Request-Next: tag, choice, invoke ID, block number (32-bit big endian, last field)
+    static const uint32_t cGetNextSize = 7U;
+    static uint32_t EncodeGetNext(uint8_t *buf, uint32_t size, uint8_t invokeId, uint32_t block);
+
+    // GET-Request-Normal with selective access by entry (profile generic buffer): rows and
+    // columns are numbered from 1, 0 for the last one
+    static uint32_t EncodeGetByEntry(uint8_t *buf, uint32_t size, uint8_t invokeId, const AttributeDescriptor &item,
+                                     uint32_t fromEntry, uint32_t toEntry, uint16_t fromColumn, uint16_t toColumn);
+
+    // General-Block-Transfer APDU carrying 'data' (may be empty for a plain acknowledge)
+    static uint32_t EncodeGeneralBlock(uint8_t *buf, uint32_t size, uint8_t control, uint16_t number, uint16_t ack,
+                                       const uint8_t *data, uint32_t dataSize);
+    // False if it is not a complete General-Block-Transfer APDU
+    static bool DecodeGeneralBlock(const uint8_t *apdu, uint32_t size, GeneralBlock &block);
+
+    // Invoke-id and priority of any GET-Response. False if it is not a GET-Response
+    static bool GetResponseInvokeId(const uint8_t *apdu, uint32_t size, uint8_t &invokeId);
+
+    static uint32_t EncodeGetWithList(uint8_t *buf, uint32_t size, uint8_t invokeId, const std::vector<AttributeDescriptor> &items);
+    // Items point into 'apdu'. False if it is not a Get-Response-With-List
+    static bool DecodeGetWithList(const uint8_t *apdu, uint32_t size, std::vector<ListItem> &items);
+    // The list of Get-Data-Result alone: raw data of a list response sent in data blocks
+    static bool DecodeDataResults(const uint8_t *apdu, uint32_t size, std::vector<ListItem> &items);
+
+    // Size of the encoded A-XDR Data at the start of 'data', 0 if invalid or truncated
+    static uint32_t DataSize(const uint8_t *data, uint32_t size);
+};
+
+#endif // XDLMS_H
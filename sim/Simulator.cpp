@@ -0,0 +1,312 @@
+/**
+ * Virtual meters on pseudo-terminals
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <fstream>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "Simulator.h"
+#include "Log.h"
+
+static const std::time_t cProfileStart = 1577836800; // 2020-01-01 00:00:00 UTC
+static const uint32_t cProfilePeriod = 900U;         // seconds
+
+Simulator::Simulator()
+    : mRandom(1U)
+    , mTerminate(false)
+{
+
+}
+
+Simulator::~Simulator()
+{
+    for (uint32_t i = 0U; i < mPorts.size(); i++)
+    {
+        close(mPorts[i].master);
+        close(mPorts[i].slave);
+        delete mPorts[i].meter;
+    }
+}
+
+bool Simulator::OpenPort(Port &port)
+{
+    bool ok = false;
+
+    port.master = posix_openpt(O_RDWR | O_NOCTTY);
+    port.slave = -1;
+    if ((port.master >= 0) && (grantpt(port.master) == 0) && (unlockpt(port.master) == 0))
+    {
+        port.name = ptsname(port.master);
+        port.slave = open(port.name.c_str(), O_RDWR | O_NOCTTY);
+
+        struct termios tio;
+        if ((port.slave >= 0) && (tcgetattr(port.slave, &tio) == 0))
+        {
+            cfmakeraw(&tio);
+            ok = (tcsetattr(port.slave, TCSANOW, &tio) == 0);
+            fcntl(port.master, F_SETFL, fcntl(port.master, F_GETFL) | O_NONBLOCK);
+        }
+    }
+    return ok;
+}
+
+// Profile generic buffer: array of { clock, double-long-unsigned }, the same for all the meters
+void Simulator::EncodeProfile()
+{
+    mProfile.assign("\x01", 1U);
+    AppendAxdrLength(mProfile, mSettings.profileEntries);
+
+    for (uint32_t i = 0U; i < mSettings.profileEntries; i++)
+    {
+        std::time_t t = cProfileStart + static_cast<std::time_t>(i) * cProfilePeriod;
+        std::tm tm = *std::gmtime(&t);
+
+        mProfile.append("\x02\x02\x09\x0C", 4U);
+        mProfile.push_back(static_cast<char>((tm.tm_year + 1900) >> 8));
+        mProfile.push_back(static_cast<char>(tm.tm_year + 1900));
+        mProfile.push_back(static_cast<char>(tm.tm_mon + 1));
+        mProfile.push_back(static_cast<char>(tm.tm_mday));
+        mProfile.push_back(static_cast<char>((tm.tm_wday == 0) ? 7 : tm.tm_wday));
+        mProfile.push_back(static_cast<char>(tm.tm_hour));
+        mProfile.push_back(static_cast<char>(tm.tm_min));
+        mProfile.append("\x00\x00\x00\x00\x00", 5U);
+        mProfile.push_back('\x06');
+        for (int shift = 24; shift >= 0; shift -= 8)
+        {
+            mProfile.push_back(static_cast<char>((i * 25U) >> shift));
+        }
+    }
+}
+
+bool Simulator::Start(const SimSettings &settings)
+{
+    mSettings = settings;
+    mRandom.seed(settings.seed);
+    EncodeProfile();
+
+    for (uint32_t i = 0U; i < mSettings.meters; i++)
+    {
+        Port port;
+        if (!OpenPort(port))
+        {
+            LOG(LOG_ERROR, "** Cannot create pseudo-terminal for meter " << i);
+            close(port.master);
+            return false;
+        }
+        port.meter = new VirtualMeter(i, mSettings, mProfile, mRandom);
+        port.busyUntil = std::chrono::steady_clock::now();
+        mPorts.push_back(port);
+        LOG(LOG_INFO, "** Meter " << i << " on " << port.name);
+    }
+
+    return WriteClientFiles();
+}
+
+// Comm and session files to point the client at the virtual meters
+bool Simulator::WriteClientFiles()
+{
+    bool ok = true;
+
+    if (mSettings.commFile.size() > 0U)
+    {
+        std::ofstream comm(mSettings.commFile.c_str());
+        comm << "{\n    \"serial\": [\n";
+        for (uint32_t i = 0U; i < mPorts.size(); i++)
+        {
+            comm << "        { \"name\": \"sim" << i << "\", \"port\": \"" << mPorts[i].name
+                 << "\", \"baudrate\": " << ((mSettings.baudrate > 0U) ? mSettings.baudrate : 9600U) << " }"
+                 << (((i + 1U) < mPorts.size()) ? ",\n" : "\n");
+        }
+        comm << "    ]\n}\n";
+        ok = comm.good();
+    }
+
+    if (ok && (mSettings.sessionFile.size() > 0U))
+    {
+        std::ofstream session(mSettings.sessionFile.c_str());
+        session << "{\n    \"version\": \"1.0.0\",\n    \"session\": {\n        \"retries\": 1\n    },\n    \"meters\": [\n";
+        for (uint32_t i = 0U; i < mPorts.size(); i++)
+        {
+            session << "        {\n"
+                    << "            \"id\": \"sim" << i << "\",\n"
+                    << "            \"transport\": \"hdlc\",\n"
+                    << "            \"port\": \"sim" << i << "\",\n"
+                    << "            \"hdlc\": { \"phy_addr\": " << static_cast<int>(VirtualMeter::cPhysicalAddress) << ", \"address_size\": 4, \"test_addr\": false, "
+                    << "\"max_info_rx\": " << mSettings.maxInfo << ", \"window_rx\": " << static_cast<int>(mSettings.window) << " },\n"
+                    << "            \"cosem\": {\n"
+                    << "                \"auth_level\": \"" << mSettings.authLevel << "\",\n"
+                    << "                \"auth_password\": \"" << mSettings.password << "\",\n"
+                    << "                \"auth_hls_secret\": \"" << mSettings.hlsSecret << "\",\n"
+                    << "                \"client\": 1,\n"
+                    << "                \"logical_device\": 1\n"
+                    << "            }\n"
+                    << "        }" << (((i + 1U) < mPorts.size()) ? ",\n" : "\n");
+        }
+        session << "    ]\n}\n";
+        ok = session.good();
+    }
+
+    if (!ok)
+    {
+        LOG(LOG_ERROR, "** Cannot write the client configuration files");
+    }
+    return ok;
+}
+
+void Simulator::Schedule(uint32_t index, const std::string &frame)
+{
+    std::uniform_real_distribution<double> draw(0.0, 1.0);
+
+    if ((mSettings.loss > 0.0) && (draw(mRandom) < mSettings.loss))
+    {
+        LOG(LOG_TRACE, "** Meter " << index << ": frame dropped");
+        return;
+    }
+
+    Port &port = mPorts[index];
+    TimePoint start = std::chrono::steady_clock::now() + std::chrono::milliseconds(mSettings.latency);
+    if (port.busyUntil > start)
+    {
+        start = port.busyUntil;
+    }
+
+    // 10 bits per byte on the line
+    Output output;
+    output.due = start;
+    if (mSettings.baudrate > 0U)
+    {
+        output.due += std::chrono::microseconds((static_cast<uint64_t>(frame.size()) * 10000000U) / mSettings.baudrate);
+    }
+    output.port = index;
+    output.data = frame;
+
+    port.busyUntil = output.due;
+    mOutputs.push(output);
+}
+
+void Simulator::OnReceived(uint32_t index)
+{
+    Port &port = mPorts[index];
+    bool loop = true;
+
+    while (loop && (port.rx.size() > 0U))
+    {
+        HdlcFrame::Frame frame;
+        int ret = HdlcFrame::Decode((const uint8_t *)port.rx.data(), static_cast<uint32_t>(port.rx.size()), frame);
+
+        if (ret > 0)
+        {
+            std::vector<std::string> replies;
+            port.meter->OnFrame(frame, replies);
+            port.rx.erase(0U, frame.frameSize);
+
+            for (uint32_t i = 0U; i < replies.size(); i++)
+            {
+                Schedule(index, replies[i]);
+            }
+        }
+        else if (ret < 0)
+        {
+            // Resynchronize on the next flag
+            std::string::size_type next = port.rx.find(static_cast<char>(HdlcFrame::cFlag), 1U);
+            port.rx.erase(0U, (next == std::string::npos) ? port.rx.size() : next);
+        }
+        else
+        {
+            loop = false;
+        }
+    }
+}
+
+// Writes what the pty accepts, the rest is written when the master is writable again
+void Simulator::Flush(uint32_t index)
+{
+    Port &port = mPorts[index];
+
+    while (port.tx.size() > 0U)
+    {
+        ssize_t size = write(port.master, port.tx.data(), port.tx.size());
+        if (size > 0)
+        {
+            port.tx.erase(0U, static_cast<size_t>(size));
+        }
+        else
+        {
+            if ((size < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+            {
+                LOG(LOG_ERROR, "** Meter " << index << ": write error");
+                port.tx.clear();
+            }
+            break;
+        }
+    }
+}
+
+void Simulator::Run()
+{
+    std::vector<struct pollfd> fds(mPorts.size());
+    for (uint32_t i = 0U; i < mPorts.size(); i++)
+    {
+        fds[i].fd = mPorts[i].master;
+        fds[i].events = POLLIN;
+    }
+
+    while (!mTerminate)
+    {
+        int timeout = 100;
+        TimePoint now = std::chrono::steady_clock::now();
+
+        while (!mOutputs.empty() && (mOutputs.top().due <= now))
+        {
+            const Output &output = mOutputs.top();
+            uint32_t index = output.port;
+            mPorts[index].tx.append(output.data);
+            mOutputs.pop();
+            Flush(index);
+        }
+
+        for (uint32_t i = 0U; i < fds.size(); i++)
+        {
+            fds[i].events = (mPorts[i].tx.size() > 0U) ? (POLLIN | POLLOUT) : POLLIN;
+        }
+
+        if (!mOutputs.empty())
+        {
+            int64_t wait = std::chrono::duration_cast<std::chrono::milliseconds>(mOutputs.top().due - now).count();
+            timeout = (wait < timeout) ? static_cast<int>(wait) : timeout;
+        }
+
+        if (poll(&fds[0], static_cast<nfds_t>(fds.size()), timeout) > 0)
+        {
+            for (uint32_t i = 0U; i < fds.size(); i++)
+            {
+                if (fds[i].revents & POLLOUT)
+                {
+                    Flush(i);
+                }
+
+                if (fds[i].revents & POLLIN)
+                {
+                    char buf[4096];
+                    ssize_t size = read(fds[i].fd, buf, sizeof(buf));
+                    if (size > 0)
+                    {
+                        mPorts[i].rx.append(buf, static_cast<size_t>(size));
+                        OnReceived(i);
+                    }
+                }
+            }
+        }
+    }
+}
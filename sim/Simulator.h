@@ -0,0 +1,74 @@
+/**
+ * Virtual meters on pseudo-terminals
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <vector>
+#include <queue>
+#include <chrono>
+#include <atomic>
+#include "VirtualMeter.h"
+
+/**
+ * One pty pair per virtual meter, all served by a single poll() loop. The
+ * response frames are delayed by the injected latency and by their
+ * transmission time at the emulated baud rate, or dropped at random.
+ */
+class Simulator
+{
+public:
+    Simulator();
+    ~Simulator();
+
+    bool Start(const SimSettings &settings);
+    void Run();
+    void Stop() { mTerminate = true; }
+
+private:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    struct Port
+    {
+        int master;
+        int slave; // Kept opened so that the master never hangs up between two client sessions
+        std::string name;
+        std::string rx;
+        std::string tx; // Due, not yet accepted by the non-blocking master
+        VirtualMeter *meter;
+        TimePoint busyUntil;
+    };
+
+    struct Output
+    {
+        TimePoint due;
+        uint32_t port;
+        std::string data;
+
+        bool operator<(const Output &other) const { return due > other.due; } // Earliest first
+    };
+
+    SimSettings mSettings;
+    std::string mProfile;
+    std::mt19937 mRandom;
+    std::vector<Port> mPorts;
+    std::priority_queue<Output> mOutputs;
+    std::atomic<bool> mTerminate;
+
+    bool OpenPort(Port &port);
+    void OnReceived(uint32_t index);
+    void Schedule(uint32_t index, const std::string &frame);
+    void Flush(uint32_t index);
+    void EncodeProfile();
+    bool WriteClientFiles();
+};
+
+#endif // SIMULATOR_H
@@ -0,0 +1,783 @@
+/**
+ * Simulated DLMS/COSEM meter behind an HDLC link
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <ctime>
+#include <algorithm>
+#include <cstring>
+#include "VirtualMeter.h"
+#include "Log.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+
+// LLC: destination and source LSAP, quality
+static const char cLlcRequest[] = "\xE6\xE6\x00";
+static const char cLlcResponse[] = "\xE6\xE7\x00";
+static const uint32_t cLlcSize = 3U;
+
+// Conformance: priority-mgmt, block-transfer-with-get, multiple-references, get, set, selective-access, event, action
+static const uint32_t cConformance = 0x00521FU;
+static const uint32_t cConformanceMultipleReferences = 0x000200U;
+
+// AARQ/AARE tags and values
+static const uint8_t cAarqTag = 0x60U;
+static const uint8_t cAareTag = 0x61U;
+static const uint8_t cRlrqTag = 0x62U;
+static const uint8_t cContextNameTag = 0xA1U;
+static const uint8_t cMechanismNameTag = 0x8BU;
+static const uint8_t cCallingAuthTag = 0xACU;
+static const uint8_t cUserInfoTag = 0xBEU;
+static const char cContextNameLn[] = "\x06\x07\x60\x85\x74\x05\x08\x01\x01";
+static const char cMechanismPrefix[] = "\x60\x85\x74\x05\x08\x02";
+
+enum AcseMechanism
+{
+    MECHANISM_NONE = 0,
+    MECHANISM_LLS = 1,
+    MECHANISM_HLS = 2,     // Manufacturer specific, SHA-256 for this client
+    MECHANISM_HLS_MD5 = 3,
+    MECHANISM_HLS_SHA1 = 4
+};
+
+enum AcseDiagnostic
+{
+    DIAG_NULL = 0,
+    DIAG_CONTEXT_NOT_SUPPORTED = 2,
+    DIAG_MECHANISM_NOT_RECOGNISED = 11,
+    DIAG_AUTHENTICATION_FAILURE = 13,
+    DIAG_AUTHENTICATION_REQUIRED = 14
+};
+
+// xDLMS services
+static const uint8_t cGetRequest = 0xC0U;
+static const uint8_t cActionRequest = 0xC3U;
+static const uint8_t cGetResponse = 0xC4U;
+static const uint8_t cActionResponse = 0xC7U;
+static const uint8_t cExceptionResponse = 0xD8U;
+
+static const uint8_t cAccessObjectUndefined = 0x04U;
+static const uint8_t cAccessReadWriteDenied = 0x03U;
+static const uint8_t cAccessBlockNumberInvalid = 0x13U;
+static const uint8_t cActionOtherReason = 0xFAU;
+
+static const uint32_t cChallengeSize = 16U;
+static const uint32_t cBlockHeaderSize = 12U; // Service, type, invoke-id, last, number, choice, length
+
+static const uint8_t cAssociationLn[6] = { 0U, 0U, 40U, 0U, 0U, 255U };
+static const uint8_t cClockLn[6] = { 0U, 0U, 1U, 0U, 0U, 255U };
+
+void AppendAxdrLength(std::string &out, uint32_t length)
+{
+    if (length < 0x80U)
+    {
+        out.push_back(static_cast<char>(length));
+    }
+    else if (length <= 0xFFU)
+    {
+        out.push_back('\x81');
+        out.push_back(static_cast<char>(length));
+    }
+    else if (length <= 0xFFFFU)
+    {
+        out.push_back('\x82');
+        out.push_back(static_cast<char>(length >> 8U));
+        out.push_back(static_cast<char>(length));
+    }
+    else
+    {
+        out.push_back('\x84');
+        for (int shift = 24; shift >= 0; shift -= 8)
+        {
+            out.push_back(static_cast<char>(length >> shift));
+        }
+    }
+}
+
+static void AppendU16(std::string &out, uint32_t value)
+{
+    out.push_back(static_cast<char>(value >> 8U));
+    out.push_back(static_cast<char>(value));
+}
+
+static void AppendU32(std::string &out, uint32_t value)
+{
+    AppendU16(out, value >> 16U);
+    AppendU16(out, value & 0xFFFFU);
+}
+
+static uint32_t ReadU16(const uint8_t *data)
+{
+    return (static_cast<uint32_t>(data[0]) << 8U) | data[1];
+}
+
+static uint32_t ReadU32(const uint8_t *data)
+{
+    return (ReadU16(data) << 16U) | ReadU16(&data[2]);
+}
+
+// BER tag, short or long form length, value
+static void AppendTlv(std::string &out, uint8_t tag, const std::string &value)
+{
+    out.push_back(static_cast<char>(tag));
+    AppendAxdrLength(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+static bool ReadBerLength(const std::string &data, uint32_t &pos, uint32_t &length)
+{
+    if (pos >= data.size())
+    {
+        return false;
+    }
+
+    uint8_t first = static_cast<uint8_t>(data[pos++]);
+    if (first < 0x80U)
+    {
+        length = first;
+    }
+    else
+    {
+        uint32_t count = first & 0x7FU;
+        length = 0U;
+        if ((count > 4U) || ((pos + count) > data.size()))
+        {
+            return false;
+        }
+        for (uint32_t i = 0U; i < count; i++)
+        {
+            length = (length << 8U) | static_cast<uint8_t>(data[pos++]);
+        }
+    }
+    return (pos + length) <= data.size();
+}
+
+static std::string DateTime(std::time_t t)
+{
+    std::tm tm = *std::gmtime(&t);
+    std::string out;
+
+    AppendU16(out, static_cast<uint32_t>(tm.tm_year + 1900));
+    out.push_back(static_cast<char>(tm.tm_mon + 1));
+    out.push_back(static_cast<char>(tm.tm_mday));
+    out.push_back(static_cast<char>((tm.tm_wday == 0) ? 7 : tm.tm_wday));
+    out.push_back(static_cast<char>(tm.tm_hour));
+    out.push_back(static_cast<char>(tm.tm_min));
+    out.push_back(static_cast<char>(tm.tm_sec));
+    out.push_back('\x00');  // hundredths
+    out.push_back('\x00');  // deviation: UTC
+    out.push_back('\x00');
+    out.push_back('\x00');  // clock status
+    return out;
+}
+
+static std::string HexToBin(const std::string &hex)
+{
+    std::string bin;
+
+    for (uint32_t i = 0U; (i + 1U) < hex.size(); i += 2U)
+    {
+        bin.push_back(static_cast<char>(std::strtoul(hex.substr(i, 2U).c_str(), NULL, 16)));
+    }
+    return bin;
+}
+
+VirtualMeter::VirtualMeter(uint32_t id, const SimSettings &settings, const std::string &profile, std::mt19937 &random)
+    : mId(id)
+    , mSettings(settings)
+    , mProfile(profile)
+    , mRandom(random)
+    , mConnected(false)
+    , mVs(0U)
+    , mVr(0U)
+    , mMaxInfoTx(settings.maxInfo)
+    , mWindowTx(1U)
+    , mTxOffset(0U)
+    , mWindowStart(0U)
+    , mState(NOT_ASSOCIATED)
+    , mMechanism(MECHANISM_NONE)
+    , mPdu(settings.maxPdu)
+    , mConformance(cConformance)
+    , mBlockOffset(0U)
+    , mBlockNumber(0U)
+    , mEnergy(id * 1000U)
+{
+    mServer.size = 0U;
+    mClient.size = 0U;
+}
+
+std::string VirtualMeter::Frame(uint8_t control, bool segmented, const std::string &info)
+{
+    uint8_t buf[2048];
+    uint32_t size = HdlcFrame::Encode(&buf[0], sizeof(buf), mClient, mServer, control, segmented,
+                                      (const uint8_t *)info.data(), static_cast<uint32_t>(info.size()));
+    return std::string((const char *)&buf[0], size);
+}
+
+void VirtualMeter::OnFrame(const HdlcFrame::Frame &frame, std::vector<std::string> &replies)
+{
+    uint16_t physical = HdlcFrame::PhysicalAddress(frame.destination);
+    bool broadcast = (physical == HdlcFrame::cAllStations) || ((frame.destination.size == 2U) && (physical == 0x7FU));
+
+    if ((frame.destination.size > 1U) && !broadcast && (physical != cPhysicalAddress))
+    {
+        // Another station of the bus
+        return;
+    }
+
+    // Answer with the addresses of the request, swapped; a broadcast is answered with our own address
+    mServer = frame.destination;
+    mClient = frame.source;
+    if (broadcast)
+    {
+        uint16_t logical = (frame.destination.size == 4U) ?
+                    static_cast<uint16_t>(((frame.destination.bytes[0] >> 1U) << 7U) | (frame.destination.bytes[1] >> 1U)) :
+                    static_cast<uint16_t>(frame.destination.bytes[0] >> 1U);
+        mServer = HdlcFrame::ServerAddress(logical, cPhysicalAddress, frame.destination.size);
+    }
+
+    uint8_t control = static_cast<uint8_t>(frame.control | HdlcFrame::cPollFinal);
+
+    if (control == HdlcFrame::cSnrm)
+    {
+        OnSnrm(frame, replies);
+    }
+    else if (control == HdlcFrame::cDisc)
+    {
+        replies.push_back(Frame(mConnected ? HdlcFrame::cUa : HdlcFrame::cDm, false, std::string()));
+        mConnected = false;
+        mState = NOT_ASSOCIATED;
+    }
+    else if (!mConnected)
+    {
+        replies.push_back(Frame(HdlcFrame::cDm, false, std::string()));
+    }
+    else if (HdlcFrame::IsRr(frame.control))
+    {
+        uint8_t nr = static_cast<uint8_t>(frame.control >> 5U);
+        if (nr != mVs)
+        {
+            // Frames of our window have been lost
+            Rewind(nr);
+            SendWindow(replies);
+        }
+        else if (mTxOffset < mTxInfo.size())
+        {
+            SendWindow(replies);
+        }
+        else
+        {
+            replies.push_back(Frame(HdlcFrame::RrControl(mVr), false, std::string()));
+        }
+    }
+    else if (HdlcFrame::IsIFrame(frame.control))
+    {
+        uint8_t ns = static_cast<uint8_t>((frame.control >> 1U) & 0x07U);
+        if (ns != mVr)
+        {
+            // Repeated request: the response has been lost
+            Rewind(mWindowStart);
+            SendWindow(replies);
+        }
+        else
+        {
+            mVr = static_cast<uint8_t>((mVr + 1U) & 0x07U);
+            mRxInfo.append((const char *)frame.info, frame.infoSize);
+
+            if (frame.segmented)
+            {
+                replies.push_back(Frame(HdlcFrame::RrControl(mVr), false, std::string()));
+            }
+            else
+            {
+                std::string request;
+                request.swap(mRxInfo);
+
+                if ((request.size() > cLlcSize) && (request.compare(0U, cLlcSize, cLlcRequest, cLlcSize) == 0))
+                {
+                    std::string response = OnApdu(request.substr(cLlcSize));
+                    mTxInfo.assign(cLlcResponse, cLlcSize);
+                    mTxInfo.append(response);
+                    mTxOffset = 0U;
+                    mWindowOffsets.clear();
+                    SendWindow(replies);
+                }
+            }
+        }
+    }
+}
+
+void VirtualMeter::OnSnrm(const HdlcFrame::Frame &frame, std::vector<std::string> &replies)
+{
+    HdlcFrame::Parameters client;
+    HdlcFrame::DecodeParameters(frame.info, frame.infoSize, client);
+
+    // Never more than what the client can receive
+    HdlcFrame::Parameters params;
+    params.maxInfoTx = std::min(mSettings.maxInfo, client.maxInfoRx);
+    params.maxInfoRx = mSettings.maxInfo;
+    params.windowTx = std::min(mSettings.window, client.windowRx);
+    params.windowRx = 1U;
+
+    uint8_t info[32];
+    uint32_t infoSize = HdlcFrame::EncodeParameters(&info[0], sizeof(info), params);
+
+    mMaxInfoTx = params.maxInfoTx;
+    mWindowTx = std::max(params.windowTx, static_cast<uint8_t>(1U));
+    mConnected = true;
+    mVs = 0U;
+    mVr = 0U;
+    mRxInfo.clear();
+    mTxInfo.clear();
+    mTxOffset = 0U;
+    mWindowStart = 0U;
+    mWindowOffsets.clear();
+    mState = NOT_ASSOCIATED;
+
+    replies.push_back(Frame(HdlcFrame::cUa, false, std::string((const char *)&info[0], infoSize)));
+}
+
+// Go back to the frame N(R) of the window in flight (go-back-N)
+void VirtualMeter::Rewind(uint8_t nr)
+{
+    uint32_t acked = static_cast<uint32_t>((nr - mWindowStart) & 0x07U);
+
+    if (acked < mWindowOffsets.size())
+    {
+        mTxOffset = mWindowOffsets[acked];
+        mVs = nr;
+    }
+}
+
+// Up to mWindowTx I-frames, only the last one has the poll/final bit and is acknowledged by a RR
+void VirtualMeter::SendWindow(std::vector<std::string> &replies)
+{
+    mWindowStart = mVs;
+    mWindowOffsets.clear();
+
+    do
+    {
+        uint32_t size = static_cast<uint32_t>(mTxInfo.size()) - mTxOffset;
+        bool segmented = false;
+
+        if (size > mMaxInfoTx)
+        {
+            size = mMaxInfoTx;
+            segmented = true;
+        }
+
+        bool final = !segmented || ((mWindowOffsets.size() + 1U) >= mWindowTx);
+
+        mWindowOffsets.push_back(mTxOffset);
+        replies.push_back(Frame(HdlcFrame::IControl(mVr, mVs, final), segmented, mTxInfo.substr(mTxOffset, size)));
+        mTxOffset += size;
+        mVs = static_cast<uint8_t>((mVs + 1U) & 0x07U);
+
+        if (final)
+        {
+            break;
+        }
+    }
+    while (mTxOffset < mTxInfo.size());
+}
+
+std::string VirtualMeter::OnApdu(const std::string &apdu)
+{
+    std::string response;
+    uint8_t tag = static_cast<uint8_t>(apdu[0]);
+
+    if (tag == cAarqTag)
+    {
+        response = OnAarq(apdu);
+    }
+    else if (tag == cRlrqTag)
+    {
+        mState = NOT_ASSOCIATED;
+        response.assign("\x63\x03\x80\x01\x00", 5U);
+    }
+    else if ((tag == cGetRequest) && (apdu.size() >= 3U))
+    {
+        response = OnGet(apdu);
+    }
+    else if ((tag == cActionRequest) && (apdu.size() >= 3U))
+    {
+        response = OnAction(apdu);
+    }
+    else
+    {
+        // State error: service not allowed, service error: service unknown
+        response.assign("\xD8\x01\x02", 3U);
+    }
+    return response;
+}
+
+std::string VirtualMeter::OnAarq(const std::string &apdu)
+{
+    uint32_t pos = 1U;
+    uint32_t length = 0U;
+    uint8_t result = 0U;
+    uint8_t diagnostic = DIAG_NULL;
+    std::string authValue;
+
+    mMechanism = MECHANISM_NONE;
+    mState = NOT_ASSOCIATED;
+    mPdu = mSettings.maxPdu;
+    mConformance = cConformance;
+
+    if (ReadBerLength(apdu, pos, length))
+    {
+        uint32_t end = pos + length;
+        while (pos < end)
+        {
+            uint8_t tag = static_cast<uint8_t>(apdu[pos++]);
+            if (!ReadBerLength(apdu, pos, length))
+            {
+                break;
+            }
+            std::string value = apdu.substr(pos, length);
+            pos += length;
+
+            if ((tag == cContextNameTag) && (value != std::string(cContextNameLn, sizeof(cContextNameLn) - 1U)))
+            {
+                // Ciphered contexts and short names are not simulated
+                result = 1U;
+                diagnostic = DIAG_CONTEXT_NOT_SUPPORTED;
+            }
+            else if ((tag == cMechanismNameTag) && (value.size() == 7U))
+            {
+                mMechanism = static_cast<uint8_t>(value[6]);
+            }
+            else if ((tag == cCallingAuthTag) && (value.size() > 2U))
+            {
+                authValue = value.substr(2U);
+            }
+            else if ((tag == cUserInfoTag) && (value.size() >= 7U))
+            {
+                // InitiateRequest ends with the proposed conformance and the client max receive PDU size
+                const uint8_t *proposed = (const uint8_t *)&value[value.size() - 5U];
+                mConformance = cConformance & ((static_cast<uint32_t>(proposed[0]) << 16U) | (static_cast<uint32_t>(proposed[1]) << 8U) | proposed[2]);
+
+                uint32_t clientPdu = ReadU16((const uint8_t *)&value[value.size() - 2U]);
+                if ((clientPdu >= 64U) && (clientPdu < mPdu))
+                {
+                    mPdu = static_cast<uint16_t>(clientPdu);
+                }
+            }
+        }
+    }
+
+    if (result == 0U)
+    {
+        if (mMechanism == MECHANISM_NONE)
+        {
+            mState = ASSOCIATED;
+        }
+        else if (mMechanism == MECHANISM_LLS)
+        {
+            if (authValue == mSettings.password)
+            {
+                mState = ASSOCIATED;
+            }
+            else
+            {
+                result = 1U;
+                diagnostic = DIAG_AUTHENTICATION_FAILURE;
+            }
+        }
+        else if ((mMechanism == MECHANISM_HLS) || (mMechanism == MECHANISM_HLS_MD5) || (mMechanism == MECHANISM_HLS_SHA1))
+        {
+            mCtoS = authValue;
+            mStoC.clear();
+            for (uint32_t i = 0U; i < cChallengeSize; i++)
+            {
+                mStoC.push_back(static_cast<char>('A' + (mRandom() % 26U)));
+            }
+            diagnostic = DIAG_AUTHENTICATION_REQUIRED;
+            mState = HLS_PENDING;
+        }
+        else
+        {
+            result = 1U;
+            diagnostic = DIAG_MECHANISM_NOT_RECOGNISED;
+        }
+    }
+
+    std::string body;
+    AppendTlv(body, cContextNameTag, std::string(cContextNameLn, sizeof(cContextNameLn) - 1U));
+    AppendTlv(body, 0xA2U, std::string("\x02\x01", 2U) + static_cast<char>(result));
+    AppendTlv(body, 0xA3U, std::string("\xA1\x03\x02\x01", 4U) + static_cast<char>(diagnostic));
+
+    if (mState == HLS_PENDING)
+    {
+        AppendTlv(body, 0x88U, std::string("\x07\x80", 2U));
+        AppendTlv(body, 0x89U, std::string(cMechanismPrefix, sizeof(cMechanismPrefix) - 1U) + static_cast<char>(mMechanism));
+        std::string auth("\x80", 1U);
+        AppendAxdrLength(auth, static_cast<uint32_t>(mStoC.size()));
+        AppendTlv(body, 0xAAU, auth + mStoC);
+    }
+
+    // InitiateResponse: no QoS, version 6, conformance, max PDU size, VAA name
+    std::string initiate("\x08\x00\x06\x5F\x1F\x04\x00", 7U);
+    initiate.push_back(static_cast<char>(mConformance >> 16U));
+    initiate.push_back(static_cast<char>(mConformance >> 8U));
+    initiate.push_back(static_cast<char>(mConformance));
+    AppendU16(initiate, mPdu);
+    initiate.append("\x00\x07", 2U);
+    std::string userInfo("\x04", 1U);
+    AppendAxdrLength(userInfo, static_cast<uint32_t>(initiate.size()));
+    AppendTlv(body, cUserInfoTag, userInfo + initiate);
+
+    std::string aare;
+    AppendTlv(aare, cAareTag, body);
+    return aare;
+}
+
+std::string VirtualMeter::Digest(const std::string &challenge) const
+{
+    std::string input = challenge + HexToBin(mSettings.hlsSecret);
+    unsigned char output[32];
+    uint32_t size = 0U;
+
+    if (mMechanism == MECHANISM_HLS_MD5)
+    {
+        mbedtls_md5((const unsigned char *)input.data(), input.size(), output);
+        size = 16U;
+    }
+    else if (mMechanism == MECHANISM_HLS_SHA1)
+    {
+        mbedtls_sha1((const unsigned char *)input.data(), input.size(), output);
+        size = 20U;
+    }
+    else
+    {
+        mbedtls_sha256((const unsigned char *)input.data(), input.size(), output, 0);
+        size = 32U;
+    }
+    return std::string((const char *)output, size);
+}
+
+std::string VirtualMeter::OnAction(const std::string &apdu)
+{
+    const uint8_t *data = (const uint8_t *)apdu.data();
+    uint8_t invokeId = data[2];
+    std::string response;
+
+    response.push_back(static_cast<char>(cActionResponse));
+    response.push_back('\x01');
+    response.push_back(static_cast<char>(invokeId));
+
+    // Reply to HLS authentication: class 15, current association, method 1, octet-string parameter
+    bool ok = (apdu.size() > 16U) && (mState == HLS_PENDING) &&
+              (ReadU16(&data[3]) == 15U) && (std::memcmp(&data[5], cAssociationLn, 6U) == 0) &&
+              (data[11] == 1U) && (data[12] == 1U) && (data[13] == 0x09U);
+
+    if (ok)
+    {
+        std::string expected = Digest(mStoC);
+        ok = (apdu.size() == (15U + expected.size())) && (apdu.compare(15U, expected.size(), expected) == 0);
+    }
+
+    if (ok)
+    {
+        mState = ASSOCIATED;
+        std::string digest = Digest(mCtoS);
+        response.append("\x00\x01\x00\x09", 4U);
+        AppendAxdrLength(response, static_cast<uint32_t>(digest.size()));
+        response.append(digest);
+    }
+    else
+    {
+        response.push_back(static_cast<char>(cActionOtherReason));
+        response.push_back('\x00');
+    }
+    return response;
+}
+
+bool VirtualMeter::ObjectData(uint16_t classId, const uint8_t *obis, uint8_t attribute, std::string &data)
+{
+    bool found = true;
+
+    data.clear();
+    if (attribute == 1U)
+    {
+        data.append("\x09\x06", 2U);
+        data.append((const char *)obis, 6U);
+    }
+    else if ((classId == 8U) && (attribute == 2U) && (std::memcmp(obis, cClockLn, 6U) == 0))
+    {
+        data.append("\x09\x0C", 2U);
+        data.append(DateTime(std::time(NULL)));
+    }
+    else if ((classId == 7U) && (attribute == 2U))
+    {
+        data = mProfile;
+    }
+    else if (((classId == 3U) || (classId == 4U)) && (attribute == 2U))
+    {
+        data.push_back('\x06');
+        AppendU32(data, mEnergy++);
+    }
+    else if (((classId == 3U) || (classId == 4U)) && (attribute == 3U))
+    {
+        // Scaler 0, unit Wh
+        data.assign("\x02\x02\x0F\x00\x16\x1E", 6U);
+    }
+    else if ((classId == 1U) && (attribute == 2U))
+    {
+        char serial[16];
+        std::snprintf(serial, sizeof(serial), "SIM%05u", mId);
+        data.push_back('\x0A');
+        AppendAxdrLength(data, static_cast<uint32_t>(std::strlen(serial)));
+        data.append(serial);
+    }
+    else
+    {
+        found = false;
+    }
+    return found;
+}
+
+std::string VirtualMeter::OnGet(const std::string &apdu)
+{
+    const uint8_t *data = (const uint8_t *)apdu.data();
+    uint8_t type = data[1];
+    uint8_t invokeId = data[2];
+    std::string response;
+
+    response.push_back(static_cast<char>(cGetResponse));
+
+    if ((type == 0x01U) && (apdu.size() >= 13U))
+    {
+        std::string value;
+
+        if (mState != ASSOCIATED)
+        {
+            response.append("\x01", 1U);
+            response.push_back(static_cast<char>(invokeId));
+            response.push_back('\x01');
+            response.push_back(static_cast<char>(cAccessReadWriteDenied));
+        }
+        else if (!ObjectData(static_cast<uint16_t>(ReadU16(&data[3])), &data[5], data[11], value))
+        {
+            response.append("\x01", 1U);
+            response.push_back(static_cast<char>(invokeId));
+            response.push_back('\x01');
+            response.push_back(static_cast<char>(cAccessObjectUndefined));
+        }
+        else if ((value.size() + 4U) <= mPdu)
+        {
+            response.append("\x01", 1U);
+            response.push_back(static_cast<char>(invokeId));
+            response.push_back('\x00');
+            response.append(value);
+        }
+        else
+        {
+            // Selective access is ignored: the whole buffer is sent by blocks
+            mBlockData.swap(value);
+            mBlockOffset = 0U;
+            mBlockNumber = 0U;
+            response = NextBlock(invokeId);
+        }
+    }
+    else if ((type == 0x03U) && (apdu.size() >= 4U) && (mState == ASSOCIATED) &&
+             ((mConformance & cConformanceMultipleReferences) != 0U))
+    {
+        // Attribute descriptors of 9 bytes, each followed by an access selection flag (ignored)
+        uint32_t count = data[3];
+        std::string list;
+
+        list.push_back(static_cast<char>(count));
+        for (uint32_t k = 0U; k < count; k++)
+        {
+            uint32_t pos = 4U + (k * 10U);
+            std::string value;
+
+            if (((pos + 10U) <= apdu.size()) &&
+                ObjectData(static_cast<uint16_t>(ReadU16(&data[pos])), &data[pos + 2U], data[pos + 8U], value))
+            {
+                list.push_back('\x00');
+                list.append(value);
+            }
+            else
+            {
+                list.push_back('\x01');
+                list.push_back(static_cast<char>(cAccessObjectUndefined));
+            }
+        }
+
+        if ((list.size() + 3U) <= mPdu)
+        {
+            response.append("\x03", 1U);
+            response.push_back(static_cast<char>(invokeId));
+            response.append(list);
+        }
+        else
+        {
+            mBlockData.swap(list);
+            mBlockOffset = 0U;
+            mBlockNumber = 0U;
+            response = NextBlock(invokeId);
+        }
+    }
+    else if ((type == 0x02U) && (apdu.size() >= 7U))
+    {
+        if ((ReadU32(&data[3]) == mBlockNumber) && (mBlockOffset < mBlockData.size()))
+        {
+            response = NextBlock(invokeId);
+        }
+        else
+        {
+            response.append("\x02", 1U);
+            response.push_back(static_cast<char>(invokeId));
+            response.push_back('\x01');
+            AppendU32(response, ReadU32(&data[3]));
+            response.push_back('\x01');
+            response.push_back(static_cast<char>(cAccessBlockNumberInvalid));
+        }
+    }
+    else
+    {
+        response.assign("\xD8\x01\x02", 3U);
+    }
+    return response;
+}
+
+std::string VirtualMeter::NextBlock(uint8_t invokeId)
+{
+    std::string response;
+    uint32_t size = static_cast<uint32_t>(mBlockData.size()) - mBlockOffset;
+    uint32_t room = mPdu - cBlockHeaderSize;
+    bool last = true;
+
+    if (size > room)
+    {
+        size = room;
+        last = false;
+    }
+    mBlockNumber++;
+
+    response.push_back(static_cast<char>(cGetResponse));
+    response.push_back('\x02');
+    response.push_back(static_cast<char>(invokeId));
+    response.push_back(last ? '\x01' : '\x00');
+    AppendU32(response, mBlockNumber);
+    response.push_back('\x00'); // raw-data
+    AppendAxdrLength(response, size);
+    response.append(mBlockData, mBlockOffset, size);
+    mBlockOffset += size;
+
+    if (last)
+    {
+        mBlockData.clear();
+        mBlockOffset = 0U;
+    }
+    return response;
+}
@@ -0,0 +1,127 @@
+/**
+ * Simulated DLMS/COSEM meter behind an HDLC link
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#ifndef VIRTUAL_METER_H
+#define VIRTUAL_METER_H
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include "HdlcFrame.h"
+
+struct SimSettings
+{
+    SimSettings()
+        : meters(1U)
+        , baudrate(9600U)
+        , latency(0U)
+        , loss(0.0)
+        , profileEntries(96U)
+        , maxPdu(1024U)
+        , maxInfo(128U)
+        , window(1U)
+        , password("ABCDEFGH")
+        , hlsSecret("000102030405060708090A0B0C0D0E0F")
+        , authLevel("LOW_LEVEL_SECURITY")
+        , seed(1U)
+    {
+
+    }
+
+    uint32_t meters;
+    unsigned int baudrate;  // Emulated line speed, 0 for none
+    uint32_t latency;       // Milliseconds added before each response frame
+    double loss;            // Probability to drop a response frame
+    uint32_t profileEntries;
+    uint16_t maxPdu;
+    uint16_t maxInfo;
+    uint8_t window;         // Transmit window proposed in the UA
+    std::string password;   // LLS
+    std::string hlsSecret;  // HLS, hexadecimal
+    std::string authLevel;  // Written into the generated session file
+    uint32_t seed;
+    std::string commFile;
+    std::string sessionFile;
+};
+
+/**
+ * Answers SNRM/DISC, I-frames (with segmentation both ways) and RR, and at the
+ * application layer AARQ (no security, LLS, HLS MD5/SHA-1/SHA-256), GET normal
+ * and with data blocks, the HLS pass 3 ACTION and RLRQ.
+ */
+class VirtualMeter
+{
+public:
+    static const uint16_t cPhysicalAddress = 17U; // Also answers the all-station address
+
+    VirtualMeter(uint32_t id, const SimSettings &settings, const std::string &profile, std::mt19937 &random);
+
+    // Appends the response frames, if any, to 'replies'
+    void OnFrame(const HdlcFrame::Frame &frame, std::vector<std::string> &replies);
+
+private:
+    enum AssociationState
+    {
+        NOT_ASSOCIATED,
+        HLS_PENDING,
+        ASSOCIATED
+    };
+
+    uint32_t mId;
+    const SimSettings &mSettings;
+    const std::string &mProfile; // Encoded once for all the meters
+    std::mt19937 &mRandom;
+
+    // HDLC
+    bool mConnected;
+    uint8_t mVs;
+    uint8_t mVr;
+    uint16_t mMaxInfoTx;
+    uint8_t mWindowTx;
+    HdlcFrame::Address mServer;
+    HdlcFrame::Address mClient;
+    std::string mRxInfo;   // Segmented request being received
+    std::string mTxInfo;   // Response being sent by segments
+    uint32_t mTxOffset;
+    uint8_t mWindowStart;  // N(S) of the first frame of the window in flight
+    std::vector<uint32_t> mWindowOffsets; // Offset in mTxInfo of each frame of that window
+
+    // Application
+    AssociationState mState;
+    uint8_t mMechanism;
+    std::string mCtoS;
+    std::string mStoC;
+    uint16_t mPdu;
+    uint32_t mConformance; // Negotiated
+    std::string mBlockData;
+    uint32_t mBlockOffset;
+    uint32_t mBlockNumber;
+    uint32_t mEnergy;
+
+    void OnSnrm(const HdlcFrame::Frame &frame, std::vector<std::string> &replies);
+    void SendWindow(std::vector<std::string> &replies);
+    void Rewind(uint8_t nr);
+    std::string Frame(uint8_t control, bool segmented, const std::string &info);
+
+    std::string OnApdu(const std::string &apdu);
+    std::string OnAarq(const std::string &apdu);
+    std::string OnGet(const std::string &apdu);
+    std::string OnAction(const std::string &apdu);
+    std::string NextBlock(uint8_t invokeId);
+    bool ObjectData(uint16_t classId, const uint8_t *obis, uint8_t attribute, std::string &data);
+    std::string Digest(const std::string &challenge) const;
+};
+
+// A-XDR length field
+void AppendAxdrLength(std::string &out, uint32_t length);
+
+#endif // VIRTUAL_METER_H
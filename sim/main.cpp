@@ -0,0 +1,102 @@
+/**
+ * DLMS/COSEM meter simulator entry point
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <csignal>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include "Simulator.h"
+#include "Log.h"
+
+static Simulator simulator;
+
+static void OnSignal(int signal)
+{
+    (void) signal;
+    simulator.Stop();
+}
+
+static void Usage()
+{
+    puts("\r\nUsage: cosem_sim [options]");
+    puts("  -n meters     number of virtual meters, one pseudo-terminal each (1)");
+    puts("  -b baudrate   emulated line speed, 0 for none (9600)");
+    puts("  -l latency    milliseconds added before each response frame (0)");
+    puts("  -x loss       percentage of response frames dropped (0)");
+    puts("  -p entries    load profile entries (96)");
+    puts("  -u pdu        maximum APDU size (1024)");
+    puts("  -i info       maximum HDLC information field (128)");
+    puts("  -W window     maximum HDLC transmit window, 1 to 7 (1)");
+    puts("  -a level      authentication level written in the session file (LOW_LEVEL_SECURITY)");
+    puts("  -w password   LLS password (ABCDEFGH)");
+    puts("  -k secret     HLS secret, hexadecimal (000102030405060708090A0B0C0D0E0F)");
+    puts("  -r seed       random seed for the losses and the challenges (1)");
+    puts("  -c file       write a comm file listing the pseudo-terminals");
+    puts("  -s file       write a session file with one meter per pseudo-terminal");
+    puts("  -v level      log level: error, info, frame or trace (info)");
+}
+
+int main(int argc, char **argv)
+{
+    SimSettings settings;
+    int opt;
+
+    Log::Start();
+
+    while ((opt = getopt(argc, argv, "n:b:l:x:p:u:i:W:a:w:k:r:c:s:v:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': settings.meters = static_cast<uint32_t>(std::strtoul(optarg, NULL, 10)); break;
+        case 'b': settings.baudrate = static_cast<unsigned int>(std::strtoul(optarg, NULL, 10)); break;
+        case 'l': settings.latency = static_cast<uint32_t>(std::strtoul(optarg, NULL, 10)); break;
+        case 'x': settings.loss = std::strtod(optarg, NULL) / 100.0; break;
+        case 'p': settings.profileEntries = static_cast<uint32_t>(std::strtoul(optarg, NULL, 10)); break;
+        case 'u': settings.maxPdu = static_cast<uint16_t>(std::strtoul(optarg, NULL, 10)); break;
+        case 'i': settings.maxInfo = static_cast<uint16_t>(std::strtoul(optarg, NULL, 10)); break;
+        case 'W': settings.window = static_cast<uint8_t>(std::strtoul(optarg, NULL, 10)); break;
+        case 'a': settings.authLevel = optarg; break;
+        case 'w': settings.password = optarg; break;
+        case 'k': settings.hlsSecret = optarg; break;
+        case 'r': settings.seed = static_cast<uint32_t>(std::strtoul(optarg, NULL, 10)); break;
+        case 'c': settings.commFile = optarg; break;
+        case 's': settings.sessionFile = optarg; break;
+        case 'v': Log::SetLevel(std::string(optarg)); break;
+        default:
+            Usage();
+            Log::Stop();
+            return 1;
+        }
+    }
+
+    // Frame length is an 11-bit field, the block header needs some room in the APDU
+    if ((settings.maxInfo < 32U) || (settings.maxInfo > 2030U) || (settings.maxPdu < 64U) ||
+        (settings.window < 1U) || (settings.window > HdlcFrame::cMaxWindow))
+    {
+        Usage();
+        Log::Stop();
+        return 1;
+    }
+
+    std::signal(SIGINT, OnSignal);
+    std::signal(SIGTERM, OnSignal);
+
+    int ret = 1;
+    if (simulator.Start(settings))
+    {
+        LOG(LOG_INFO, "** " << settings.meters << " virtual meters ready, Ctrl-C to stop");
+        simulator.Run();
+        ret = 0;
+    }
+
+    Log::Stop();
+    return ret;
+}
@@ -9,14 +9,25 @@
  *
  */
 
-#include "CosemClient.h"
+#include "SessionPool.h"
+#include "TransportReactor.h"
+#include "UdpEndpoint.h"
+#include "Log.h"
 
-CosemClient client;
+SessionPool pool;
+TransportReactor reactor;
 
 extern "C" void csm_hal_get_lls_password(uint8_t sap, uint8_t *array, uint8_t max_size)
 {
     (void)sap;
-    std::string lls = client.GetLls();
+    std::string lls;
+
+    // Called from the session thread that performs the association
+    CosemClient *client = CosemClient::Current();
+    if (client != NULL)
+    {
+        lls = client->GetLls();
+    }
 
     uint32_t size = (lls.size() > max_size) ? max_size : lls.size();
 
@@ -25,7 +36,8 @@ extern "C" void csm_hal_get_lls_password(uint8_t sap, uint8_t *array, uint8_t ma
 
 int main(int argc, char **argv)
 {
-    setbuf(stdout, NULL); // disable printf buffering
+    // Console output is written by a background thread
+    Log::Start();
 
    std::cout << "DLMS/Cosem client tool version " <<  COSEM_CLIENT_VER <<  " build date: " << __DATE__ << " " <<  __TIME__ << std::endl;
 
@@ -37,21 +49,27 @@ int main(int argc, char **argv)
 
         if (argc >= 5)
         {
-            client.SetStartDate(std::string(argv[4])); // startDate for the profiles
+            pool.SetStartDate(std::string(argv[4])); // startDate for the profiles
         }
 
         if (argc >= 6)
         {
-            client.SetEndDate(std::string(argv[5])); // endDate for the profiles
+            pool.SetEndDate(std::string(argv[5])); // endDate for the profiles
+        }
+
+        // One event loop for all the links, otherwise fall back to a reader thread
+        if (reactor.Start())
+        {
+            pool.SetReactor(&reactor);
         }
 
         // Before application, test connectivity
-        if (client.Initialize(commFile, objectsFile, meterFile))
+        if (pool.Initialize(commFile, objectsFile, meterFile))
         {
-            while (client.PerformTask());
+            pool.Run();
         }
 
-        client.PrintResult();
+        pool.PrintResult();
     }
     else
     {
@@ -61,8 +79,11 @@ int main(int argc, char **argv)
         puts("\r\nDate-time format: %Y-%m-%d.%H:%M:%S");
     }
 
-    printf("** Exit task loop, waiting for reading thread...\r\n");
-    client.WaitForStop();
+    LOG(LOG_INFO, "** Exit task loop, waiting for reading thread...");
+    pool.WaitForStop();
+    reactor.Stop();
+    UdpEndpoint::CloseAll();
+    Log::Stop();
 
     return 0;
 
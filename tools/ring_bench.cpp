@@ -0,0 +1,180 @@
+/**
+ * Receive path throughput benchmark: legacy string/mutex/semaphore hand-over
+ * versus the Transport ring, read through WaitForData() and WaitForMore()/Peek()
+ *
+ * Copyright (c) 2016, Anthony Rabine
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms of the BSD license.
+ * See LICENSE.txt for more details.
+ *
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <cstdlib>
+#include "Transport.h"
+#include "sema.h"
+
+static const uint32_t cBufferSize = 64U*1024U;
+static volatile uint8_t gSink; // Keeps the consumer work from being optimized out
+
+// Reproduces the former Transport::Reader()/WaitForData() hand-over
+static double LegacyPath(uint64_t total, uint32_t chunk)
+{
+    std::string shared;
+    std::mutex mutex;
+    Semaphore sem;
+    char rcvBuffer[cBufferSize];
+    uint64_t received = 0U;
+
+    for (uint32_t i = 0U; i < chunk; i++)
+    {
+        rcvBuffer[i] = static_cast<char>(i);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::thread producer([&]() {
+        for (uint64_t sent = 0U; sent < total; sent += chunk)
+        {
+            std::string data(&rcvBuffer[0], chunk);
+            mutex.lock();
+            shared += data;
+            mutex.unlock();
+            sem.signal();
+        }
+    });
+
+    while (received < total)
+    {
+        std::string data;
+        if (sem.wait(1))
+        {
+            mutex.lock();
+            data += shared;
+            shared.clear();
+            mutex.unlock();
+        }
+        received += data.size();
+    }
+
+    producer.join();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Exposes the reception entry used by the replay transport and the UDP endpoint
+class BenchTransport : public Transport
+{
+public:
+    BenchTransport()
+    {
+        SetOpened(Transport::Params(), true);
+    }
+
+    void Receive(const uint8_t *data, uint32_t size)
+    {
+        Push(data, size);
+    }
+};
+
+// Runs the shipped Transport hand-over: the producer publishes into the ring and
+// wakes the consumer, the consumer blocks in WaitForMore()/WaitForData()
+static double TransportPath(uint64_t total, uint32_t chunk, bool inPlace)
+{
+    BenchTransport transport;
+    uint8_t rcvBuffer[cBufferSize];
+    uint64_t received = 0U;
+    uint8_t checksum = 0U;
+
+    for (uint32_t i = 0U; i < chunk; i++)
+    {
+        rcvBuffer[i] = static_cast<uint8_t>(i);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::thread producer([&]() {
+        for (uint64_t sent = 0U; sent < total; sent += chunk)
+        {
+            // A link reader stops reading when the ring is full, never truncates
+            while (transport.Readable() > (cBufferSize - chunk))
+            {
+                std::this_thread::yield();
+            }
+            transport.Receive(&rcvBuffer[0], chunk);
+        }
+    });
+
+    while (received < total)
+    {
+        if (inPlace)
+        {
+            // HDLC and wrapper processing: parse in place, then consume
+            if (transport.WaitForMore(0U, 1000U))
+            {
+                const uint8_t *ptr;
+                uint32_t size = transport.Peek(ptr);
+                checksum ^= ptr[size - 1U];
+                transport.Consume(size);
+                received += size;
+            }
+        }
+        else
+        {
+            std::string data;
+            transport.WaitForData(data, 1000U);
+            if (data.size() > 0U)
+            {
+                checksum ^= static_cast<uint8_t>(data[data.size() - 1U]);
+            }
+            received += data.size();
+        }
+    }
+
+    producer.join();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    gSink = checksum;
+    return elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t total = 64U*1024U*1024U;
+
+    if (argc >= 2)
+    {
+        total = std::strtoull(argv[1], NULL, 10) * 1024U * 1024U;
+    }
+
+    const uint32_t chunks[] = { 16U, 128U, 1024U, 4096U };
+
+    std::cout << "Transferring " << (total / (1024U*1024U)) << " MiB per run" << std::endl;
+    std::cout << std::setw(8) << "chunk" << std::setw(16) << "legacy MiB/s"
+              << std::setw(16) << "string MiB/s" << std::setw(16) << "peek MiB/s" << std::endl;
+
+    for (uint32_t i = 0U; i < (sizeof(chunks) / sizeof(chunks[0])); i++)
+    {
+        uint32_t chunk = chunks[i];
+        uint64_t bytes = (total / chunk) * chunk;
+        double mib = static_cast<double>(bytes) / (1024.0 * 1024.0);
+
+        double legacy = LegacyPath(bytes, chunk);
+        double copied = TransportPath(bytes, chunk, false);
+        double inPlace = TransportPath(bytes, chunk, true);
+
+        std::cout << std::setw(8) << chunk
+                  << std::setw(16) << std::fixed << std::setprecision(1) << (mib / legacy)
+                  << std::setw(16) << std::fixed << std::setprecision(1) << (mib / copied)
+                  << std::setw(16) << std::fixed << std::setprecision(1) << (mib / inPlace) << std::endl;
+    }
+
+    return 0;
+}